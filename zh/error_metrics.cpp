@@ -0,0 +1,145 @@
+#include "error_metrics.h"
+#include "parallel_for.h"
+#include <math.h>
+#include <stdio.h>
+#include <chrono>
+
+#define PI 3.14159265358979
+#define ERROR_CHUNK 256
+
+void makeEqualAreaNormals(int count, NormalSet& normals) {
+    normals.count = count;
+    normals.x.resize(count);
+    normals.y.resize(count);
+    normals.z.resize(count);
+    const double golden = PI * (3.0 - sqrt(5.0));
+    for (int i = 0; i < count; ++i) {
+        double z = 1.0 - (2.0 * i + 1.0) / count;
+        double r = sqrt(1.0 - z * z);
+        double phi = golden * i;
+        normals.x[i] = (float)(r * cos(phi));
+        normals.y[i] = (float)(r * sin(phi));
+        normals.z[i] = (float)z;
+    }
+}
+
+float errorRms(const IrradianceError& error) {
+    return error.samples > 0 ? (float)sqrt(error.sumSq / error.samples) : 0.0f;
+}
+
+float errorRelativeRms(const IrradianceError& error) {
+    return error.targetSq > 0.0 ? (float)sqrt(error.sumSq / error.targetSq) : 0.0f;
+}
+
+float errorRelativeMax(const IrradianceError& error) {
+    return error.maxTarget > 0.0f ? error.maxError / error.maxTarget : 0.0f;
+}
+
+void accumulateIrradianceError(const IrradiancePoly& poly, const NormalSet& normals, const float* target,
+    IrradianceError& error) {
+    int n = normals.count;
+    float value[3][ERROR_CHUNK];
+    for (int begin = 0; begin < n; begin += ERROR_CHUNK) {
+        int count = n - begin < ERROR_CHUNK ? n - begin : ERROR_CHUNK;
+        evalIrradiancePolyRow(poly, &normals.x[begin], &normals.y[begin], &normals.z[begin], count,
+            value[0], value[1], value[2]);
+        for (int col = 0; col < 3; ++col) {
+            const float* v = value[col];
+            const float* t = target + (size_t)col * n + begin;
+            float sumSq = 0.0f, targetSq = 0.0f;
+            float maxError = error.maxError, maxTarget = error.maxTarget;
+            for (int i = 0; i < count; ++i) {
+                float d = v[i] - t[i];
+                sumSq += d * d;
+                targetSq += t[i] * t[i];
+                maxError = fmaxf(maxError, fabsf(d));
+                maxTarget = fmaxf(maxTarget, fabsf(t[i]));
+            }
+            error.sumSq += sumSq;
+            error.targetSq += targetSq;
+            error.maxError = maxError;
+            error.maxTarget = maxTarget;
+        }
+    }
+    error.samples += 3 * n;
+}
+
+void measureMethodErrors(const float* probes, int probeCount, const NormalSet& normals, const float* referenceTargets,
+    std::vector<MethodError>& errors) {
+    errors.assign((size_t)probeCount * IRRADIANCE_METHOD_COUNT, MethodError());
+    int n = normals.count;
+    parallelFor(probeCount * IRRADIANCE_METHOD_COUNT, 1, [&](int begin, int end) {
+        std::vector<float> sh3Target((size_t)n * 3);
+        int sh3Probe = -1;
+        for (int task = begin; task < end; ++task) {
+            int p = task / IRRADIANCE_METHOD_COUNT;
+            IrradianceMethod method = (IrradianceMethod)(task % IRRADIANCE_METHOD_COUNT);
+            const float (*sh)[3] = (const float (*)[3])(probes + (size_t)p * 27);
+            float k2[3];
+            fitZH3PerChannelK2(sh, k2);
+            if (p != sh3Probe) {
+                IrradiancePoly sh3;
+                buildIrradiancePoly(IRRADIANCE_SH3, sh, k2, sh3);
+                evalIrradianceNormals(sh3, normals, &sh3Target[0]);
+                sh3Probe = p;
+            }
+            IrradiancePoly poly;
+            buildIrradiancePoly(method, sh, k2, poly);
+            MethodError& error = errors[task];
+            accumulateIrradianceError(poly, normals, &sh3Target[0], error.vsSH3);
+            if (referenceTargets)
+                accumulateIrradianceError(poly, normals, referenceTargets + (size_t)p * n * 3, error.vsReference);
+        }
+    });
+}
+
+static void addError(IrradianceError& total, const IrradianceError& error) {
+    total.sumSq += error.sumSq;
+    total.targetSq += error.targetSq;
+    total.maxError = fmaxf(total.maxError, error.maxError);
+    total.maxTarget = fmaxf(total.maxTarget, error.maxTarget);
+    total.samples += error.samples;
+}
+
+static void printErrorRow(const char* method, const MethodError& error, bool hasReference) {
+    const IrradianceError& s = error.vsSH3;
+    const IrradianceError& r = error.vsReference;
+    printf("  %-17s %10.5f %10.5f %9.3f%% %9.3f%%", method, errorRms(s), s.maxError,
+        100.0f * errorRelativeRms(s), 100.0f * errorRelativeMax(s));
+    if (hasReference)
+        printf(" %10.5f %10.5f %9.3f%% %9.3f%%", errorRms(r), r.maxError,
+            100.0f * errorRelativeRms(r), 100.0f * errorRelativeMax(r));
+    printf("\n");
+}
+
+void reportMethodErrors(const char* const* names, const float* probes, int probeCount, const NormalSet& normals,
+    const float* referenceTargets) {
+    if (probeCount <= 0) return;
+    std::vector<MethodError> errors;
+    auto start = std::chrono::high_resolution_clock::now();
+    measureMethodErrors(probes, probeCount, normals, referenceTargets, errors);
+    auto end = std::chrono::high_resolution_clock::now();
+    double ms = std::chrono::duration<double, std::milli>(end - start).count();
+
+    bool hasReference = referenceTargets != NULL;
+    printf("Reconstruction error over %d equal-area normals, %d probes x %d methods in %.2f ms\n",
+        normals.count, probeCount, IRRADIANCE_METHOD_COUNT, ms);
+    printf("  %-17s %10s %10s %10s %10s", "method", "rms/SH3", "max/SH3", "rel rms", "rel max");
+    if (hasReference)
+        printf(" %10s %10s %10s %10s", "rms/ref", "max/ref", "rel rms", "rel max");
+    printf("\n");
+
+    MethodError total[IRRADIANCE_METHOD_COUNT] = {};
+    for (int p = 0; p < probeCount; ++p) {
+        printf("%s\n", names[p]);
+        for (int m = 0; m < IRRADIANCE_METHOD_COUNT; ++m) {
+            const MethodError& error = errors[(size_t)p * IRRADIANCE_METHOD_COUNT + m];
+            printErrorRow(irradianceMethodName((IrradianceMethod)m), error, hasReference);
+            addError(total[m].vsSH3, error.vsSH3);
+            addError(total[m].vsReference, error.vsReference);
+        }
+    }
+    printf("all probes\n");
+    for (int m = 0; m < IRRADIANCE_METHOD_COUNT; ++m)
+        printErrorRow(irradianceMethodName((IrradianceMethod)m), total[m], hasReference);
+}
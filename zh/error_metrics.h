@@ -0,0 +1,41 @@
+// error_metrics.h
+#pragma once
+#include <vector>
+#include "irradiance.h"
+
+// count unit normals on a Fibonacci spiral; every point covers the same solid angle
+// to within the spiral's discrepancy, so plain averages are sphere integrals.
+void makeEqualAreaNormals(int count, NormalSet& normals);
+
+// Running sums over normals and channels. Start from {} and accumulate into it.
+struct IrradianceError {
+    double sumSq;     // squared error
+    double targetSq;  // squared target
+    float maxError;
+    float maxTarget;
+    int samples;      // normals * channels
+};
+
+float errorRms(const IrradianceError& error);
+float errorRelativeRms(const IrradianceError& error); // rms error over rms target
+float errorRelativeMax(const IrradianceError& error); // max error over max target
+
+// Add the error of poly at every normal against target, laid out like evalIrradianceNormals.
+void accumulateIrradianceError(const IrradiancePoly& poly, const NormalSet& normals, const float* target,
+    IrradianceError& error);
+
+struct MethodError {
+    IrradianceError vsSH3;
+    IrradianceError vsReference; // left empty without reference values
+};
+
+// Compare every IrradianceMethod on every probe (27 floats of cosine-convolved SH each)
+// against SH3 and, when referenceTargets is not null, against normals.count * 3 reference
+// values per probe. errors receives probeCount * IRRADIANCE_METHOD_COUNT entries, method
+// fastest. Probes and methods are spread over all cores.
+void measureMethodErrors(const float* probes, int probeCount, const NormalSet& normals, const float* referenceTargets,
+    std::vector<MethodError>& errors);
+
+// Print the comparison per probe and averaged over the set, with the time taken.
+void reportMethodErrors(const char* const* names, const float* probes, int probeCount, const NormalSet& normals,
+    const float* referenceTargets);
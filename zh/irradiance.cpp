@@ -0,0 +1,134 @@
+#include "irradiance.h"
+#include <math.h>
+#include <string.h>
+
+#define PI 3.14159265358979
+
+static const float c0 = (float)(1.0 / (2.0 * sqrt(PI)));
+static const float c1 = (float)sqrt(3.0 / (4.0 * PI));
+static const float c2 = (float)sqrt(15.0 / (4.0 * PI));
+static const float c3 = (float)sqrt(5.0 / (16.0 * PI));
+static const float c4 = (float)sqrt(15.0 / (16.0 * PI));
+
+const char* irradianceMethodName(IrradianceMethod method) {
+    switch (method) {
+    case IRRADIANCE_SH2: return "SH2";
+    case IRRADIANCE_SH3: return "SH3";
+    case IRRADIANCE_ZH3: return "ZH3";
+    case IRRADIANCE_SHARED: return "ZH3 shared";
+    case IRRADIANCE_HALLUCINATED: return "ZH3 hallucinated";
+    }
+    return "?";
+}
+
+static bool zonalAxis(float sh1, float sh2, float sh3, float axis[3]) {
+    axis[0] = -sh3;
+    axis[1] = -sh1;
+    axis[2] = sh2;
+    float len = sqrtf(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+    if (len < 1e-12f) return false;
+    for (int i = 0; i < 3; ++i) axis[i] /= len;
+    return true;
+}
+
+// k * Y20(dot(axis, n)) expanded into the polynomial terms of one channel.
+static void addZonal(IrradiancePoly& poly, int col, const float axis[3], float k) {
+    float s = 3.0f * c3 * k;
+    poly.c[col] -= c3 * k;
+    poly.q[col][0] += s * axis[0] * axis[0];
+    poly.q[col][1] += s * axis[1] * axis[1];
+    poly.q[col][2] += s * axis[2] * axis[2];
+    poly.q[col][3] += 2.0f * s * axis[0] * axis[1];
+    poly.q[col][4] += 2.0f * s * axis[1] * axis[2];
+    poly.q[col][5] += 2.0f * s * axis[0] * axis[2];
+}
+
+void buildIrradiancePoly(IrradianceMethod method, const float sh[9][3], const float k2[3], IrradiancePoly& poly) {
+    memset(&poly, 0, sizeof(poly));
+    for (int col = 0; col < 3; ++col) {
+        poly.c[col] = c0 * sh[0][col];
+        poly.l[col][0] = -c1 * sh[3][col];
+        poly.l[col][1] = -c1 * sh[1][col];
+        poly.l[col][2] = c1 * sh[2][col];
+    }
+
+    if (method == IRRADIANCE_SH3) {
+        for (int col = 0; col < 3; ++col) {
+            poly.q[col][3] += c2 * sh[4][col];
+            poly.q[col][4] -= c2 * sh[5][col];
+            poly.q[col][2] += 3.0f * c3 * sh[6][col];
+            poly.c[col] -= c3 * sh[6][col];
+            poly.q[col][5] -= c2 * sh[7][col];
+            poly.q[col][0] += c4 * sh[8][col];
+            poly.q[col][1] -= c4 * sh[8][col];
+        }
+    }
+    else if (method == IRRADIANCE_ZH3) {
+        for (int col = 0; col < 3; ++col) {
+            float axis[3];
+            if (zonalAxis(sh[1][col], sh[2][col], sh[3][col], axis))
+                addZonal(poly, col, axis, k2[col]);
+        }
+    }
+    else if (method == IRRADIANCE_SHARED) {
+        ZH3Packet packet;
+        fitZH3Shared(sh, packet);
+        buildIrradiancePoly(packet, poly);
+    }
+    else if (method == IRRADIANCE_HALLUCINATED) {
+        ZH3Packet packet;
+        fitZH3Hallucinated(sh, packet);
+        buildIrradiancePoly(packet, poly);
+    }
+}
+
+void buildIrradiancePoly(const ZH3Packet& packet, IrradiancePoly& poly) {
+    const float* a = packet.axis;
+    for (int col = 0; col < 3; ++col) {
+        float k = packet.k2[col];
+        poly.c[col] = packet.l0[col];
+        for (int i = 0; i < 3; ++i)
+            poly.l[col][i] = packet.l1[i][col];
+        poly.q[col][0] = k * a[0] * a[0];
+        poly.q[col][1] = k * a[1] * a[1];
+        poly.q[col][2] = k * a[2] * a[2];
+        poly.q[col][3] = 2.0f * k * a[0] * a[1];
+        poly.q[col][4] = 2.0f * k * a[1] * a[2];
+        poly.q[col][5] = 2.0f * k * a[0] * a[2];
+    }
+}
+
+void evalIrradiancePoly(const IrradiancePoly& poly, const float n[3], float out[3]) {
+    float x = n[0], y = n[1], z = n[2];
+    for (int col = 0; col < 3; ++col) {
+        const float* l = poly.l[col];
+        const float* q = poly.q[col];
+        out[col] = poly.c[col] + l[0] * x + l[1] * y + l[2] * z
+            + q[0] * x * x + q[1] * y * y + q[2] * z * z + q[3] * x * y + q[4] * y * z + q[5] * x * z;
+    }
+}
+
+void evalIrradiancePolyRow(const IrradiancePoly& poly, const float* x, const float* y, const float* z, int count,
+    float* r, float* g, float* b) {
+    float* out[3] = { r, g, b };
+    // One channel per pass keeps the ten coefficients in registers and the loop free
+    // of branches, so it vectorizes across normals.
+    for (int col = 0; col < 3; ++col) {
+        const float c = poly.c[col];
+        const float lx = poly.l[col][0], ly = poly.l[col][1], lz = poly.l[col][2];
+        const float qxx = poly.q[col][0], qyy = poly.q[col][1], qzz = poly.q[col][2];
+        const float qxy = poly.q[col][3], qyz = poly.q[col][4], qxz = poly.q[col][5];
+        float* dst = out[col];
+        for (int i = 0; i < count; ++i) {
+            float nx = x[i], ny = y[i], nz = z[i];
+            dst[i] = c + lx * nx + ly * ny + lz * nz
+                + nx * (qxx * nx + qxy * ny + qxz * nz) + ny * (qyy * ny + qyz * nz) + qzz * nz * nz;
+        }
+    }
+}
+
+void evalIrradianceNormals(const IrradiancePoly& poly, const NormalSet& normals, float* out) {
+    int n = normals.count;
+    if (n == 0) return;
+    evalIrradiancePolyRow(poly, &normals.x[0], &normals.y[0], &normals.z[0], n, out, out + n, out + 2 * n);
+}
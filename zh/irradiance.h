@@ -0,0 +1,45 @@
+// irradiance.h
+#pragma once
+#include <vector>
+#include "zh3_fit.h"
+
+// CPU counterparts of the reconstructions in shader.frag.
+enum IrradianceMethod {
+    IRRADIANCE_SH2,     // calcIrradianceSH2_mine
+    IRRADIANCE_SH3,     // calcIrradianceSH3_mine
+    IRRADIANCE_ZH3,     // calcIrradianceZH3, one zonal axis per channel
+    IRRADIANCE_SHARED,  // calcIrradianceShared, luminance zonal axis
+    IRRADIANCE_HALLUCINATED // calcIrradianceHallucinated, K2 hallucinated from sh[0..3]
+};
+
+#define IRRADIANCE_METHOD_COUNT 5
+
+const char* irradianceMethodName(IrradianceMethod method);
+
+// On unit normals every reconstruction is a quadratic polynomial per channel:
+// E(n) = c + dot(l, n) + xx*x*x + yy*y*y + zz*z*z + xy*x*y + yz*y*z + xz*x*z.
+// Building it once per probe leaves a handful of multiply-adds per normal.
+struct IrradiancePoly {
+    float c[3];
+    float l[3][3];  // [channel][x, y, z]
+    float q[3][6];  // [channel][xx, yy, zz, xy, yz, xz]
+};
+
+// sh and k2 are the cosine-convolved values uploaded to shader.frag. k2 holds the
+// per-channel-axis coefficients of IRRADIANCE_ZH3; IRRADIANCE_SHARED fits its own
+// along the luminance axis.
+void buildIrradiancePoly(IrradianceMethod method, const float sh[9][3], const float k2[3], IrradiancePoly& poly);
+void buildIrradiancePoly(const ZH3Packet& packet, IrradiancePoly& poly);
+void evalIrradiancePoly(const IrradiancePoly& poly, const float n[3], float out[3]);
+// Evaluate count normals stored as separate x, y, z arrays into separate r, g, b arrays.
+void evalIrradiancePolyRow(const IrradiancePoly& poly, const float* x, const float* y, const float* z, int count,
+    float* r, float* g, float* b);
+
+// Unit normals stored as separate x, y, z arrays.
+struct NormalSet {
+    int count = 0;
+    std::vector<float> x, y, z;
+};
+
+// Evaluate every normal of the set; out receives count r values, then g, then b.
+void evalIrradianceNormals(const IrradiancePoly& poly, const NormalSet& normals, float* out);
@@ -0,0 +1,213 @@
+#include "irradiance_batch.h"
+#include "error_metrics.h"
+#include "parallel_for.h"
+#include "sh_eval.h"
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#define BATCH_CHUNK 16384
+#define BATCH_BLOCK 1024  // normals per block, 12 KB of x, y, z stays in L1 across channels
+#define BENCHMARK_PROBES 256
+
+typedef ShVec3<FloatW> Vec3W;
+
+static void evalPolyRange(const IrradiancePoly& poly, const float* x, const float* y, const float* z, int count,
+    float* const out[3]) {
+    for (int begin = 0; begin < count; begin += BATCH_BLOCK) {
+        int end = std::min(count, begin + BATCH_BLOCK);
+        for (int col = 0; col < 3; ++col) {
+            const FloatW c(poly.c[col]);
+            const FloatW lx(poly.l[col][0]), ly(poly.l[col][1]), lz(poly.l[col][2]);
+            const FloatW qxx(poly.q[col][0]), qyy(poly.q[col][1]), qzz(poly.q[col][2]);
+            const FloatW qxy(poly.q[col][3]), qyz(poly.q[col][4]), qxz(poly.q[col][5]);
+            float* dst = out[col];
+            int i = begin;
+            for (; i + SIMD_FLOAT_WIDTH <= end; i += SIMD_FLOAT_WIDTH) {
+                FloatW nx = FloatW::load(x + i), ny = FloatW::load(y + i), nz = FloatW::load(z + i);
+                FloatW v = c + lx * nx + ly * ny + lz * nz
+                    + nx * (qxx * nx + qxy * ny + qxz * nz) + ny * (qyy * ny + qyz * nz) + qzz * nz * nz;
+                v.store(dst + i);
+            }
+            for (; i < end; ++i) {
+                float n[3] = { x[i], y[i], z[i] }, e[3];
+                evalIrradiancePoly(poly, n, e);
+                dst[i] = e[col];
+            }
+        }
+    }
+}
+
+template <typename Fn>
+static void evalDirectRange(const float* x, const float* y, const float* z, int count, float* const out[3], Fn fn) {
+    int i = 0;
+    for (; i + SIMD_FLOAT_WIDTH <= count; i += SIMD_FLOAT_WIDTH) {
+        Vec3W e = fn(Vec3W(FloatW::load(x + i), FloatW::load(y + i), FloatW::load(z + i)));
+        e.x.store(out[0] + i);
+        e.y.store(out[1] + i);
+        e.z.store(out[2] + i);
+    }
+    if (i == count) return;
+    // Pad the tail with +z so every lane holds a valid normal.
+    float px[SIMD_FLOAT_WIDTH], py[SIMD_FLOAT_WIDTH], pz[SIMD_FLOAT_WIDTH];
+    float pr[SIMD_FLOAT_WIDTH], pg[SIMD_FLOAT_WIDTH], pb[SIMD_FLOAT_WIDTH];
+    for (int k = 0; k < SIMD_FLOAT_WIDTH; ++k) {
+        bool valid = i + k < count;
+        px[k] = valid ? x[i + k] : 0.0f;
+        py[k] = valid ? y[i + k] : 0.0f;
+        pz[k] = valid ? z[i + k] : 1.0f;
+    }
+    Vec3W e = fn(Vec3W(FloatW::load(px), FloatW::load(py), FloatW::load(pz)));
+    e.x.store(pr);
+    e.y.store(pg);
+    e.z.store(pb);
+    for (int k = 0; i + k < count; ++k) {
+        out[0][i + k] = pr[k];
+        out[1][i + k] = pg[k];
+        out[2][i + k] = pb[k];
+    }
+}
+
+static void evalMethodRange(IrradianceMethod method, const float* probe, const float* x, const float* y, const float* z,
+    int count, float* const out[3]) {
+    // sh_eval.h applies the cosine lobe itself, so undo it on the broadcast coefficients.
+    Vec3W env[9];
+    for (int i = 0; i < 9; ++i) {
+        float band = cosLobe[i == 0 ? 0 : (i < 4 ? 1 : 2)];
+        const float* c = probe + i * 3;
+        env[i] = Vec3W(FloatW(c[0] / band), FloatW(c[1] / band), FloatW(c[2] / band));
+    }
+    switch (method) {
+    case IRRADIANCE_SH2:
+        evalDirectRange(x, y, z, count, out, [&](const Vec3W& n) { return SH2_EvalIrradiance(env, n); });
+        break;
+    case IRRADIANCE_SH3:
+        evalDirectRange(x, y, z, count, out, [&](const Vec3W& n) { return SH3_EvalIrradiance(env, n); });
+        break;
+    case IRRADIANCE_ZH3:
+        evalDirectRange(x, y, z, count, out, [&](const Vec3W& n) { return ZH3_EvalIrradiance(env, n); });
+        break;
+    case IRRADIANCE_SHARED:
+        evalDirectRange(x, y, z, count, out, [&](const Vec3W& n) { return ZH3_EvalIrradianceLumAxis(env, n); });
+        break;
+    case IRRADIANCE_HALLUCINATED:
+        evalDirectRange(x, y, z, count, out, [&](const Vec3W& n) { return ZH3Hallucinate_EvalIrradianceLumAxis(env, n); });
+        break;
+    }
+}
+
+// Run fn(probe, begin, end) on every probe range overlapping each chunk, chunks in parallel.
+template <typename Fn>
+static void forEachProbeRange(int probeCount, const int* probeOffsets, int count, Fn fn) {
+    parallelFor(count, BATCH_CHUNK, [&](int begin, int end) {
+        if (!probeOffsets) {
+            fn(0, begin, end);
+            return;
+        }
+        int p = (int)(std::upper_bound(probeOffsets, probeOffsets + probeCount + 1, begin) - probeOffsets) - 1;
+        for (; p < probeCount && probeOffsets[p] < end; ++p) {
+            int first = std::max(begin, probeOffsets[p]);
+            int last = std::min(end, probeOffsets[p + 1]);
+            if (first < last) fn(p, first, last);
+        }
+    });
+}
+
+void evalIrradianceBatch(const IrradiancePoly* probes, int probeCount, const int* probeOffsets,
+    const float* x, const float* y, const float* z, int count, float* r, float* g, float* b) {
+    forEachProbeRange(probeCount, probeOffsets, count, [&](int p, int begin, int end) {
+        float* const out[3] = { r + begin, g + begin, b + begin };
+        evalPolyRange(probes[p], x + begin, y + begin, z + begin, end - begin, out);
+    });
+}
+
+void evalIrradianceBatchDirect(IrradianceMethod method, const float* probes, int probeCount, const int* probeOffsets,
+    const float* x, const float* y, const float* z, int count, float* r, float* g, float* b) {
+    forEachProbeRange(probeCount, probeOffsets, count, [&](int p, int begin, int end) {
+        float* const out[3] = { r + begin, g + begin, b + begin };
+        evalMethodRange(method, probes + (size_t)p * 27, x + begin, y + begin, z + begin, end - begin, out);
+    });
+}
+
+void bakeVertexIrradiance(const IrradiancePoly& poly, const float* vertices, int vertexCount, int stride,
+    int normalOffset, float* rgb) {
+    std::vector<float> soa((size_t)vertexCount * 6);
+    float* x = &soa[0];
+    float* y = x + vertexCount;
+    float* z = y + vertexCount;
+    for (int i = 0; i < vertexCount; ++i) {
+        const float* n = vertices + (size_t)i * stride + normalOffset;
+        x[i] = n[0];
+        y[i] = n[1];
+        z[i] = n[2];
+    }
+    float* r = z + vertexCount;
+    float* g = r + vertexCount;
+    float* b = g + vertexCount;
+    evalIrradianceBatch(&poly, 1, NULL, x, y, z, vertexCount, r, g, b);
+    for (int i = 0; i < vertexCount; ++i) {
+        rgb[(size_t)i * 3 + 0] = r[i];
+        rgb[(size_t)i * 3 + 1] = g[i];
+        rgb[(size_t)i * 3 + 2] = b[i];
+    }
+}
+
+template <typename Fn>
+static double bestSeconds(Fn fn) {
+    double best = 1e30;
+    for (int run = 0; run < 4; ++run) {
+        auto start = std::chrono::high_resolution_clock::now();
+        fn();
+        auto end = std::chrono::high_resolution_clock::now();
+        if (run > 0) best = std::min(best, std::chrono::duration<double>(end - start).count());
+    }
+    return best;
+}
+
+void benchmarkIrradianceBatch(const float sh[9][3], int normalCount) {
+    NormalSet normals;
+    makeEqualAreaNormals(normalCount, normals);
+    std::vector<float> rgb((size_t)normalCount * 3);
+    float* r = &rgb[0];
+    float* g = r + normalCount;
+    float* b = g + normalCount;
+    const float* x = &normals.x[0];
+    const float* y = &normals.y[0];
+    const float* z = &normals.z[0];
+
+    // Stand-in for a mesh split between many probes: equal runs of a dimming probe.
+    std::vector<float> probes((size_t)BENCHMARK_PROBES * 27);
+    std::vector<int> offsets(BENCHMARK_PROBES + 1);
+    for (int p = 0; p < BENCHMARK_PROBES; ++p) {
+        for (int i = 0; i < 27; ++i)
+            probes[(size_t)p * 27 + i] = (&sh[0][0])[i] * (1.0f - 0.5f * p / BENCHMARK_PROBES);
+        offsets[p] = (int)((long long)normalCount * p / BENCHMARK_PROBES);
+    }
+    offsets[BENCHMARK_PROBES] = normalCount;
+
+    printf("Batched irradiance over %d normals, %d-wide SIMD (M normals/s)\n", normalCount, SIMD_FLOAT_WIDTH);
+    printf("  %-17s %12s %12s %12s %12s\n", "method", "poly", "poly x256", "direct", "direct x256");
+    for (int m = 0; m < IRRADIANCE_METHOD_COUNT; ++m) {
+        IrradianceMethod method = (IrradianceMethod)m;
+        std::vector<IrradiancePoly> polys(BENCHMARK_PROBES);
+        for (int p = 0; p < BENCHMARK_PROBES; ++p) {
+            const float (*probe)[3] = (const float (*)[3])&probes[(size_t)p * 27];
+            float k2[3];
+            fitZH3PerChannelK2(probe, k2);
+            buildIrradiancePoly(method, probe, k2, polys[p]);
+        }
+        double poly = bestSeconds([&]() { evalIrradianceBatch(&polys[0], 1, NULL, x, y, z, normalCount, r, g, b); });
+        double polyMany = bestSeconds([&]() {
+            evalIrradianceBatch(&polys[0], BENCHMARK_PROBES, &offsets[0], x, y, z, normalCount, r, g, b);
+        });
+        double direct = bestSeconds([&]() {
+            evalIrradianceBatchDirect(method, &probes[0], 1, NULL, x, y, z, normalCount, r, g, b);
+        });
+        double directMany = bestSeconds([&]() {
+            evalIrradianceBatchDirect(method, &probes[0], BENCHMARK_PROBES, &offsets[0], x, y, z, normalCount, r, g, b);
+        });
+        printf("  %-17s %12.1f %12.1f %12.1f %12.1f\n", irradianceMethodName(method), normalCount / poly * 1e-6,
+            normalCount / polyMany * 1e-6, normalCount / direct * 1e-6, normalCount / directMany * 1e-6);
+    }
+}
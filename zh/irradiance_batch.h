@@ -0,0 +1,26 @@
+// irradiance_batch.h
+#pragma once
+#include "irradiance.h"
+
+// Streaming irradiance for large SoA normal arrays, e.g. every vertex of a mesh.
+// Normals lit by the same probe are contiguous: probe p covers
+// [probeOffsets[p], probeOffsets[p + 1]). probeOffsets may be null when
+// probeCount is 1. The array is split into chunks spread over all cores; inside a
+// chunk each probe range runs one channel at a time with its ten coefficients held
+// in SIMD registers.
+void evalIrradianceBatch(const IrradiancePoly* probes, int probeCount, const int* probeOffsets,
+    const float* x, const float* y, const float* z, int count, float* r, float* g, float* b);
+
+// The same pass evaluating method the way shader.frag and st.cpp do, rederiving
+// axes and zonal coefficients from the SH per lane, for comparison.
+// probes holds probeCount cosine-convolved SH sets of 27 floats.
+void evalIrradianceBatchDirect(IrradianceMethod method, const float* probes, int probeCount, const int* probeOffsets,
+    const float* x, const float* y, const float* z, int count, float* r, float* g, float* b);
+
+// Bake irradiance for vertexCount interleaved vertices whose normal starts at
+// normalOffset floats into each stride-float record; rgb receives 3 floats per vertex.
+void bakeVertexIrradiance(const IrradiancePoly& poly, const float* vertices, int vertexCount, int stride,
+    int normalOffset, float* rgb);
+
+// Print normals per second of both passes for every method over normalCount normals.
+void benchmarkIrradianceBatch(const float sh[9][3], int normalCount);
@@ -0,0 +1,138 @@
+#include "irradiance_map.h"
+#include "parallel_for.h"
+#include <math.h>
+#include <stdio.h>
+#include <chrono>
+
+static float signNotZero(float x) {
+    return x >= 0.0f ? 1.0f : -1.0f;
+}
+
+void octahedralEncode(const float dir[3], float& u, float& v) {
+    float s = fabsf(dir[0]) + fabsf(dir[1]) + fabsf(dir[2]);
+    float px = dir[0] / s;
+    float py = dir[1] / s;
+    if (dir[2] < 0.0f) {
+        float ox = (1.0f - fabsf(py)) * signNotZero(px);
+        float oy = (1.0f - fabsf(px)) * signNotZero(py);
+        px = ox;
+        py = oy;
+    }
+    u = px * 0.5f + 0.5f;
+    v = py * 0.5f + 0.5f;
+}
+
+void octahedralDecode(float u, float v, float dir[3]) {
+    float px = u * 2.0f - 1.0f;
+    float py = v * 2.0f - 1.0f;
+    float pz = 1.0f - fabsf(px) - fabsf(py);
+    if (pz < 0.0f) {
+        float ox = (1.0f - fabsf(py)) * signNotZero(px);
+        float oy = (1.0f - fabsf(px)) * signNotZero(py);
+        px = ox;
+        py = oy;
+    }
+    float len = sqrtf(px * px + py * py + pz * pz);
+    dir[0] = px / len;
+    dir[1] = py / len;
+    dir[2] = pz / len;
+}
+
+void bakeIrradianceMap(const IrradiancePoly& poly, int size, IrradianceMap& map) {
+    map.size = size;
+    map.texels.assign((size_t)size * size * 3, 0.0f);
+    parallelFor(size, 4, [&](int begin, int end) {
+        std::vector<float> row((size_t)size * 6);
+        float* x = &row[0];
+        float* y = x + size;
+        float* z = y + size;
+        float* r = z + size;
+        float* g = r + size;
+        float* b = g + size;
+        for (int j = begin; j < end; ++j) {
+            float v = (j + 0.5f) / size;
+            for (int i = 0; i < size; ++i) {
+                float dir[3];
+                octahedralDecode((i + 0.5f) / size, v, dir);
+                x[i] = dir[0];
+                y[i] = dir[1];
+                z[i] = dir[2];
+            }
+            evalIrradiancePolyRow(poly, x, y, z, size, r, g, b);
+            float* dst = &map.texels[(size_t)j * size * 3];
+            for (int i = 0; i < size; ++i) {
+                dst[i * 3 + 0] = r[i];
+                dst[i * 3 + 1] = g[i];
+                dst[i * 3 + 2] = b[i];
+            }
+        }
+    });
+}
+
+void sampleIrradianceMap(const IrradianceMap& map, const float n[3], float out[3]) {
+    float u, v;
+    octahedralEncode(n, u, v);
+    float fx = u * map.size - 0.5f;
+    float fy = v * map.size - 0.5f;
+    int x0 = (int)floorf(fx);
+    int y0 = (int)floorf(fy);
+    float tx = fx - x0;
+    float ty = fy - y0;
+    int x1 = x0 + 1;
+    int y1 = y0 + 1;
+    int last = map.size - 1;
+    x0 = x0 < 0 ? 0 : (x0 > last ? last : x0);
+    x1 = x1 < 0 ? 0 : (x1 > last ? last : x1);
+    y0 = y0 < 0 ? 0 : (y0 > last ? last : y0);
+    y1 = y1 < 0 ? 0 : (y1 > last ? last : y1);
+    const float* t00 = &map.texels[((size_t)y0 * map.size + x0) * 3];
+    const float* t10 = &map.texels[((size_t)y0 * map.size + x1) * 3];
+    const float* t01 = &map.texels[((size_t)y1 * map.size + x0) * 3];
+    const float* t11 = &map.texels[((size_t)y1 * map.size + x1) * 3];
+    for (int col = 0; col < 3; ++col) {
+        float top = t00[col] + (t10[col] - t00[col]) * tx;
+        float bottom = t01[col] + (t11[col] - t01[col]) * tx;
+        out[col] = top + (bottom - top) * ty;
+    }
+}
+
+void benchmarkIrradianceMap(const IrradianceMap& map, const ZH3Packet& packet, int width, int height) {
+    // Rasterize the sphere once so both timings only measure shading.
+    std::vector<float> normals;
+    float radius = 0.45f * (width < height ? width : height);
+    for (int j = 0; j < height; ++j) {
+        for (int i = 0; i < width; ++i) {
+            float px = (i + 0.5f - width * 0.5f) / radius;
+            float py = (j + 0.5f - height * 0.5f) / radius;
+            float rSq = px * px + py * py;
+            if (rSq > 1.0f) continue;
+            normals.push_back(px);
+            normals.push_back(py);
+            normals.push_back(sqrtf(1.0f - rSq));
+        }
+    }
+    int count = (int)(normals.size() / 3);
+    if (count == 0) return;
+
+    std::vector<float> analytic(normals.size());
+    std::vector<float> sampled(normals.size());
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < count; ++i)
+        evalZH3Packet(packet, &normals[i * 3], &analytic[i * 3]);
+    auto mid = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < count; ++i)
+        sampleIrradianceMap(map, &normals[i * 3], &sampled[i * 3]);
+    auto end = std::chrono::high_resolution_clock::now();
+
+    float maxError = 0.0f;
+    for (size_t i = 0; i < analytic.size(); ++i)
+        maxError = fmaxf(maxError, fabsf(analytic[i] - sampled[i]));
+
+    double analyticMs = std::chrono::duration<double, std::milli>(mid - start).count();
+    double sampledMs = std::chrono::duration<double, std::milli>(end - mid).count();
+    printf("Irradiance map %dx%d, %d pixels\n", map.size, map.size, count);
+    printf("  analytic shared : %.3f ms (%.2f ns/pixel)\n", analyticMs, analyticMs * 1e6 / count);
+    printf("  map lookup      : %.3f ms (%.2f ns/pixel)\n", sampledMs, sampledMs * 1e6 / count);
+    printf("  max abs error   : %g\n", maxError);
+}
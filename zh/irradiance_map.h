@@ -0,0 +1,24 @@
+// irradiance_map.h
+#pragma once
+#include <vector>
+#include "irradiance.h"
+#include "zh3_fit.h"
+
+// Irradiance baked into a size x size octahedral map of RGB floats,
+// row 0 at v = 0 so it can be uploaded to GL as is.
+struct IrradianceMap {
+    int size = 0;
+    std::vector<float> texels;
+};
+
+void octahedralEncode(const float dir[3], float& u, float& v);
+void octahedralDecode(float u, float v, float dir[3]);
+
+// Bake the polynomial at every texel centre, rows spread over all cores.
+void bakeIrradianceMap(const IrradiancePoly& poly, int size, IrradianceMap& map);
+// Bilinear lookup matching GL_LINEAR with GL_CLAMP_TO_EDGE.
+void sampleIrradianceMap(const IrradianceMap& map, const float n[3], float out[3]);
+
+// Time the map lookup against the analytic calcIrradianceShared (evalZH3Packet) for
+// every pixel of a CPU-rasterized width x height view of the unit sphere.
+void benchmarkIrradianceMap(const IrradianceMap& map, const ZH3Packet& packet, int width, int height);
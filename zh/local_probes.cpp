@@ -0,0 +1,142 @@
+#include "local_probes.h"
+#include "parallel_for.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+
+void packLocalProbes(const LocalProbe* probes, int count, std::vector<float>& texels) {
+    texels.assign((size_t)count * LOCAL_PROBE_TEXELS * 4, 0.0f);
+    for (int p = 0; p < count; ++p) {
+        float* dst = &texels[(size_t)p * LOCAL_PROBE_TEXELS * 4];
+        memcpy(dst, probes[p].position, 3 * sizeof(float));
+        dst[3] = probes[p].radius;
+        memcpy(dst + 4, probes[p].zh3, 15 * sizeof(float));
+    }
+}
+
+// Depth of the far plane of slice z; slice 0 starts at nearZ.
+static float sliceDepth(const ClusterGrid& grid, int z) {
+    return grid.nearZ * powf(grid.farZ / grid.nearZ, (float)z / grid.dim[2]);
+}
+
+void buildClusters(const LocalProbe* probes, int count, const float view[16], float fovY, float aspect,
+    ClusterGrid& grid, WorkerPool& workers) {
+    int tiles = grid.dim[0] * grid.dim[1];
+    float tanY = tanf(0.5f * fovY);
+    float tanX = tanY * aspect;
+
+    // View-space spheres with depth as a positive distance along the view direction.
+    std::vector<float> spheres((size_t)count * 4);
+    for (int p = 0; p < count; ++p) {
+        const float* w = probes[p].position;
+        float* s = &spheres[(size_t)p * 4];
+        s[0] = view[0] * w[0] + view[4] * w[1] + view[8] * w[2] + view[12];
+        s[1] = view[1] * w[0] + view[5] * w[1] + view[9] * w[2] + view[13];
+        s[2] = -(view[2] * w[0] + view[6] * w[1] + view[10] * w[2] + view[14]);
+        s[3] = probes[p].radius;
+    }
+
+    std::vector<std::vector<unsigned int>> sliceLists(grid.dim[2]);
+    std::vector<std::vector<unsigned int>> sliceCounts(grid.dim[2]);
+    workers.run(grid.dim[2], 1, [&](int begin, int end) {
+        std::vector<std::vector<unsigned int>> lists(tiles);
+        for (int z = begin; z < end; ++z) {
+            for (int t = 0; t < tiles; ++t) lists[t].clear();
+            float z0 = sliceDepth(grid, z), z1 = sliceDepth(grid, z + 1);
+            for (int p = 0; p < count; ++p) {
+                const float* s = &spheres[(size_t)p * 4];
+                if (s[2] + s[3] < z0 || s[2] - s[3] > z1) continue;
+                // Tile range of the sphere's box within the slice: x / z is monotonic in z
+                // for a fixed x, so the extremes lie at the slice's depth bounds.
+                float za = std::max(z0, s[2] - s[3]), zb = std::min(z1, s[2] + s[3]);
+                float ndc[4] = { 1e30f, -1e30f, 1e30f, -1e30f };
+                for (int e = 0; e < 2; ++e) {
+                    float d = e ? zb : za;
+                    ndc[0] = std::min(ndc[0], (s[0] - s[3]) / (d * tanX));
+                    ndc[1] = std::max(ndc[1], (s[0] + s[3]) / (d * tanX));
+                    ndc[2] = std::min(ndc[2], (s[1] - s[3]) / (d * tanY));
+                    ndc[3] = std::max(ndc[3], (s[1] + s[3]) / (d * tanY));
+                }
+                int x0 = std::max(0, (int)floorf((ndc[0] * 0.5f + 0.5f) * grid.dim[0]));
+                int x1 = std::min(grid.dim[0] - 1, (int)floorf((ndc[1] * 0.5f + 0.5f) * grid.dim[0]));
+                int y0 = std::max(0, (int)floorf((ndc[2] * 0.5f + 0.5f) * grid.dim[1]));
+                int y1 = std::min(grid.dim[1] - 1, (int)floorf((ndc[3] * 0.5f + 0.5f) * grid.dim[1]));
+                for (int y = y0; y <= y1; ++y) {
+                    for (int x = x0; x <= x1; ++x) {
+                        // Exact sphere test against the cluster's view-space box.
+                        float tx0 = (2.0f * x / grid.dim[0] - 1.0f) * tanX, tx1 = (2.0f * (x + 1) / grid.dim[0] - 1.0f) * tanX;
+                        float ty0 = (2.0f * y / grid.dim[1] - 1.0f) * tanY, ty1 = (2.0f * (y + 1) / grid.dim[1] - 1.0f) * tanY;
+                        float bx0 = std::min(tx0 * z0, tx0 * z1), bx1 = std::max(tx1 * z0, tx1 * z1);
+                        float by0 = std::min(ty0 * z0, ty0 * z1), by1 = std::max(ty1 * z0, ty1 * z1);
+                        float dx = std::max(std::max(bx0 - s[0], s[0] - bx1), 0.0f);
+                        float dy = std::max(std::max(by0 - s[1], s[1] - by1), 0.0f);
+                        float dz = std::max(std::max(z0 - s[2], s[2] - z1), 0.0f);
+                        if (dx * dx + dy * dy + dz * dz <= s[3] * s[3])
+                            lists[y * grid.dim[0] + x].push_back((unsigned int)p);
+                    }
+                }
+            }
+            std::vector<unsigned int>& flat = sliceLists[z];
+            std::vector<unsigned int>& counts = sliceCounts[z];
+            flat.clear();
+            counts.resize(tiles);
+            for (int t = 0; t < tiles; ++t) {
+                counts[t] = (unsigned int)lists[t].size();
+                flat.insert(flat.end(), lists[t].begin(), lists[t].end());
+            }
+        }
+    });
+
+    grid.ranges.resize((size_t)tiles * grid.dim[2] * 2);
+    grid.indices.clear();
+    for (int z = 0; z < grid.dim[2]; ++z) {
+        unsigned int offset = (unsigned int)grid.indices.size();
+        for (int t = 0; t < tiles; ++t) {
+            size_t cluster = (size_t)z * tiles + t;
+            grid.ranges[cluster * 2] = offset;
+            grid.ranges[cluster * 2 + 1] = sliceCounts[z][t];
+            offset += sliceCounts[z][t];
+        }
+        grid.indices.insert(grid.indices.end(), sliceLists[z].begin(), sliceLists[z].end());
+    }
+}
+
+void benchmarkClusters(int count, float extent, float maxRadius) {
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::vector<LocalProbe> probes(count);
+    for (int p = 0; p < count; ++p) {
+        for (int i = 0; i < 3; ++i) probes[p].position[i] = (unit(rng) - 0.5f) * extent;
+        probes[p].radius = maxRadius * (0.25f + 0.75f * unit(rng));
+        memset(probes[p].zh3, 0, sizeof(probes[p].zh3));
+    }
+    // Camera at the origin looking down -z.
+    float view[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+    ClusterGrid grid;
+    grid.dim[0] = 16;
+    grid.dim[1] = 9;
+    grid.dim[2] = 24;
+    grid.nearZ = 0.1f;
+    grid.farZ = extent;
+
+    WorkerPool workers;
+    double best = 1e30;
+    for (int run = 0; run < 5; ++run) {
+        auto start = std::chrono::high_resolution_clock::now();
+        buildClusters(&probes[0], count, view, 0.785398f, 16.0f / 9.0f, grid, workers);
+        auto end = std::chrono::high_resolution_clock::now();
+        best = std::min(best, std::chrono::duration<double>(end - start).count());
+    }
+    int clusters = grid.dim[0] * grid.dim[1] * grid.dim[2];
+    unsigned int longest = 0;
+    int occupied = 0;
+    for (int c = 0; c < clusters; ++c) {
+        longest = std::max(longest, grid.ranges[c * 2 + 1]);
+        occupied += grid.ranges[c * 2 + 1] > 0;
+    }
+    printf("Clustered probes: %d probes, %d clusters built in %.3f ms, %zu entries, mean %.1f per occupied cluster, max %u\n",
+        count, clusters, best * 1000.0, grid.indices.size(), occupied ? (double)grid.indices.size() / occupied : 0.0, longest);
+}
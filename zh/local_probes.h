@@ -0,0 +1,40 @@
+// local_probes.h
+#pragma once
+#include <vector>
+#include "parallel_for.h"
+#include "probe_storage.h"
+
+// Hand-placed probe with a spherical influence: ZH3 is the 15-float storage of
+// probe_storage.h, weighted by (1 - (d / radius)^2)^2 when blended.
+struct LocalProbe {
+    float position[3];
+    float radius;
+    float zh3[15];
+};
+
+#define LOCAL_PROBE_TEXELS 5  // RGBA32F texels per probe in the shader's buffer
+
+// View-frustum froxel grid: dim[0] x dim[1] screen tiles by dim[2] depth slices spaced
+// exponentially between nearZ and farZ. Cluster (x, y, z) with index
+// (z * dim[1] + y) * dim[0] + x lists indices[ranges[2i]] .. + ranges[2i + 1].
+struct ClusterGrid {
+    int dim[3];
+    float nearZ;
+    float farZ;
+    std::vector<unsigned int> ranges;
+    std::vector<unsigned int> indices;
+};
+
+// Pack position, radius and ZH3 of every probe into LOCAL_PROBE_TEXELS vec4s each.
+void packLocalProbes(const LocalProbe* probes, int count, std::vector<float>& texels);
+
+// Assign probes to the clusters of a perspective view: view is the column-major
+// world-to-view matrix, fovY in radians. Depth slices run in parallel on workers, which
+// the caller keeps across frames; each tests the probes overlapping its depth range
+// against only the tiles their bounds cover.
+void buildClusters(const LocalProbe* probes, int count, const float view[16], float fovY, float aspect,
+    ClusterGrid& grid, WorkerPool& workers);
+
+// Print build time and list lengths for count random probes of radius up to maxRadius
+// scattered over extent around the camera, for a 16 x 9 x 24 grid.
+void benchmarkClusters(int count, float extent, float maxRadius);
@@ -3,13 +3,34 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <cstring>
 #include <iostream>
 #include <vector>
 #include "xProgram.h"
+#include "xProgramCache.h"
 #include "xCamera.h"
 #include "sphere_generator.h"
 #include "transfer.h"
+#include "sh_convolution.h"
+#include "irradiance_map.h"
+#include "reference_irradiance.h"
+#include "probe_quantize.h"
+#include "probe_pca.h"
+#include "error_metrics.h"
+#include "irradiance_batch.h"
+#include "probe_volume.h"
+#include "probe_brick_map.h"
+#include "probe_pager.h"
+#include "local_probes.h"
+#include "time_of_day.h"
+#include "probe_lod.h"
+#include "probe_baker.h"
+#include "probe_volume_gl.h"
+#include "stand_in_scene.h"
+#include "xStreamBuffer.h"
+#include "xUniformBuffer.h"
 #include <fstream>
+#include <memory>
 #include <sstream>
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
@@ -20,8 +41,39 @@ void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void processInput(GLFWwindow* window);
 std::string readFile(const char* path); 
+std::string readShader(const char* path);
 GLuint loadHDRTexture(const char* path); 
+GLuint uploadIrradianceMap(const IrradianceMap& map);
 void saveScreenshot(const std::string& filename, int width, int height);
+void loadBundledProbes(const NormalSet& normals, std::vector<const char*>& names, std::vector<float>& bundled,
+    std::vector<float>& referenceTargets);
+
+// std140 mirrors of the uniform blocks the shaders declare; every vec3 and every mat3
+// column takes a vec4 slot.
+struct FrameConstants {
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::vec4 cameraPos;
+};
+
+struct ObjectConstants {
+    glm::mat4 model;
+    glm::vec4 normalMatrix[3];
+};
+
+struct ProbeConstants {
+    glm::vec4 sh[4];
+    glm::vec4 rsh[9];
+    glm::vec4 k2;
+    glm::vec4 zhAxis;
+    glm::vec4 zhL0;
+    glm::vec4 zhL1[3];
+    glm::vec4 zhK2;
+    glm::uvec4 packedZH3;
+    glm::vec4 pcaWeights[PCA_MAX_COMPONENTS + 1];
+    int pcaComponents;
+    int padding[3];
+};
 
 int screenWidth = 1920;
 int screenHeight = 1080;
@@ -38,6 +90,56 @@ float K2[3];
 float placeWeight;
 const float PI = 3.14159265359;
 static bool saved = false;
+bool useIrradianceMap = false;
+int irradianceMapSize = 32;
+bool runBenchmark = false;
+bool bakeReference = false;
+float referenceErrorBound = 1e-4f;
+bool reportStorage = false;
+bool reportErrors = false;
+int errorNormalCount = 16384;
+int pcaComponents = 4;
+bool usePerVertexIrradiance = false;
+IrradianceMethod vertexMethod = IRRADIANCE_SHARED;
+bool vertexIrradianceDirty = true;
+bool reportFrameTime = false;
+// Print the streaming and probe-system counters every 240 frames.
+bool reportRuntimeStats = false;
+bool useProbeVolume = false;
+int probeVolumeDim = 32;
+size_t probeVolumeBudget = (size_t)256 << 20;
+bool useBrickMap = false;
+int brickMapBricks = 16;
+bool useProbePager = false;
+const char* probePagePath = "probe_pages.bin";
+int pagerCpuPages = 192;
+int pagerGpuSlots = 63;
+int pagerUploadsPerFrame = 4;
+bool useClusteredProbes = false;
+int localProbeCount = 400;
+bool useTimeOfDay = false;
+const char* probeKeyframePath = "probe_keyframes.bin";
+float dayLengthSeconds = 60.0f;
+float timeOfDayBlendStep = 1.0f / 256.0f;
+bool useProbeLod = false;
+float lodNearDistance = 8.0f;
+float lodFarDistance = 16.0f;
+int lodAtlasSlots = 127;
+int lodUploadsPerFrame = 16;
+bool useBakedScene = false;
+const char* bakeScenePath = "scene.obj";
+int bakeRaysPerProbe = 256;
+int bakeMaxBounces = 4;
+float bakeConvergence = 0.01f;
+int probeInstanceCount = 0;
+bool nudgeSceneBlock = false;
+// shader.frag variants the F key cycles through, each defining the one reconstruction
+// its main() calls.
+const char* const pixelVariants[] = { "IRRADIANCE_SHARED", "IRRADIANCE_ZH3", "IRRADIANCE_SH3", "IRRADIANCE_SH2",
+    "IRRADIANCE_HALLUCINATED", "IRRADIANCE_PACKED_ZH3", "IRRADIANCE_PCA" };
+#define PIXEL_VARIANT_COUNT (int)(sizeof(pixelVariants) / sizeof(pixelVariants[0]))
+int pixelVariant = 0;
+const char* programCachePath = "program_cache.bin";
 
 int main() {
     glfwInit();
@@ -53,6 +155,9 @@ int main() {
     }
     glfwMakeContextCurrent(window);
 
+    // From here on screenWidth and screenHeight follow the framebuffer, which differs
+    // from the window size on HiDPI displays.
+    glfwGetFramebufferSize(window, &screenWidth, &screenHeight);
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
     glfwSetCursorPosCallback(window, mouse_callback);
     glfwSetScrollCallback(window, scroll_callback);
@@ -86,6 +191,15 @@ int main() {
     glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
     glEnableVertexAttribArray(1);
 
+    int vertexCount = (int)(vertices.size() / 6);
+    std::vector<float> vertexIrradiance((size_t)vertexCount * 3, 0.0f);
+    GLuint irradianceVBO;
+    glGenBuffers(1, &irradianceVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, irradianceVBO);
+    glBufferData(GL_ARRAY_BUFFER, vertexIrradiance.size() * sizeof(float), &vertexIrradiance[0], GL_DYNAMIC_DRAW);
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(2);
+
     GLuint skyVAO, skyVBO, skyEBO;
     glGenVertexArrays(1, &skyVAO);
     glGenBuffers(1, &skyVBO);
@@ -98,13 +212,43 @@ int main() {
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(0);
 
+    double programStart = glfwGetTime();
+    xProgramBinaryCache programBinaries(programCachePath);
     std::string vertCode = readFile("shader.vert");
-    std::string fragCode = readFile("shader.frag");
-    xProgram shader((char*)vertCode.c_str(), (char*)fragCode.c_str());
+    std::string fragCode = readShader("shader.frag");
+    // The PCA basis is only known once the probe grid below is built; variants are
+    // compiled on first use, after that.
+    std::vector<float> pcaMean, pcaBasis;
+    xProgramCache probeShaders(vertCode, fragCode, [&](const xProgram& program) {
+        glUniform1f(program.uniform("weight"), placeWeight);
+        if (!pcaBasis.empty()) {
+            glUniform3fv(program.uniform("pcaMean"), 9, &pcaMean[0]);
+            glUniform3fv(program.uniform("pcaBasis"), (GLsizei)(pcaBasis.size() / 3), &pcaBasis[0]);
+        }
+    }, &programBinaries);
 
     std::string skyVert = readFile("sky.vert");
     std::string skyFrag = readFile("sky.frag");
-    xProgram skyShader((char*)skyVert.c_str(), (char*)skyFrag.c_str());
+    xProgram skyShader((char*)skyVert.c_str(), (char*)skyFrag.c_str(), &programBinaries);
+
+    std::string irrMapFrag = readFile("shader_irrmap.frag");
+    xProgram irrMapShader((char*)vertCode.c_str(), (char*)irrMapFrag.c_str(), &programBinaries);
+
+    std::string perVertexVert = readFile("shader_vertex.vert");
+    std::string perVertexFrag = readFile("shader_vertex.frag");
+    xProgram perVertexShader((char*)perVertexVert.c_str(), (char*)perVertexFrag.c_str(), &programBinaries);
+
+    std::string volumeFrag = readShader("shader_volume.frag");
+    xProgram volumeShader((char*)vertCode.c_str(), (char*)volumeFrag.c_str(), &programBinaries);
+
+    std::string clusteredFrag = readShader("shader_clustered.frag");
+    xProgram clusteredShader((char*)vertCode.c_str(), (char*)clusteredFrag.c_str(), &programBinaries);
+
+    std::string instancedVert = readFile("shader_instanced.vert");
+    std::string instancedFrag = readFile("shader_instanced.frag");
+    xProgram instancedShader((char*)instancedVert.c_str(), (char*)instancedFrag.c_str(), &programBinaries);
+    programBinaries.flush();
+    printf("Programs ready in %.3f s\n", glfwGetTime() - programStart);
 
     std::string place = "rnl";
     std::string floatFile = place + "_probe.float";
@@ -123,6 +267,7 @@ int main() {
         placeWeight = 1.0f;
     }
 
+
     int guessWidth = guessFloatWidth(floatFile.c_str());
     printf("Guessed Width : %d\n", guessWidth);
 
@@ -134,48 +279,353 @@ int main() {
         printf("%d : ", i);
         for (int j = 0; j < 3; j++) {
             shCoeffs[i][j] *= 0.1f;
-            rShaderInput[i][j] = shCoeffs[i][j];
             printf("%lf ", shCoeffs[i][j]);
         }
         printf("\n");
     }
+    convolveSH(shCoeffs, makeCosineKernel(), rShaderInput);
     for (int i = 0; i < 4; i++) {
         for (int j = 0; j < 3; j++) {
-            shaderInput[i][j] = shCoeffs[i][j];
+            shaderInput[i][j] = rShaderInput[i][j];
         }
     }
+    fitZH3PerChannelK2(rShaderInput, K2);
     for (int i = 0; i < 3; i++) {
-        K2[i] = 0.0f;
-        float sh0 = shCoeffs[0][i];
-        float sh1 = shCoeffs[1][i];
-        float sh2 = shCoeffs[2][i];
-        float sh3 = shCoeffs[3][i];
-        float sh4 = shCoeffs[4][i];
-        float sh5 = shCoeffs[5][i];
-        float sh6 = shCoeffs[6][i];
-        float sh7 = shCoeffs[7][i];
-        float sh8 = shCoeffs[8][i];
-
-        glm::vec3 optDir = normalize(glm::vec3(-sh3, -sh1, sh2));
-
-        float q4 = sqrt(15.0 / (4.0 * PI)) * optDir.x * optDir.y;
-        float q5 = -sqrt(15.0 / (4.0 * PI)) * optDir.y * optDir.z;
-        float q6 = sqrt(5.0 / (16.0 * PI)) * (3.0 * optDir.z * optDir.z - 1.0);
-        float q7 = -sqrt(15.0 / (4.0 * PI)) * optDir.x * optDir.z;
-        float q8 = sqrt(15.0 / (16.0 * PI)) * (optDir.x * optDir.x - optDir.y * optDir.y);
-
-        K2[i] = q4 * sh4 + q5 * sh5 + q6 * sh6 + q7 * sh7 + q8 * sh8;
-        K2[i] *= sqrt(4.0 * PI / 5.0);
+        printf("%d : %lf\n", i, K2[i]);
     }
+
+    // Every form of the probe shader.frag can evaluate, uploaded together below.
+    ProbeConstants probe = {};
+    for (int i = 0; i < 9; i++) {
+        for (int j = 0; j < 3; j++) {
+            if (i < 4) probe.sh[i][j] = shaderInput[i][j];
+            probe.rsh[i][j] = rShaderInput[i][j];
+        }
+    }
+    for (int j = 0; j < 3; j++) {
+        probe.k2[j] = K2[j];
+    }
+
+    ZH3Packet zh3Packet;
+    fitZH3Shared(rShaderInput, zh3Packet);
+    for (int j = 0; j < 3; j++) {
+        probe.zhAxis[j] = zh3Packet.axis[j];
+        probe.zhL0[j] = zh3Packet.l0[j];
+        probe.zhK2[j] = zh3Packet.k2[j];
+        for (int i = 0; i < 3; i++) {
+            probe.zhL1[i][j] = zh3Packet.l1[i][j];
+        }
+    }
+
+    float zh3Probe[15];
+    GLuint packedZH3[4];
+    packProbe(PROBE_STORAGE_ZH3, rShaderInput, zh3Probe);
+    encodeProbes(PROBE_STORAGE_ZH3, PROBE_ENCODING_RATIO8, zh3Probe, 1, (unsigned char*)packedZH3);
+    for (int i = 0; i < 4; i++) {
+        probe.packedZH3[i] = packedZH3[i];
+    }
+
+    if (reportStorage || reportErrors) {
+        NormalSet errorNormals;
+        makeEqualAreaNormals(errorNormalCount, errorNormals);
+        std::vector<const char*> bundledNames;
+        std::vector<float> bundled;
+        std::vector<float> bundledReference;
+        loadBundledProbes(errorNormals, bundledNames, bundled, bundledReference);
+        int envCount = (int)bundledNames.size();
+        if (reportErrors && envCount > 0) {
+            reportMethodErrors(&bundledNames[0], &bundled[0], envCount, errorNormals, &bundledReference[0]);
+        }
+        if (reportStorage) {
+            for (int e = 0; e < envCount; e++) {
+                const float (*irradiance)[3] = (const float (*)[3])&bundled[e * 27];
+                reportProbeStorage(bundledNames[e], irradiance, errorNormals, &bundledReference[(size_t)e * errorNormals.count * 3]);
+                reportProbeEncodings(bundledNames[e], irradiance, errorNormals);
+            }
+        }
+    }
+
+    // The blocks stay attached to their binding points; the frame and object blocks
+    // are refilled every frame, the probe block only when the probe changes.
+    xUniformBuffer<FrameConstants> frameConstants(FrameBlock);
+    xUniformBuffer<ObjectConstants> objectConstants(ObjectBlock);
+    xUniformBuffer<ProbeConstants> probeConstants(ProbeBlock);
+
+    IrradiancePoly irradiancePoly;
+    buildIrradiancePoly(IRRADIANCE_SHARED, rShaderInput, K2, irradiancePoly);
+    IrradianceMap irradianceMap;
+    bakeIrradianceMap(irradiancePoly, irradianceMapSize, irradianceMap);
+    if (bakeReference) {
+        double start = glfwGetTime();
+        std::vector<float> probe((size_t)guessWidth * guessWidth * 3);
+        readFloatFile(floatFile.c_str(), guessWidth, &probe[0]);
+        ReferenceIrradiance reference;
+        buildReferenceIrradiance(&probe[0], guessWidth, reference);
+        bakeReferenceIrradianceMap(reference, irradianceMapSize, referenceErrorBound, irradianceMap);
+        for (size_t i = 0; i < irradianceMap.texels.size(); i++) {
+            irradianceMap.texels[i] *= 0.1f;
+        }
+        printf("Reference irradiance baked in %.3f s\n", glfwGetTime() - start);
+        stbi_write_hdr((place + "_reference.hdr").c_str(), irradianceMap.size, irradianceMap.size, 3, &irradianceMap.texels[0]);
+    }
+    GLuint irradianceTexture = uploadIrradianceMap(irradianceMap);
+    if (runBenchmark) {
+        benchmarkIrradianceMap(irradianceMap, zh3Packet, screenWidth / 3, screenHeight / 2);
+        benchmarkIrradianceBatch(rShaderInput, 4 << 20);
+        benchmarkZH3Fit(1 << 20);
+    }
+
+    glUseProgram(irrMapShader.program);
+    glUniform1f(irrMapShader.uniform("weight"), placeWeight);
+    glUniform1i(irrMapShader.uniform("irradianceMap"), 1);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, irradianceTexture);
+    glActiveTexture(GL_TEXTURE0);
+
+    glUseProgram(perVertexShader.program);
+    glUniform1f(perVertexShader.uniform("weight"), placeWeight);
+
+    // Analytic lighting of stand_in_scene.h for every probe system: the loaded
+    // environment plus a warm point light beside the sphere.
+    StandInScene standIn;
+    initStandInScene(rShaderInput, standIn);
+    ProbeSource sceneProbes = standInProbes(standIn);
+
+    // Ray-traced alternative: the probes see the triangles of bakeScenePath, or of the
+    // stand-in room, in front of the loaded environment. Built on first use.
+    SceneMesh bakeMesh;
+    SceneBvh bakeBvh;
+    std::vector<float> bakeEnvironment;
+    BakeScene bakeScene = {};
+    int blockFirst = -1;
+    auto buildBakeScene = [&]() {
+        if (bakeScene.bvh) return;
+        double start = glfwGetTime();
+        if (!loadOBJ(bakeScenePath, bakeMesh)) {
+            bakeMesh = SceneMesh();
+            blockFirst = buildStandInScene(bakeMesh);
+        }
+        buildSceneBvh(bakeMesh, bakeBvh);
+        bakeEnvironment.resize((size_t)guessWidth * guessWidth * 3);
+        readFloatFile(floatFile.c_str(), guessWidth, &bakeEnvironment[0]);
+        for (size_t i = 0; i < bakeEnvironment.size(); i++) {
+            bakeEnvironment[i] *= 0.1f;
+        }
+        bakeScene.mesh = &bakeMesh;
+        bakeScene.bvh = &bakeBvh;
+        bakeScene.environment = &bakeEnvironment[0];
+        bakeScene.environmentWidth = guessWidth;
+        buildIrradiancePoly(IRRADIANCE_SH3, rShaderInput, K2, bakeScene.environmentIrradiance);
+        printf("Bake scene: %zu triangles, %zu BVH nodes built in %.3f s\n", bakeMesh.triangleMaterial.size(),
+            bakeBvh.nodes.size(), glfwGetTime() - start);
+    };
+    if (runBenchmark) {
+        buildBakeScene();
+        benchmarkProbeBaker(bakeScene, 256, 1024);
+    }
+
+    // The grid covers the sphere; its textures use units 2 and up and are baked on first use.
+    ProbeVolume probeVolume;
     for (int i = 0; i < 3; i++) {
-        printf("%d : %lf\n", i, K2[i]);
+        probeVolume.dim[i] = probeVolumeDim;
+        probeVolume.boundsMin[i] = -1.5f;
+        probeVolume.boundsMax[i] = 1.5f;
     }
+    bool volumeFits = chooseVolumeFormat(probeVolume.dim, probeVolumeBudget, probeVolume.format);
+    if (!volumeFits) {
+        probeVolume.format = VOLUME_ZH3_RATIO8;
+    }
+    VolumeBinding denseBinding = {};
+    initVolumeBinding(probeVolume, denseBinding);
+    bool volumeBaked = false;
+    bool volumeFromBakedScene = false;
+
+    // The PCA basis of shader.frag is fitted to the stand-in scene on a 16^3 grid over
+    // the volume's bounds, where the light makes the probes vary with position instead
+    // of spanning a few environments. The loaded probe is stored as its weights.
+    std::vector<float> pcaProbes;
+    sampleProbeGrid(probeVolume, 16, sceneProbes, pcaProbes);
+    int pcaProbeCount = (int)(pcaProbes.size() / 27);
+    ProbePCA pca;
+    buildProbePCA(&pcaProbes[0], pcaProbeCount, pcaComponents, pca);
+    float pcaWeights[PCA_MAX_COMPONENTS + 1] = { 0.0f };
+    encodeProbePCA(pca, &rShaderInput[0][0], 1, pcaWeights);
+    pcaMean.assign(pca.mean, pca.mean + 27);
+    pcaBasis.assign(pca.basis.begin(), pca.basis.begin() + 27 * pca.components);
+    for (int k = 0; k <= pca.components; k++) {
+        probe.pcaWeights[k][0] = pcaWeights[k];
+    }
+    probe.pcaComponents = pca.components;
+    probeConstants.update(probe);
+    if (reportStorage) {
+        NormalSet pcaNormals;
+        makeEqualAreaNormals(errorNormalCount, pcaNormals);
+        reportProbePCA(&pcaProbes[0], pcaProbeCount, PCA_MAX_COMPONENTS, pcaNormals);
+    }
+
+    // The ray-traced volume keeps every probe's radiance SH and dependency record, so a
+    // scene edit re-bakes only the probes whose rays can reach it, and its ZH3 probes
+    // light the hits of those re-bakes as they lit the last bounce.
+    std::vector<float> bakedPositions, bakedRadiance, bakedReach, bakedPacked;
+    std::vector<IrradiancePoly> bakedBounceProbes;
+    std::vector<unsigned char> bakedDirty;
+    // Convolve probe p's radiance into its packed record and its bounce probe.
+    auto convolveBakedProbe = [&](size_t p) {
+        ProbeStorage storage = volumeFormatStorage(probeVolume.format);
+        float sh[9][3], zh3[15];
+        convolveSH((const float (*)[3])&bakedRadiance[p * 27], makeCosineKernel(), sh);
+        packProbe(storage, sh, &bakedPacked[p * probeStorageFloats(storage)]);
+        packProbe(PROBE_STORAGE_ZH3, sh, zh3);
+        unpackProbe(PROBE_STORAGE_ZH3, zh3, bakedBounceProbes[p]);
+    };
+    auto uploadBakedVolume = [&]() {
+        size_t count = bakedPositions.size() / 3;
+        bakedPacked.resize(count * probeStorageFloats(volumeFormatStorage(probeVolume.format)));
+        for (size_t p = 0; p < count; p++) {
+            convolveBakedProbe(p);
+        }
+        uploadVolumeProbes(probeVolume.format, probeVolume.dim, &bakedPacked[0], denseBinding.textures);
+    };
+    // After a local re-bake, convolve only the probes in rebaked and upload the boxes
+    // of the grid that hold any of them. Returns the number of boxes uploaded.
+    auto uploadRebakedProbes = [&](const std::vector<unsigned char>& rebaked) {
+        for (size_t p = 0; p < rebaked.size(); p++) {
+            if (rebaked[p]) convolveBakedProbe(p);
+        }
+        return uploadMarkedProbes(probeVolume.format, probeVolume.dim, &bakedPacked[0], rebaked, denseBinding.textures);
+    };
+    glUseProgram(volumeShader.program);
+    glUniform1f(volumeShader.uniform("weight"), placeWeight);
+    setVolumeSamplers(volumeShader);
+
+    // The sparse brick map shares the bounds and format of the dense grid.
+    int brickGrid[3] = { brickMapBricks, brickMapBricks, brickMapBricks };
+    BrickMap brickMap;
+    VolumeBinding brickBinding = {};
+    bool brickMapBuilt = false;
+    if (runBenchmark) {
+        BrickMap benchmarkMap;
+        buildSceneBrickMap(brickGrid, probeVolume.boundsMin, probeVolume.boundsMax, probeVolume.format, sceneProbes,
+            rShaderInput, benchmarkMap);
+        benchmarkBrickMap(benchmarkMap, sceneProbes, 1 << 20);
+    }
+
+    // Day cycle over the probe grid, captured at four times of day. The grid is kept
+    // as ZH3 halves and relit whenever the blend refits.
+    const float keyframeTimes[4] = { 0.0f, 0.25f, 0.5f, 0.75f };
+    KeyframeSource dayProbes = standInDayProbes(standIn, probeVolume, keyframeTimes, 4);
+    // Threads for the CPU work redone every frame, started once.
+    WorkerPool frameWorkers;
+    ProbeTimeOfDay timeOfDay;
+    VolumeBinding dayBinding = denseBinding;
+    dayBinding.format = VOLUME_ZH3_HALF;
+    bool timeOfDayOpen = false;
+    float dayTime = 0.3f;
+    int dayFrames = 0;
+
+    // Streamed world of 120 x 120 units lit by a grid of point lights.
+    ProbeSource worldProbes = standInWorldProbes(standIn);
+    ProbePager probePager;
+    std::unique_ptr<xStreamBuffer> pageStream;
+    std::vector<PageUpload> pageUploads;
+    VolumeBinding pagerBinding = {};
+    bool pagerOpen = false;
+    int pagerFrames = 0;
 
-    glUseProgram(shader.program);
-    glUniform1f(glGetUniformLocation(shader.program, "weight"), placeWeight);
-    glUniform3fv(glGetUniformLocation(shader.program, "sh"), 9, &shaderInput[0][0]);
-    glUniform3fv(glGetUniformLocation(shader.program, "rsh"), 9, &rShaderInput[0][0]);
-    glUniform1fv(glGetUniformLocation(shader.program, "k2"), 3, &K2[0]);
+    // The same world as a LOD field baked in memory: full ZH3 within the transition
+    // band around the camera, hallucinated ZH3 beyond it.
+    ProbeLodField lodField;
+    ProbeLodSelector lodSelector;
+    std::vector<LodUpload> lodUploads;
+    VolumeBinding lodBinding = {};
+    lodBinding.lodBand[0] = lodNearDistance;
+    lodBinding.lodBand[1] = lodFarDistance;
+    bool lodBuilt = false;
+    int lodFrames = 0;
+    glm::vec3 lastCameraPosition = camera.Position;
+    glm::vec3 cameraVelocity(0.0f);
+
+    // Local probes around the sphere, reassigned to a 16 x 9 x 24 froxel grid every
+    // frame; their texture buffers use units 10 to 12.
+    std::vector<LocalProbe> localProbes;
+    placeLocalProbes(localProbeCount, sceneProbes, localProbes);
+
+    // Probe grids drawn as one instanced draw of a coarse sphere, with each instance's
+    // placement and shared-axis fit in a texture buffer on unit 13. Rebuilt whenever
+    // I changes the count.
+    std::vector<float> instanceVertices;
+    std::vector<unsigned int> instanceIndices;
+    generateSphere(instanceVertices, instanceIndices, 1.0f, 16, 8);
+    GLuint instanceVAO, instanceVBO, instanceEBO;
+    glGenVertexArrays(1, &instanceVAO);
+    glGenBuffers(1, &instanceVBO);
+    glGenBuffers(1, &instanceEBO);
+    glBindVertexArray(instanceVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    glBufferData(GL_ARRAY_BUFFER, instanceVertices.size() * sizeof(float), &instanceVertices[0], GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, instanceEBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, instanceIndices.size() * sizeof(unsigned int), &instanceIndices[0], GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
+    glEnableVertexAttribArray(1);
+    glBindVertexArray(0);
+    GLuint instanceBuffer, instanceTexture;
+    glGenBuffers(1, &instanceBuffer);
+    glGenTextures(1, &instanceTexture);
+    std::vector<float> instanceTexels;
+    int instancesBuilt = 0;
+    glUseProgram(instancedShader.program);
+    glUniform1f(instancedShader.uniform("weight"), placeWeight);
+    glUniform1i(instancedShader.uniform("instanceProbes"), 13);
+    std::vector<float> localProbeTexels;
+    packLocalProbes(&localProbes[0], localProbeCount, localProbeTexels);
+    ClusterGrid clusters;
+    clusters.dim[0] = 16;
+    clusters.dim[1] = 9;
+    clusters.dim[2] = 24;
+    clusters.nearZ = 0.1f;
+    clusters.farZ = 100.0f;
+    GLuint clusterBuffers[3], clusterTextures[3];
+    glGenBuffers(3, clusterBuffers);
+    glGenTextures(3, clusterTextures);
+    uploadTextureBuffer(clusterBuffers[0], clusterTextures[0], GL_RGBA32F, &localProbeTexels[0],
+        localProbeTexels.size() * sizeof(float));
+    float globalZH3[15];
+    packProbe(PROBE_STORAGE_ZH3, rShaderInput, globalZH3);
+    glUseProgram(clusteredShader.program);
+    glUniform1f(clusteredShader.uniform("weight"), placeWeight);
+    glUniform1i(clusteredShader.uniform("localProbes"), 10);
+    glUniform1i(clusteredShader.uniform("clusterRanges"), 11);
+    glUniform1i(clusteredShader.uniform("clusterIndices"), 12);
+    glUniform3f(clusteredShader.uniform("clusterDim"), (float)clusters.dim[0], (float)clusters.dim[1],
+        (float)clusters.dim[2]);
+    glUniform2f(clusteredShader.uniform("clusterDepth"), clusters.nearZ, clusters.farZ);
+    glUniform3fv(clusteredShader.uniform("globalZH3"), 5, globalZH3);
+    int clusterFrames = 0;
+    double clusterTimeSum = 0.0;
+    if (runBenchmark) {
+        benchmarkClusters(400, 40.0f, 2.0f);
+        benchmarkClusters(4000, 40.0f, 2.0f);
+        benchmarkClusters(40000, 40.0f, 2.0f);
+    }
+
+    // Sphere pass timers in a ring: each is read when the ring comes back to it, two
+    // frames after it was issued, so timing a frame never waits for the GPU. Every
+    // query remembers what it timed so a mode switch drops the results still in flight.
+    const int timerQueries = 3;
+    GLuint sphereQueries[timerQueries];
+    glGenQueries(timerQueries, sphereQueries);
+    GLuint queryProgram[timerQueries] = { 0 };
+    int queryInstances[timerQueries] = { 0 };
+    bool queryPending[timerQueries] = { false };
+    int queryIndex = 0;
+    GLuint timedProgram = 0;
+    int timedInstances = 0;
+    int timedFrames = 0;
+    int timedSamples = 0;
+    double frameTimeSum = 0.0;
+    double sphereTimeSum = 0.0;
 
     while (!glfwWindowShouldClose(window)) {
         float currentFrame = glfwGetTime();
@@ -184,31 +634,313 @@ int main() {
 
         processInput(window); 
 
+        if (vertexIrradianceDirty) {
+            double start = glfwGetTime();
+            IrradiancePoly vertexPoly;
+            buildIrradiancePoly(vertexMethod, rShaderInput, K2, vertexPoly);
+            bakeVertexIrradiance(vertexPoly, &vertices[0], vertexCount, 6, 3, &vertexIrradiance[0]);
+            glBindBuffer(GL_ARRAY_BUFFER, irradianceVBO);
+            glBufferSubData(GL_ARRAY_BUFFER, 0, vertexIrradiance.size() * sizeof(float), &vertexIrradiance[0]);
+            printf("Per-vertex %s irradiance baked for %d vertices in %.3f ms\n", irradianceMethodName(vertexMethod),
+                vertexCount, (glfwGetTime() - start) * 1000.0);
+            vertexIrradianceDirty = false;
+        }
+
+        if (useProbeVolume && !volumeFits) {
+            printf("No probe volume format fits %d^3 probes in %zu MB\n", probeVolumeDim, probeVolumeBudget >> 20);
+            useProbeVolume = false;
+        }
+        if (useProbeVolume && volumeBaked && volumeFromBakedScene != useBakedScene) {
+            glDeleteTextures(volumeTextureCount(probeVolume.format), denseBinding.textures);
+            volumeBaked = false;
+        }
+        if (useProbeVolume && !volumeBaked) {
+            double start = glfwGetTime();
+            if (useBakedScene) {
+                buildBakeScene();
+                int count = probeVolume.dim[0] * probeVolume.dim[1] * probeVolume.dim[2];
+                bakedPositions.resize((size_t)count * 3);
+                for (int z = 0; z < probeVolume.dim[2]; z++) {
+                    for (int y = 0; y < probeVolume.dim[1]; y++) {
+                        for (int x = 0; x < probeVolume.dim[0]; x++) {
+                            int p = (z * probeVolume.dim[1] + y) * probeVolume.dim[0] + x;
+                            volumeProbePosition(probeVolume, x, y, z, &bakedPositions[(size_t)p * 3]);
+                        }
+                    }
+                }
+                bakedRadiance.resize((size_t)count * 27);
+                bakedReach.resize((size_t)count * PROBE_REACH_SIZE);
+                int bounces = bakeVolumeBounces(bakeScene, probeVolume, &bakedPositions[0], bakeRaysPerProbe,
+                    bakeMaxBounces, bakeConvergence, &bakedRadiance[0], &bakedReach[0], bakedBounceProbes);
+                bakeScene.bounceVolume = &probeVolume;
+                bakeScene.bounceProbes = &bakedBounceProbes[0];
+                printf("Ray-traced %d probes with %d bounces\n", count, bounces);
+                createVolumeTextures(probeVolume.format, probeVolume.dim, NULL, denseBinding.textures);
+                uploadBakedVolume();
+            }
+            else {
+                bakeVolumeTextures(probeVolume, sceneProbes, denseBinding.textures);
+            }
+            printf("Probe volume %d^3 %s baked in %.3f s, %.1f MB of textures\n", probeVolumeDim,
+                volumeFormatName(probeVolume.format), glfwGetTime() - start, volumeBytes(probeVolume.dim, probeVolume.format) / 1048576.0);
+            volumeBaked = true;
+            volumeFromBakedScene = useBakedScene;
+        }
+        if (nudgeSceneBlock) {
+            nudgeSceneBlock = false;
+            if (!(useProbeVolume && volumeBaked && volumeFromBakedScene && blockFirst >= 0)) {
+                printf("Moving the block needs the ray-traced stand-in room in the probe volume\n");
+            }
+            else {
+                // Slide the block along x across the room and re-bake what saw it before
+                // or after the move.
+                double start = glfwGetTime();
+                int blockCount = (int)bakeMesh.triangleMaterial.size() - blockFirst;
+                float before[2][3], after[2][3];
+                sceneTriangleBounds(bakeMesh, blockFirst, blockCount, before[0], before[1]);
+                float step = before[1][0] + 0.4f > 1.3f ? -2.0f : 0.4f;
+                for (int k = blockFirst * 3; k < (blockFirst + blockCount) * 3; k++) {
+                    bakeMesh.positions[bakeMesh.triangles[k] * 3] += step;
+                }
+                sceneTriangleBounds(bakeMesh, blockFirst, blockCount, after[0], after[1]);
+                buildSceneBvh(bakeMesh, bakeBvh);
+                int count = (int)(bakedPositions.size() / 3);
+                float coverage = 1.0f / bakeRaysPerProbe;
+                markProbesInBox(&bakedPositions[0], count, &bakedReach[0], before[0], before[1], coverage, bakedDirty);
+                markProbesInBox(&bakedPositions[0], count, &bakedReach[0], after[0], after[1], coverage, bakedDirty);
+                // rebakeDirtyProbes clears the marks, and the upload needs them after.
+                std::vector<unsigned char> rebakedSet = bakedDirty;
+                int rebaked = rebakeDirtyProbes(bakeScene, &bakedPositions[0], count, bakeRaysPerProbe, bakedDirty,
+                    &bakedRadiance[0], &bakedReach[0]);
+                int boxes = uploadRebakedProbes(rebakedSet);
+                printf("Block moved: %d of %d probes re-baked in %.3f s, %d boxes uploaded\n", rebaked, count,
+                    glfwGetTime() - start, boxes);
+            }
+        }
+        if (useBrickMap && !brickMapBuilt) {
+            double start = glfwGetTime();
+            buildSceneBrickMap(brickGrid, probeVolume.boundsMin, probeVolume.boundsMax, probeVolume.format, sceneProbes,
+                rShaderInput, brickMap);
+            createBrickMapTextures(brickMap, brickBinding);
+            printf("Brick map %d^3 bricks, %d occupied, built in %.3f s, %.2f MB\n", brickMapBricks, brickMap.brickCount - 1,
+                glfwGetTime() - start, brickMapBytes(brickMap) / 1048576.0);
+            brickMapBuilt = true;
+        }
+
+        if (deltaTime > 0.0f) {
+            cameraVelocity += ((camera.Position - lastCameraPosition) / deltaTime - cameraVelocity) * 0.2f;
+        }
+        lastCameraPosition = camera.Position;
+        if (useProbePager && !pagerOpen) {
+            std::ifstream existing(probePagePath, std::ios::binary);
+            if (!existing) {
+                double start = glfwGetTime();
+                ProbePageLayout world = { { 16, 2, 16 }, { -60.0f, -7.5f, -60.0f }, { 60.0f, 7.5f, 60.0f }, VOLUME_ZH3_RATIO8 };
+                writeProbePages(probePagePath, world, worldProbes);
+                printf("Probe pages written to %s in %.3f s\n", probePagePath, glfwGetTime() - start);
+            }
+            pagerOpen = probePager.open(probePagePath, pagerCpuPages, pagerGpuSlots, 12.0f, 1.0f);
+            if (pagerOpen) {
+                createPagerTextures(probePager, rShaderInput, pagerBinding);
+                pageStream.reset(new xStreamBuffer((GLsizeiptr)probePageBytes(probePager.layout().format) * pagerUploadsPerFrame, 3));
+            }
+            else {
+                useProbePager = false;
+            }
+        }
+        if (useProbePager) {
+            // Never waits: a busy stream region or a page still on disk just shows the
+            // fallback until a later frame.
+            unsigned char* staging = pageStream->map();
+            int maxUploads = staging ? pagerUploadsPerFrame : 0;
+            probePager.update(glm::value_ptr(camera.Position), glm::value_ptr(cameraVelocity), maxUploads, pageUploads);
+            uploadPagerPages(probePager, pageUploads, *pageStream, staging, pagerBinding);
+            if (reportRuntimeStats && ++pagerFrames % 240 == 0) {
+                ProbePagerStats stats = probePager.stats();
+                printf("Probe pager: %d pages in memory, %d on GPU, %d pending, %lld loads (%.1f MB), %lld uploads\n",
+                    stats.cpuResident, stats.gpuResident, stats.pending, stats.loads, stats.bytesLoaded / 1048576.0, stats.uploads);
+            }
+        }
+
         glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+        FrameConstants frame;
+        frame.view = camera.GetViewMatrix();
+        frame.projection = glm::perspective(glm::radians(camera.Zoom), (float)screenWidth / screenHeight, 0.1f, 100.0f);
+        frame.cameraPos = glm::vec4(camera.Position, 1.0f);
+        frameConstants.update(frame);
+        ObjectConstants object;
+        object.model = glm::mat4(1.0f);
+        glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(object.model)));
+        for (int i = 0; i < 3; i++) {
+            object.normalMatrix[i] = glm::vec4(normalMatrix[i], 0.0f);
+        }
+        objectConstants.update(object);
+
         glDepthFunc(GL_LEQUAL);
         glUseProgram(skyShader.program);
-        glm::mat4 view = glm::mat4(glm::mat3(camera.GetViewMatrix())); 
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)screenWidth / screenHeight, 0.1f, 100.0f);
-        glm::mat4 skyModel = glm::scale(glm::mat4(1.0f), glm::vec3(2.0f)); 
-        glUniformMatrix4fv(glGetUniformLocation(skyShader.program, "model"), 1, GL_FALSE, glm::value_ptr(skyModel));
-        glUniformMatrix4fv(glGetUniformLocation(skyShader.program, "view"), 1, GL_FALSE, glm::value_ptr(view));
-        glUniformMatrix4fv(glGetUniformLocation(skyShader.program, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
         glBindTexture(GL_TEXTURE_2D, hdrTexture);
         glBindVertexArray(skyVAO);
         glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
         glDepthFunc(GL_LESS);
 
-        glUseProgram(shader.program);
-        view = camera.GetViewMatrix();
-        glm::mat4 model = glm::mat4(1.0f); 
-        glUniformMatrix4fv(glGetUniformLocation(shader.program, "model"), 1, GL_FALSE, glm::value_ptr(model));
-        glUniformMatrix4fv(glGetUniformLocation(shader.program, "view"), 1, GL_FALSE, glm::value_ptr(view));
-        glUniformMatrix4fv(glGetUniformLocation(shader.program, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
-        glUniform3fv(glGetUniformLocation(shader.program, "cameraPos"), 1, glm::value_ptr(camera.Position));
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+        if (useTimeOfDay && !timeOfDayOpen) {
+            std::ifstream existing(probeKeyframePath, std::ios::binary);
+            int probeCount = probeVolume.dim[0] * probeVolume.dim[1] * probeVolume.dim[2];
+            if (!existing) {
+                double start = glfwGetTime();
+                writeProbeKeyframes(probeKeyframePath, keyframeTimes, 4, probeCount, dayProbes);
+                printf("Probe keyframes written to %s in %.3f s\n", probeKeyframePath, glfwGetTime() - start);
+            }
+            timeOfDayOpen = timeOfDay.open(probeKeyframePath, timeOfDayBlendStep) && timeOfDay.probeCount() == probeCount;
+            if (timeOfDayOpen) {
+                createVolumeTextures(dayBinding.format, probeVolume.dim, NULL, dayBinding.textures);
+            }
+            else {
+                useTimeOfDay = false;
+            }
+        }
+        if (useTimeOfDay) {
+            dayTime += deltaTime / dayLengthSeconds;
+            if (timeOfDay.update(dayTime, frameWorkers)) {
+                uploadVolumeProbes(dayBinding.format, probeVolume.dim, &timeOfDay.zh3()[0], dayBinding.textures);
+            }
+            if (reportRuntimeStats && ++dayFrames % 240 == 0) {
+                TimeOfDayStats stats = timeOfDay.stats();
+                printf("Time of day %.2f: %lld keyframe loads (%lld not prefetched), %lld refits of %d probes, %.3f ms per refit\n",
+                    dayTime - floorf(dayTime), stats.keyframeLoads, stats.keyframeStalls, stats.refits, timeOfDay.probeCount(),
+                    stats.refits ? stats.refitSeconds / stats.refits * 1000.0 : 0.0);
+            }
+        }
+        if (useProbeLod && !lodBuilt) {
+            double start = glfwGetTime();
+            int blocks[3] = { 16, 2, 16 };
+            float boundsMin[3] = { -60.0f, -7.5f, -60.0f }, boundsMax[3] = { 60.0f, 7.5f, 60.0f };
+            bakeLodField(blocks, boundsMin, boundsMax, worldProbes, lodField);
+            lodSelector.init(lodField, lodAtlasSlots, lodFarDistance, 4.0f);
+            createLodTextures(lodField, lodSelector, lodBinding);
+            printf("Probe LOD field baked in %.3f s\n", glfwGetTime() - start);
+            lodBuilt = true;
+        }
+        if (useProbeLod) {
+            lodSelector.update(glm::value_ptr(camera.Position), lodUploadsPerFrame, lodUploads);
+            uploadLodBlocks(lodField, lodSelector, lodUploads, lodBinding);
+            if (reportRuntimeStats && ++lodFrames % 240 == 0) {
+                ProbeLodStats stats = lodSelector.stats();
+                printf("Probe LOD: %d of %d wanted blocks full, %.2f MB resident against %.2f MB all full\n",
+                    stats.fullBlocks, stats.wantedBlocks, stats.residentBytes / 1048576.0, stats.fullBytes / 1048576.0);
+            }
+        }
+        if (useClusteredProbes) {
+            double start = glfwGetTime();
+            glm::mat4 clusterView = camera.GetViewMatrix();
+            buildClusters(&localProbes[0], localProbeCount, glm::value_ptr(clusterView), glm::radians(camera.Zoom),
+                (float)screenWidth / screenHeight, clusters, frameWorkers);
+            clusterTimeSum += glfwGetTime() - start;
+            uploadTextureBuffer(clusterBuffers[1], clusterTextures[1], GL_RG32UI, &clusters.ranges[0],
+                clusters.ranges.size() * sizeof(unsigned int));
+            // An empty index list still needs a buffer behind its texture.
+            unsigned int noIndex = 0;
+            uploadTextureBuffer(clusterBuffers[2], clusterTextures[2], GL_R32UI,
+                clusters.indices.empty() ? &noIndex : &clusters.indices[0],
+                std::max<size_t>(clusters.indices.size(), 1) * sizeof(unsigned int));
+            if (++clusterFrames % 240 == 0) {
+                if (reportRuntimeStats) {
+                    printf("Clustered probes: %d local probes, %zu cluster entries, build %.3f ms\n", localProbeCount,
+                        clusters.indices.size(), clusterTimeSum / 240 * 1000.0);
+                }
+                clusterTimeSum = 0.0;
+            }
+        }
+
+        if (probeInstanceCount > 0 && probeInstanceCount != instancesBuilt) {
+            double start = glfwGetTime();
+            placeProbeInstances(probeInstanceCount, sceneProbes, instanceTexels);
+            uploadTextureBuffer(instanceBuffer, instanceTexture, GL_RGBA32F, &instanceTexels[0],
+                instanceTexels.size() * sizeof(float));
+            printf("%d probe instances fitted and uploaded in %.3f s\n", probeInstanceCount, glfwGetTime() - start);
+            instancesBuilt = probeInstanceCount;
+        }
+
+        const xProgram& sphereShader = probeInstanceCount > 0 ? instancedShader
+            : useIrradianceMap ? irrMapShader
+            : useClusteredProbes ? clusteredShader
+            : (useProbeLod || useTimeOfDay || useProbePager || useBrickMap || useProbeVolume ? volumeShader
+            : (usePerVertexIrradiance ? perVertexShader : probeShaders.get(pixelVariants[pixelVariant])));
+        GLuint sphereProgram = sphereShader.program;
+        glUseProgram(sphereProgram);
+        if (sphereProgram == volumeShader.program) {
+            bindVolume(sphereShader, useProbeLod ? lodBinding : useTimeOfDay ? dayBinding
+                : (useProbePager ? pagerBinding : (useBrickMap ? brickBinding : denseBinding)));
+        }
+        if (sphereProgram == clusteredShader.program) {
+            glUniform2f(sphereShader.uniform("screenSize"), (float)screenWidth, (float)screenHeight);
+            for (int t = 0; t < 3; t++) {
+                glActiveTexture(GL_TEXTURE10 + t);
+                glBindTexture(GL_TEXTURE_BUFFER, clusterTextures[t]);
+            }
+            glActiveTexture(GL_TEXTURE0);
+        }
+        if (sphereProgram == instancedShader.program) {
+            glActiveTexture(GL_TEXTURE13);
+            glBindTexture(GL_TEXTURE_BUFFER, instanceTexture);
+            glActiveTexture(GL_TEXTURE0);
+        }
+        if (reportFrameTime) {
+            glBeginQuery(GL_TIME_ELAPSED, sphereQueries[queryIndex]);
+        }
+        if (probeInstanceCount > 0) {
+            glBindVertexArray(instanceVAO);
+            glDrawElementsInstanced(GL_TRIANGLES, (GLsizei)instanceIndices.size(), GL_UNSIGNED_INT, 0, probeInstanceCount);
+        }
+        else {
+            glBindVertexArray(VAO);
+            glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+        }
+        if (reportFrameTime) {
+            glEndQuery(GL_TIME_ELAPSED);
+            queryProgram[queryIndex] = sphereProgram;
+            queryInstances[queryIndex] = probeInstanceCount;
+            queryPending[queryIndex] = true;
+            queryIndex = (queryIndex + 1) % timerQueries;
+            if (sphereProgram != timedProgram || probeInstanceCount != timedInstances) {
+                timedProgram = sphereProgram;
+                timedInstances = probeInstanceCount;
+                timedFrames = 0;
+                timedSamples = 0;
+                frameTimeSum = 0.0;
+                sphereTimeSum = 0.0;
+            }
+            frameTimeSum += deltaTime * 1000.0;
+            if (queryPending[queryIndex]) {
+                GLint available = 0;
+                glGetQueryObjectiv(sphereQueries[queryIndex], GL_QUERY_RESULT_AVAILABLE, &available);
+                if (available) {
+                    GLuint64 elapsed = 0;
+                    glGetQueryObjectui64v(sphereQueries[queryIndex], GL_QUERY_RESULT, &elapsed);
+                    queryPending[queryIndex] = false;
+                    if (queryProgram[queryIndex] == timedProgram && queryInstances[queryIndex] == timedInstances) {
+                        sphereTimeSum += elapsed * 1e-6;
+                        timedSamples++;
+                    }
+                }
+            }
+            if (++timedFrames == 240) {
+                char instanceMode[64];
+                snprintf(instanceMode, sizeof(instanceMode), "%d probe instances of %zu triangles", probeInstanceCount,
+                    instanceIndices.size() / 3);
+                const char* mode = probeInstanceCount > 0 ? instanceMode : useIrradianceMap ? "irradiance map" : useClusteredProbes ? "clustered probes"
+                    : useProbeLod ? "probe LOD" : useTimeOfDay ? "time of day" : (useProbePager ? "probe pager" : (useBrickMap ? "brick map" : (useProbeVolume ? "probe volume"
+                    : (usePerVertexIrradiance ? "per-vertex" : pixelVariants[pixelVariant]))));
+                printf("%s: frame %.3f ms, sphere pass %.3f ms GPU\n", mode, frameTimeSum / timedFrames,
+                    timedSamples > 0 ? sphereTimeSum / timedSamples : 0.0);
+                timedFrames = 0;
+                timedSamples = 0;
+                frameTimeSum = 0.0;
+                sphereTimeSum = 0.0;
+            }
+        }
 
         if (!saved) {
             saveScreenshot(place + "_SHa.png", screenWidth, screenHeight);
@@ -219,6 +951,14 @@ int main() {
         glfwPollEvents();
     }
 
+    glDeleteTextures(3, clusterTextures);
+    glDeleteBuffers(3, clusterBuffers);
+    glDeleteTextures(1, &instanceTexture);
+    glDeleteBuffers(1, &instanceBuffer);
+    probePager.close();
+    pageStream.reset();
+    // Variants built lazily while running join the file here, not mid-frame.
+    programBinaries.flush();
     glfwTerminate();
     return 0;
 }
@@ -230,6 +970,30 @@ std::string readFile(const char* path) {
     return buffer.str();
 }
 
+// readFile with every #include "name" line replaced by that file, for the GLSL the
+// probe shaders share. The #line directives keep compile logs on each file's own
+// numbering, the included one as source string 1.
+std::string readShader(const char* path) {
+    std::string source = readFile(path);
+    std::string result;
+    int line = 1;
+    for (size_t start = 0; start < source.size(); line++) {
+        size_t end = source.find('\n', start);
+        end = end == std::string::npos ? source.size() : end + 1;
+        size_t open = source.find('"', start);
+        size_t close = open < end ? source.find('"', open + 1) : std::string::npos;
+        if (source.compare(start, 9, "#include ") == 0 && close < end) {
+            std::string name = source.substr(open + 1, close - open - 1);
+            result += "#line 1 1\n" + readFile(name.c_str()) + "\n#line " + std::to_string(line + 1) + " 0\n";
+        }
+        else {
+            result += source.substr(start, end - start);
+        }
+        start = end;
+    }
+    return result;
+}
+
 GLuint loadHDRTexture(const char* path) {
     stbi_set_flip_vertically_on_load(true);
     int width, height, nrComponents;
@@ -253,8 +1017,26 @@ GLuint loadHDRTexture(const char* path) {
     return hdrTex;
 }
 
+GLuint uploadIrradianceMap(const IrradianceMap& map) {
+    GLuint tex = 0;
+    glGenTextures(1, &tex);
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F,
+        map.size, map.size, 0, GL_RGB, GL_FLOAT, &map.texels[0]);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    return tex;
+}
+
 void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
     glViewport(0, 0, width, height);
+    // A minimized window reports 0 x 0; keep the last size for the aspect ratio.
+    if (width > 0 && height > 0) {
+        screenWidth = width;
+        screenHeight = height;
+    }
 }
 
 void mouse_callback(GLFWwindow* window, double xpos, double ypos) {
@@ -290,6 +1072,74 @@ void processInput(GLFWwindow* window) {
         camera.ProcessKeyboard(UP, deltaTime);
     if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS)
         camera.ProcessKeyboard(DOWN, deltaTime);
+
+    // V toggles per-vertex irradiance, M cycles the reconstruction it bakes,
+    // G toggles the probe volume, B its sparse brick map, P the streamed pages and
+    // C the clustered local probes, T the time-of-day cycle, L the probe LOD field,
+    // R switches the dense volume to the ray-traced scene, N moves its block and I
+    // cycles instanced probe grids of 1K, 10K and 100K spheres.
+    static bool vWasDown = false;
+    static bool mWasDown = false;
+    static bool gWasDown = false;
+    static bool bWasDown = false;
+    static bool pWasDown = false;
+    static bool cWasDown = false;
+    static bool tWasDown = false;
+    static bool lWasDown = false;
+    static bool rWasDown = false;
+    static bool nWasDown = false;
+    static bool iWasDown = false;
+    static bool fWasDown = false;
+    bool vDown = glfwGetKey(window, GLFW_KEY_V) == GLFW_PRESS;
+    bool mDown = glfwGetKey(window, GLFW_KEY_M) == GLFW_PRESS;
+    bool gDown = glfwGetKey(window, GLFW_KEY_G) == GLFW_PRESS;
+    bool bDown = glfwGetKey(window, GLFW_KEY_B) == GLFW_PRESS;
+    bool pDown = glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS;
+    bool cDown = glfwGetKey(window, GLFW_KEY_C) == GLFW_PRESS;
+    bool tDown = glfwGetKey(window, GLFW_KEY_T) == GLFW_PRESS;
+    bool lDown = glfwGetKey(window, GLFW_KEY_L) == GLFW_PRESS;
+    bool rDown = glfwGetKey(window, GLFW_KEY_R) == GLFW_PRESS;
+    bool nDown = glfwGetKey(window, GLFW_KEY_N) == GLFW_PRESS;
+    bool iDown = glfwGetKey(window, GLFW_KEY_I) == GLFW_PRESS;
+    bool fDown = glfwGetKey(window, GLFW_KEY_F) == GLFW_PRESS;
+    if (vDown && !vWasDown)
+        usePerVertexIrradiance = !usePerVertexIrradiance;
+    if (gDown && !gWasDown)
+        useProbeVolume = !useProbeVolume;
+    if (bDown && !bWasDown)
+        useBrickMap = !useBrickMap;
+    if (pDown && !pWasDown)
+        useProbePager = !useProbePager;
+    if (cDown && !cWasDown)
+        useClusteredProbes = !useClusteredProbes;
+    if (tDown && !tWasDown)
+        useTimeOfDay = !useTimeOfDay;
+    if (lDown && !lWasDown)
+        useProbeLod = !useProbeLod;
+    if (rDown && !rWasDown)
+        useBakedScene = !useBakedScene;
+    if (nDown && !nWasDown)
+        nudgeSceneBlock = true;
+    if (iDown && !iWasDown)
+        probeInstanceCount = probeInstanceCount == 0 ? 1000 : (probeInstanceCount < 100000 ? probeInstanceCount * 10 : 0);
+    if (fDown && !fWasDown)
+        pixelVariant = (pixelVariant + 1) % PIXEL_VARIANT_COUNT;
+    if (mDown && !mWasDown) {
+        vertexMethod = (IrradianceMethod)((vertexMethod + 1) % IRRADIANCE_METHOD_COUNT);
+        vertexIrradianceDirty = true;
+    }
+    vWasDown = vDown;
+    mWasDown = mDown;
+    gWasDown = gDown;
+    bWasDown = bDown;
+    pWasDown = pDown;
+    cWasDown = cDown;
+    tWasDown = tDown;
+    lWasDown = lDown;
+    rWasDown = rDown;
+    nWasDown = nDown;
+    iWasDown = iDown;
+    fWasDown = fDown;
 }
 
 void saveScreenshot(const std::string& filename, int width, int height) {
@@ -312,3 +1162,29 @@ void saveScreenshot(const std::string& filename, int width, int height) {
     std::cout << "Cropped screenshot saved to: " << filename << std::endl;
 }
 
+void loadBundledProbes(const NormalSet& normals, std::vector<const char*>& names, std::vector<float>& bundled,
+    std::vector<float>& referenceTargets) {
+    static const char* places[] = { "beach", "building", "campus", "galileo", "grace", "kitchen", "rnl" };
+    stbi_set_flip_vertically_on_load(false);
+    for (const char* name : places) {
+        std::string path = std::string(name) + "_probe_mine.hdr";
+        int width, height, nrComponents;
+        float* data = stbi_loadf(path.c_str(), &width, &height, &nrComponents, 3);
+        if (!data || width != height) {
+            std::cerr << "Failed to load " << path << std::endl;
+            if (data) stbi_image_free(data);
+            continue;
+        }
+        float sh[9][3], irradiance[9][3];
+        computeSHFromImage(data, width, sh);
+        convolveSH(sh, makeCosineKernel(), irradiance);
+        ReferenceIrradiance reference;
+        buildReferenceIrradiance(data, width, reference);
+        size_t offset = referenceTargets.size();
+        referenceTargets.resize(offset + (size_t)normals.count * 3);
+        evalReferenceIrradianceNormals(reference, normals, referenceErrorBound, &referenceTargets[offset]);
+        names.push_back(name);
+        bundled.insert(bundled.end(), &irradiance[0][0], &irradiance[0][0] + 27);
+        stbi_image_free(data);
+    }
+}
@@ -0,0 +1,130 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <stddef.h>
+#include <thread>
+#include <vector>
+
+// Split [0, count) into chunks of grain items and run fn(begin, end) on them
+// from every hardware thread. The calling thread takes part in the work.
+template <typename Fn>
+void parallelFor(int count, int grain, Fn fn) {
+    if (count <= 0) return;
+    if (grain < 1) grain = 1;
+    int chunkCount = (count + grain - 1) / grain;
+    int threadCount = (int)std::thread::hardware_concurrency();
+    threadCount = std::max(1, std::min(threadCount, chunkCount));
+
+    std::atomic<int> nextChunk(0);
+    auto worker = [&]() {
+        for (;;) {
+            int chunk = nextChunk.fetch_add(1);
+            if (chunk >= chunkCount) break;
+            int begin = chunk * grain;
+            fn(begin, std::min(begin + grain, count));
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 1; i < threadCount; ++i)
+        threads.emplace_back(worker);
+    worker();
+    for (size_t i = 0; i < threads.size(); ++i)
+        threads[i].join();
+}
+
+// Threads that stay alive between parallel loops, for work that runs every frame
+// where parallelFor would start and join hardware_concurrency - 1 threads each time.
+// run() has the same contract as parallelFor; calls from different threads take
+// turns, and fn must not call run() on the same pool.
+class WorkerPool {
+public:
+    WorkerPool() {
+        int threadCount = std::max(1, (int)std::thread::hardware_concurrency());
+        for (int i = 1; i < threadCount; ++i)
+            threads.emplace_back([this]() { workerLoop(); });
+    }
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (size_t i = 0; i < threads.size(); ++i)
+            threads[i].join();
+    }
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    template <typename Fn>
+    void run(int count, int grain, Fn fn) {
+        if (count <= 0) return;
+        if (grain < 1) grain = 1;
+        int chunkCount = (count + grain - 1) / grain;
+        std::function<void(int, int)> body = [&](int begin, int end) { fn(begin, end); };
+        if (threads.empty() || chunkCount == 1) {
+            body(0, count);
+            return;
+        }
+        std::lock_guard<std::mutex> turn(runMutex);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job = &body;
+            jobCount = count;
+            jobGrain = grain;
+            jobChunks = chunkCount;
+            nextChunk.store(0);
+            busy = (int)threads.size();
+            ++generation;
+        }
+        wake.notify_all();
+        work();
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this]() { return busy == 0; });
+        job = NULL;
+    }
+
+private:
+    void work() {
+        for (;;) {
+            int chunk = nextChunk.fetch_add(1);
+            if (chunk >= jobChunks) break;
+            int begin = chunk * jobGrain;
+            (*job)(begin, std::min(begin + jobGrain, jobCount));
+        }
+    }
+
+    void workerLoop() {
+        unsigned long long seen = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&]() { return stopping || generation != seen; });
+                if (stopping) return;
+                seen = generation;
+            }
+            work();
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (--busy == 0) done.notify_one();
+            }
+        }
+    }
+
+    std::vector<std::thread> threads;
+    std::mutex runMutex;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    unsigned long long generation = 0;
+    bool stopping = false;
+    int busy = 0;
+    const std::function<void(int, int)>* job = NULL;
+    int jobCount = 0;
+    int jobGrain = 1;
+    int jobChunks = 0;
+    std::atomic<int> nextChunk;
+};
@@ -0,0 +1,351 @@
+#include "probe_baker.h"
+#include "parallel_for.h"
+#include "probe_storage.h"
+#include "sh_convolution.h"
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+
+#define PI 3.14159265358979
+
+static const float c0 = 0.282095f, c1 = 0.488603f, c2 = 1.092548f, c3 = 0.315392f, c4 = 0.546274f;
+
+// Texel of the angular map seen along a world direction. The captures' frame has x
+// and y mirrored against the frame shader.frag evaluates in (see addPointLightSH).
+static const float* environmentTexel(const BakeScene& scene, float x, float y, float z) {
+    float cx = -x, cy = -y;
+    float theta = acosf(std::max(-1.0f, std::min(1.0f, z)));
+    float r = theta / (float)PI;
+    float phi = atan2f(cy, cx);
+    int w = scene.environmentWidth;
+    int j = (int)((r * cosf(phi) + 1.0f) * 0.5f * w);
+    int i = (int)((1.0f - r * sinf(phi)) * 0.5f * w);
+    i = std::max(0, std::min(w - 1, i));
+    j = std::max(0, std::min(w - 1, j));
+    return &scene.environment[3 * ((size_t)i * w + j)];
+}
+
+// Irradiance at p facing n from the bounce volume, blended from the eight surrounding
+// probes and clamped at the grid's edges. The probes are unpacked once per bounce, so
+// blending their polynomials rather than their records keeps a hit to a few madds.
+static void bounceIrradiance(const BakeScene& scene, const float p[3], const float n[3], float irradiance[3]) {
+    const ProbeVolume& volume = *scene.bounceVolume;
+    int base[3];
+    float frac[3];
+    for (int i = 0; i < 3; ++i) {
+        float extent = volume.boundsMax[i] - volume.boundsMin[i];
+        float g = extent > 0.0f ? (p[i] - volume.boundsMin[i]) / extent * (volume.dim[i] - 1) : 0.0f;
+        g = std::max(0.0f, std::min((float)(volume.dim[i] - 1), g));
+        base[i] = std::min((int)g, std::max(volume.dim[i] - 2, 0));
+        frac[i] = volume.dim[i] > 1 ? g - base[i] : 0.0f;
+    }
+    IrradiancePoly poly = {};
+    for (int corner = 0; corner < 8; ++corner) {
+        int index[3];
+        float weight = 1.0f;
+        for (int i = 0; i < 3; ++i) {
+            int up = (corner >> i) & 1;
+            index[i] = std::min(base[i] + up, volume.dim[i] - 1);
+            weight *= up ? frac[i] : 1.0f - frac[i];
+        }
+        if (weight == 0.0f) continue;
+        const float* src = &scene.bounceProbes[((size_t)index[2] * volume.dim[1] + index[1]) * volume.dim[0] + index[0]].c[0];
+        float* dst = &poly.c[0];
+        for (int k = 0; k < (int)(sizeof(IrradiancePoly) / sizeof(float)); ++k) dst[k] += weight * src[k];
+    }
+    evalIrradiancePoly(poly, n, irradiance);
+}
+
+void traceProbeRays(const BakeScene& scene, const float pos[3], const float* dirX, const float* dirY, const float* dirZ,
+    int count, float* rgb, float* distance) {
+    const SceneMesh& mesh = *scene.mesh;
+    for (int base = 0; base < count; base += RAY_PACKET_SIZE) {
+        int triangle[RAY_PACKET_SIZE];
+        float t[RAY_PACKET_SIZE];
+        traceRayPacket(*scene.bvh, pos, dirX + base, dirY + base, dirZ + base, FLT_MAX, triangle, t);
+        if (distance) {
+            for (int l = 0; l < RAY_PACKET_SIZE; ++l) distance[base + l] = triangle[l] < 0 ? FLT_MAX : t[l];
+        }
+        for (int l = 0; l < RAY_PACKET_SIZE; ++l) {
+            float* out = rgb + 3 * (base + l);
+            float d[3] = { dirX[base + l], dirY[base + l], dirZ[base + l] };
+            if (triangle[l] < 0) {
+                memcpy(out, environmentTexel(scene, d[0], d[1], d[2]), 3 * sizeof(float));
+                continue;
+            }
+            const unsigned int* tri = &mesh.triangles[triangle[l] * 3];
+            const float* v0 = &mesh.positions[tri[0] * 3];
+            const float* v1 = &mesh.positions[tri[1] * 3];
+            const float* v2 = &mesh.positions[tri[2] * 3];
+            float e1[3] = { v1[0] - v0[0], v1[1] - v0[1], v1[2] - v0[2] };
+            float e2[3] = { v2[0] - v0[0], v2[1] - v0[1], v2[2] - v0[2] };
+            float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+            float len = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            // Both sides of a triangle are lit; the normal faces the ray.
+            float facing = n[0] * d[0] + n[1] * d[1] + n[2] * d[2] > 0.0f ? -1.0f : 1.0f;
+            for (int i = 0; i < 3; ++i) n[i] *= facing / std::max(len, 1e-20f);
+            float irradiance[3];
+            if (scene.bounceVolume) {
+                float hit[3] = { pos[0] + t[l] * d[0], pos[1] + t[l] * d[1], pos[2] + t[l] * d[2] };
+                bounceIrradiance(scene, hit, n, irradiance);
+            }
+            else {
+                evalIrradiancePoly(scene.environmentIrradiance, n, irradiance);
+            }
+            const SceneMaterial& material = mesh.materials[mesh.triangleMaterial[triangle[l]]];
+            for (int c = 0; c < 3; ++c)
+                out[c] = material.emission[c] + material.albedo[c] * std::max(irradiance[c], 0.0f);
+        }
+    }
+}
+
+void bakeProbeAngularMap(const BakeScene& scene, const float pos[3], int width, float* rgb) {
+    // One row at a time, padded to whole packets; texels outside the disc stay black.
+    int padded = (width + RAY_PACKET_SIZE - 1) / RAY_PACKET_SIZE * RAY_PACKET_SIZE;
+    std::vector<float> dx(padded), dy(padded), dz(padded), radiance((size_t)padded * 3);
+    for (int i = 0; i < width; ++i) {
+        for (int j = 0; j < padded; ++j) {
+            float u = (j - width / 2.0f) / (width / 2.0f);
+            float v = (width / 2.0f - i) / (width / 2.0f);
+            float r = std::min(sqrtf(u * u + v * v), 1.0f);
+            float theta = (float)PI * r, phi = atan2f(v, u);
+            dx[j] = -sinf(theta) * cosf(phi);
+            dy[j] = -sinf(theta) * sinf(phi);
+            dz[j] = cosf(theta);
+        }
+        traceProbeRays(scene, pos, &dx[0], &dy[0], &dz[0], padded, &radiance[0], NULL);
+        for (int j = 0; j < width; ++j) {
+            float u = (j - width / 2.0f) / (width / 2.0f);
+            float v = (width / 2.0f - i) / (width / 2.0f);
+            bool inside = u * u + v * v <= 1.0f;
+            for (int c = 0; c < 3; ++c)
+                rgb[3 * ((size_t)i * width + j) + c] = inside ? radiance[3 * j + c] : 0.0f;
+        }
+    }
+}
+
+// Octahedral bin of a unit direction.
+static int reachBin(float x, float y, float z) {
+    float n = fabsf(x) + fabsf(y) + fabsf(z);
+    float u = x / n, v = y / n;
+    if (z < 0.0f) {
+        float fu = (1.0f - fabsf(v)) * (u < 0.0f ? -1.0f : 1.0f);
+        v = (1.0f - fabsf(u)) * (v < 0.0f ? -1.0f : 1.0f);
+        u = fu;
+    }
+    int i = std::min(PROBE_REACH_BINS - 1, (int)((u + 1.0f) * 0.5f * PROBE_REACH_BINS));
+    int j = std::min(PROBE_REACH_BINS - 1, (int)((v + 1.0f) * 0.5f * PROBE_REACH_BINS));
+    return j * PROBE_REACH_BINS + i;
+}
+
+static void octahedralDirection(float u, float v, float d[3]) {
+    float z = 1.0f - fabsf(u) - fabsf(v);
+    if (z < 0.0f) {
+        float fu = (1.0f - fabsf(v)) * (u < 0.0f ? -1.0f : 1.0f);
+        v = (1.0f - fabsf(u)) * (v < 0.0f ? -1.0f : 1.0f);
+        u = fu;
+    }
+    float len = sqrtf(u * u + v * v + z * z);
+    d[0] = u / len;
+    d[1] = v / len;
+    d[2] = z / len;
+}
+
+// Central direction of every reach bin and the widest angle from it to a direction in
+// the bin, measured densely over the bin's square and widened a little.
+struct ReachBins {
+    float center[PROBE_REACH_SIZE][3];
+    float radius[PROBE_REACH_SIZE];
+    ReachBins() {
+        const int steps = 16;
+        float size = 2.0f / PROBE_REACH_BINS;
+        for (int b = 0; b < PROBE_REACH_SIZE; ++b) {
+            float u0 = -1.0f + (b % PROBE_REACH_BINS) * size, v0 = -1.0f + (b / PROBE_REACH_BINS) * size;
+            octahedralDirection(u0 + 0.5f * size, v0 + 0.5f * size, center[b]);
+            float minCos = 1.0f;
+            for (int i = 0; i <= steps; ++i) {
+                for (int j = 0; j <= steps; ++j) {
+                    float d[3];
+                    octahedralDirection(u0 + size * i / steps, v0 + size * j / steps, d);
+                    minCos = std::min(minCos, d[0] * center[b][0] + d[1] * center[b][1] + d[2] * center[b][2]);
+                }
+            }
+            radius[b] = acosf(std::max(-1.0f, std::min(1.0f, minCos))) * 1.05f + 1e-3f;
+        }
+    }
+};
+
+static const ReachBins& reachBins() {
+    static const ReachBins bins;
+    return bins;
+}
+
+void bakeProbeSH(const BakeScene& scene, const float pos[3], int rayCount, float sh[9][3], float* reach) {
+    int count = (rayCount + RAY_PACKET_SIZE - 1) / RAY_PACKET_SIZE * RAY_PACKET_SIZE;
+    std::vector<float> dx(count), dy(count), dz(count), radiance((size_t)count * 3), distance(reach ? count : 0);
+    const float golden = (float)(PI * (3.0 - sqrt(5.0)));
+    for (int k = 0; k < count; ++k) {
+        float z = 1.0f - (2.0f * k + 1.0f) / count;
+        float r = sqrtf(std::max(0.0f, 1.0f - z * z));
+        dx[k] = r * cosf(golden * k);
+        dy[k] = r * sinf(golden * k);
+        dz[k] = z;
+    }
+    traceProbeRays(scene, pos, &dx[0], &dy[0], &dz[0], count, &radiance[0], reach ? &distance[0] : NULL);
+    if (reach) {
+        for (int b = 0; b < PROBE_REACH_SIZE; ++b) reach[b] = 0.0f;
+        for (int k = 0; k < count; ++k) {
+            float& bin = reach[reachBin(dx[k], dy[k], dz[k])];
+            bin = std::max(bin, distance[k]);
+        }
+    }
+
+    memset(sh, 0, 9 * 3 * sizeof(float));
+    float weight = (float)(4.0 * PI / count);
+    for (int k = 0; k < count; ++k) {
+        float x = dx[k], y = dy[k], z = dz[k];
+        float basis[9] = { c0, -c1 * y, c1 * z, -c1 * x, c2 * x * y, -c2 * y * z, c3 * (3.0f * z * z - 1.0f), -c2 * x * z,
+            c4 * (x * x - y * y) };
+        for (int i = 0; i < 9; ++i)
+            for (int c = 0; c < 3; ++c)
+                sh[i][c] += radiance[3 * k + c] * basis[i] * weight;
+    }
+}
+
+double bakeProbesSH(const BakeScene& scene, const float* positions, int count, int rayCount, float* sh, float* reach) {
+    auto start = std::chrono::high_resolution_clock::now();
+    parallelFor(count, 1, [&](int begin, int end) {
+        for (int p = begin; p < end; ++p) {
+            bakeProbeSH(scene, positions + 3 * p, rayCount, (float (*)[3])(sh + 27 * (size_t)p),
+                reach ? reach + PROBE_REACH_SIZE * (size_t)p : NULL);
+        }
+    });
+    auto end = std::chrono::high_resolution_clock::now();
+    int rays = (rayCount + RAY_PACKET_SIZE - 1) / RAY_PACKET_SIZE * RAY_PACKET_SIZE;
+    return (double)rays * count / std::chrono::duration<double>(end - start).count();
+}
+
+int markProbesInBox(const float* positions, int count, const float* reach, const float lo[3], const float hi[3],
+    float minCoverage, std::vector<unsigned char>& dirty) {
+    const ReachBins& bins = reachBins();
+    dirty.resize(count, 0);
+    float center[3], radius = 0.0f;
+    for (int i = 0; i < 3; ++i) {
+        center[i] = 0.5f * (lo[i] + hi[i]);
+        radius += 0.25f * (hi[i] - lo[i]) * (hi[i] - lo[i]);
+    }
+    radius = sqrtf(radius);
+    int marked = 0;
+    for (int p = 0; p < count; ++p) {
+        if (dirty[p]) continue;
+        const float* pos = positions + 3 * p;
+        const float* probeReach = reach + PROBE_REACH_SIZE * (size_t)p;
+        float axis[3], nearest = 0.0f, d = 0.0f;
+        for (int i = 0; i < 3; ++i) {
+            axis[i] = center[i] - pos[i];
+            d += axis[i] * axis[i];
+            float outside = std::max(std::max(lo[i] - pos[i], pos[i] - hi[i]), 0.0f);
+            nearest += outside * outside;
+        }
+        d = sqrtf(d);
+        nearest = sqrtf(nearest);
+        bool touched = d <= radius;
+        if (!touched) {
+            // A ray through the box leaves within the box's bounding cone and has
+            // travelled at least `nearest` when it gets there.
+            float halfAngle = asinf(radius / d);
+            if (0.5f * (1.0f - cosf(halfAngle)) < minCoverage) continue;
+            for (int i = 0; i < 3; ++i) axis[i] /= d;
+            for (int b = 0; b < PROBE_REACH_SIZE && !touched; ++b) {
+                if (probeReach[b] < nearest) continue;
+                float spread = halfAngle + bins.radius[b];
+                float c = axis[0] * bins.center[b][0] + axis[1] * bins.center[b][1] + axis[2] * bins.center[b][2];
+                touched = spread >= (float)PI || c >= cosf(spread);
+            }
+        }
+        if (touched) {
+            dirty[p] = 1;
+            marked++;
+        }
+    }
+    return marked;
+}
+
+int rebakeDirtyProbes(const BakeScene& scene, const float* positions, int count, int rayCount,
+    std::vector<unsigned char>& dirty, float* sh, float* reach) {
+    std::vector<int> probes;
+    for (int p = 0; p < count && p < (int)dirty.size(); ++p) {
+        if (dirty[p]) probes.push_back(p);
+    }
+    parallelFor((int)probes.size(), 1, [&](int begin, int end) {
+        for (int k = begin; k < end; ++k) {
+            size_t p = probes[k];
+            bakeProbeSH(scene, positions + 3 * p, rayCount, (float (*)[3])(sh + 27 * p), reach + PROBE_REACH_SIZE * p);
+        }
+    });
+    for (int p : probes) dirty[p] = 0;
+    return (int)probes.size();
+}
+
+int bakeVolumeBounces(const BakeScene& scene, const ProbeVolume& volume, const float* positions, int rayCount,
+    int maxBounces, float threshold, float* sh, float* reach, std::vector<IrradiancePoly>& bounceProbes) {
+    int count = volume.dim[0] * volume.dim[1] * volume.dim[2];
+    // The bounce being baked writes sh while its hits read the previous one's records.
+    std::vector<float> previous((size_t)count * 27);
+    bounceProbes.resize(count);
+    BakeScene bounceScene = scene;
+    bounceScene.bounceVolume = NULL;
+    bounceScene.bounceProbes = NULL;
+    int bounce = 0;
+    while (bounce < maxBounces) {
+        auto start = std::chrono::high_resolution_clock::now();
+        bakeProbesSH(bounceScene, positions, count, rayCount, sh, reach);
+        bounce++;
+
+        float largestL0 = 0.0f, change = 0.0f;
+        for (size_t p = 0; p < (size_t)count; ++p) {
+            for (int c = 0; c < 3; ++c) largestL0 = std::max(largestL0, fabsf(sh[27 * p + c]));
+            for (int k = 0; k < 27 && bounce > 1; ++k) change = std::max(change, fabsf(sh[27 * p + k] - previous[27 * p + k]));
+        }
+        parallelFor(count, 256, [&](int begin, int end) {
+            for (int p = begin; p < end; ++p) {
+                float irradiance[9][3], zh3[15];
+                convolveSH((const float (*)[3])(sh + 27 * (size_t)p), makeCosineKernel(), irradiance);
+                packProbe(PROBE_STORAGE_ZH3, irradiance, zh3);
+                unpackProbe(PROBE_STORAGE_ZH3, zh3, bounceProbes[p]);
+            }
+        });
+        memcpy(&previous[0], sh, previous.size() * sizeof(float));
+        bounceScene.bounceVolume = &volume;
+        bounceScene.bounceProbes = &bounceProbes[0];
+
+        auto end = std::chrono::high_resolution_clock::now();
+        float relative = largestL0 > 0.0f ? change / largestL0 : 0.0f;
+        if (bounce == 1)
+            printf("Bounce 1: %d probes in %.3f s\n", count, std::chrono::duration<double>(end - start).count());
+        else
+            printf("Bounce %d: %d probes in %.3f s, largest change %.2e of L0\n", bounce, count,
+                std::chrono::duration<double>(end - start).count(), relative);
+        if (bounce > 1 && relative < threshold) break;
+    }
+    return bounce;
+}
+
+void benchmarkProbeBaker(const BakeScene& scene, int probeCount, int rayCount) {
+    const BvhNode& root = scene.bvh->nodes[0];
+    std::vector<float> positions((size_t)probeCount * 3);
+    unsigned int seed = 1u;
+    for (size_t i = 0; i < positions.size(); ++i) {
+        seed = seed * 1664525u + 1013904223u;
+        float t = (seed >> 8) / 16777216.0f;
+        positions[i] = root.boundsMin[i % 3] + (root.boundsMax[i % 3] - root.boundsMin[i % 3]) * t;
+    }
+    std::vector<float> sh((size_t)probeCount * 27);
+    double raysPerSecond = bakeProbesSH(scene, &positions[0], probeCount, rayCount, &sh[0], NULL);
+    printf("Probe baker: %zu triangles, %zu BVH nodes, %d probes x %d rays in %d-ray packets: %.2f M rays/s\n",
+        scene.mesh->triangleMaterial.size(), scene.bvh->nodes.size(), probeCount, rayCount, RAY_PACKET_SIZE,
+        raysPerSecond * 1e-6);
+}
@@ -0,0 +1,74 @@
+// probe_baker.h
+#pragma once
+#include "irradiance.h"
+#include "probe_volume.h"
+#include "scene_bvh.h"
+
+// What a probe sees: the scene's triangles in front of a captured environment. Rays
+// that escape read the environment, an angular map in the layout of the .float
+// captures; rays that hit a triangle return its emission plus its albedo times the
+// environment's irradiance at its normal, unshadowed, as a single diffuse bounce.
+// With a bounce volume the irradiance at the hit is read from that probe grid
+// instead, blended trilinearly from its probes' ZH3, which carries every earlier bounce.
+struct BakeScene {
+    const SceneMesh* mesh;
+    const SceneBvh* bvh;
+    const float* environment;  // width x width RGB radiance
+    int environmentWidth;
+    IrradiancePoly environmentIrradiance;  // built from the cosine-convolved environment SH
+    const ProbeVolume* bounceVolume;       // NULL to light hits with the environment
+    const IrradiancePoly* bounceProbes;    // unpacked ZH3 per probe, in volumeProbePosition order, x fastest
+};
+
+// Radiance seen from pos along count unit directions, in packets of RAY_PACKET_SIZE;
+// count must be a multiple of it. distance, when not NULL, receives how far each ray
+// travelled, FLT_MAX for rays that escaped.
+void traceProbeRays(const BakeScene& scene, const float pos[3], const float* dirX, const float* dirY, const float* dirZ,
+    int count, float* rgb, float* distance);
+
+// Render the view from pos into a width x width angular map laid out like the .float
+// captures, one ray per texel, for computeSHFromImage or the capture tools.
+void bakeProbeAngularMap(const BakeScene& scene, const float pos[3], int width, float* rgb);
+// Project the view from pos straight to SH with rayCount rays on a spherical
+// Fibonacci set, rounded up to whole packets: the same basis and scale as
+// computeSHFromFloatFile, before cosine convolution. reach, when not NULL, receives
+// the probe's dependency record described below.
+void bakeProbeSH(const BakeScene& scene, const float pos[3], int rayCount, float sh[9][3], float* reach);
+
+// Bake count probes at positions (xyz each) over all cores, one probe per task, and
+// return the rays traced per second. reach is NULL or PROBE_REACH_SIZE floats per probe.
+double bakeProbesSH(const BakeScene& scene, const float* positions, int count, int rayCount, float* sh, float* reach);
+
+// What a baked probe depends on: the directions are split into an octahedral map of
+// PROBE_REACH_BINS^2 bins, and each bin keeps the farthest any of its rays travelled
+// (FLT_MAX once one escaped). A hit is shaded from the triangle alone, so a probe can
+// only change when geometry enters, leaves or changes inside those ray segments.
+#define PROBE_REACH_BINS 16
+#define PROBE_REACH_SIZE (PROBE_REACH_BINS * PROBE_REACH_BINS)
+
+// Mark each probe whose recorded rays may pass through the box lo..hi and return how
+// many were newly marked. Moving, adding, removing or re-materialing triangles is
+// covered by marking their bounds before and after the edit. Probes that see the box's
+// bounding sphere over less than minCoverage of all directions are left alone: about
+// 1 / rayCount skips probes that at most a ray or two could notice, 0 is exact.
+int markProbesInBox(const float* positions, int count, const float* reach, const float lo[3], const float hi[3],
+    float minCoverage, std::vector<unsigned char>& dirty);
+// Re-bake the marked probes of a bakeProbesSH result in place, sh and reach alike,
+// and clear the marks. Returns the number of probes baked, so the cost follows the
+// size of the edit rather than of the grid.
+int rebakeDirtyProbes(const BakeScene& scene, const float* positions, int count, int rayCount,
+    std::vector<unsigned char>& dirty, float* sh, float* reach);
+
+// Bake the probes of a grid bounce by bounce. The first bounce lights hits with the
+// environment; each later one re-traces the same rays and lights hits with the grid
+// of the bounce before, evaluated as ZH3, so every bounce costs one ray per sample.
+// Bounces stop after maxBounces or once no coefficient moved by more than threshold
+// times the grid's largest L0. positions are the grid's probes in volumeProbePosition
+// order; sh receives the radiance SH, reach the dependency records (or NULL) and
+// bounceProbes the unpacked ZH3 of the result, ready to be the bounce volume of later
+// re-bakes. Returns the number of bounces baked.
+int bakeVolumeBounces(const BakeScene& scene, const ProbeVolume& volume, const float* positions, int rayCount,
+    int maxBounces, float threshold, float* sh, float* reach, std::vector<IrradiancePoly>& bounceProbes);
+
+// Print BVH size and baking throughput for probeCount probes spread through the scene bounds.
+void benchmarkProbeBaker(const BakeScene& scene, int probeCount, int rayCount);
@@ -0,0 +1,240 @@
+#include "probe_brick_map.h"
+#include "parallel_for.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <random>
+
+static int brickIndex(const BrickMap& map, int x, int y, int z) {
+    return (z * map.bricks[1] + y) * map.bricks[0] + x;
+}
+
+static size_t atlasTexel(const BrickMap& map, int x, int y, int z) {
+    return ((size_t)z * map.atlasBricks[1] * BRICK_PROBES + y) * map.atlasBricks[0] * BRICK_PROBES + x;
+}
+
+// Bricks along one axis containing probe coordinate c: two when c lies on a shared face.
+static int bricksOfCell(int c, int bricks, int out[2]) {
+    int first = c / 3 < bricks ? c / 3 : bricks - 1;
+    out[0] = first;
+    if (c % 3 == 0 && c / 3 - 1 >= 0 && c / 3 - 1 != first) {
+        out[1] = c / 3 - 1;
+        return 2;
+    }
+    return 1;
+}
+
+void buildBrickMap(const int bricks[3], const float boundsMin[3], const float boundsMax[3], VolumeFormat format,
+    const int* cells, const float* probes, int probeCount, const float fallback[9][3], BrickMap& map) {
+    for (int i = 0; i < 3; ++i) {
+        map.bricks[i] = bricks[i];
+        map.boundsMin[i] = boundsMin[i];
+        map.boundsMax[i] = boundsMax[i];
+    }
+    map.format = format;
+
+    // Mark the brick owning each listed probe, then give them atlas slots in grid order.
+    int brickTotal = bricks[0] * bricks[1] * bricks[2];
+    std::vector<int> slots(brickTotal, 0);
+    auto forEachBrick = [&](const int* cell, auto fn) {
+        int bx[2], by[2], bz[2];
+        int nx = bricksOfCell(cell[0], bricks[0], bx);
+        int ny = bricksOfCell(cell[1], bricks[1], by);
+        int nz = bricksOfCell(cell[2], bricks[2], bz);
+        for (int k = 0; k < nz; ++k)
+            for (int j = 0; j < ny; ++j)
+                for (int i = 0; i < nx; ++i)
+                    fn(bx[i], by[j], bz[k]);
+    };
+    for (int p = 0; p < probeCount; ++p) {
+        const int* cell = cells + (size_t)p * 3;
+        int owner[3][2];
+        for (int i = 0; i < 3; ++i) bricksOfCell(cell[i], bricks[i], owner[i]);
+        slots[brickIndex(map, owner[0][0], owner[1][0], owner[2][0])] = 1;
+    }
+    map.brickCount = 1;
+    for (int b = 0; b < brickTotal; ++b)
+        if (slots[b]) slots[b] = map.brickCount++;
+
+    int ax = map.brickCount < BRICK_ATLAS_MAX ? map.brickCount : BRICK_ATLAS_MAX;
+    int ay = (map.brickCount + ax - 1) / ax;
+    ay = ay < BRICK_ATLAS_MAX ? ay : BRICK_ATLAS_MAX;
+    int az = (map.brickCount + ax * ay - 1) / (ax * ay);
+    if (az > BRICK_ATLAS_MAX)
+        printf("Brick atlas of %d bricks exceeds %d^3 bricks\n", map.brickCount, BRICK_ATLAS_MAX);
+    map.atlasBricks[0] = ax;
+    map.atlasBricks[1] = ay;
+    map.atlasBricks[2] = az;
+
+    map.indirection.assign((size_t)brickTotal * 4, 0);
+    for (int b = 0; b < brickTotal; ++b) {
+        unsigned char* entry = &map.indirection[(size_t)b * 4];
+        entry[0] = (unsigned char)(slots[b] % ax);
+        entry[1] = (unsigned char)(slots[b] / ax % ay);
+        entry[2] = (unsigned char)(slots[b] / (ax * ay));
+    }
+
+    // Fill the atlas with the fallback, then copy every probe into each occupied brick sharing it.
+    ProbeStorage storage = volumeFormatStorage(format);
+    ProbeEncoding encoding = volumeFormatEncoding(format);
+    int floats = probeStorageFloats(storage);
+    size_t atlasProbes = (size_t)ax * ay * az * BRICK_PROBES * BRICK_PROBES * BRICK_PROBES;
+    std::vector<float> packed(atlasProbes * floats);
+    std::vector<float> fallbackPacked(floats);
+    packProbe(storage, fallback, &fallbackPacked[0]);
+    for (size_t t = 0; t < atlasProbes; ++t)
+        memcpy(&packed[t * floats], &fallbackPacked[0], floats * sizeof(float));
+    for (int p = 0; p < probeCount; ++p) {
+        const int* cell = cells + (size_t)p * 3;
+        float probe[27];
+        packProbe(storage, (const float (*)[3])(probes + (size_t)p * 27), probe);
+        forEachBrick(cell, [&](int x, int y, int z) {
+            if (!slots[brickIndex(map, x, y, z)]) return;
+            const unsigned char* entry = &map.indirection[(size_t)brickIndex(map, x, y, z) * 4];
+            size_t t = atlasTexel(map, entry[0] * BRICK_PROBES + cell[0] - 3 * x, entry[1] * BRICK_PROBES + cell[1] - 3 * y,
+                entry[2] * BRICK_PROBES + cell[2] - 3 * z);
+            memcpy(&packed[t * floats], probe, floats * sizeof(float));
+        });
+    }
+
+    int recordBytes = probeEncodedBytes(storage, encoding);
+    int rowProbes = ax * BRICK_PROBES;
+    map.atlas.resize(atlasProbes * recordBytes);
+    parallelFor((int)(atlasProbes / rowProbes), 64, [&](int begin, int end) {
+        for (int row = begin; row < end; ++row) {
+            size_t first = (size_t)row * rowProbes;
+            encodeProbes(storage, encoding, &packed[first * floats], rowProbes, &map.atlas[first * recordBytes]);
+        }
+    });
+}
+
+size_t brickMapBytes(const BrickMap& map) {
+    return map.indirection.size() + map.atlas.size();
+}
+
+void brickAtlasTexels(const BrickMap& map, int texture, unsigned char* dst) {
+    size_t recordBytes = probeEncodedBytes(volumeFormatStorage(map.format), volumeFormatEncoding(map.format));
+    deinterleaveVolumeTexels(map.format, &map.atlas[0], map.atlas.size() / recordBytes, texture, dst);
+}
+
+// Blend the eight records around base, x, y and z steps apart, by the weights frac.
+static void blendRecords(VolumeFormat format, const unsigned char* base, const size_t step[3], const float frac[3],
+    float* probe) {
+    ProbeStorage storage = volumeFormatStorage(format);
+    ProbeEncoding encoding = volumeFormatEncoding(format);
+    int floats = probeStorageFloats(storage);
+    float corner[27];
+    for (int k = 0; k < floats; ++k) probe[k] = 0.0f;
+    for (int c = 0; c < 8; ++c) {
+        int dx = c & 1, dy = (c >> 1) & 1, dz = c >> 2;
+        float w = (dx ? frac[0] : 1.0f - frac[0]) * (dy ? frac[1] : 1.0f - frac[1]) * (dz ? frac[2] : 1.0f - frac[2]);
+        decodeProbes(storage, encoding, base + dx * step[0] + dy * step[1] + dz * step[2], 1, corner);
+        for (int k = 0; k < floats; ++k) probe[k] += w * corner[k];
+    }
+}
+
+// Probe coordinates of pos in a grid of cells probe spacings per axis, clamped to it.
+static void gridCoordinates(const float boundsMin[3], const float boundsMax[3], const int cells[3], const float pos[3],
+    float f[3]) {
+    for (int i = 0; i < 3; ++i) {
+        float t = (pos[i] - boundsMin[i]) / (boundsMax[i] - boundsMin[i]);
+        t = t < 0.0f ? 0.0f : (t > 1.0f ? 1.0f : t);
+        f[i] = t * cells[i];
+    }
+}
+
+void sampleBrickMap(const BrickMap& map, const float pos[3], float* probe) {
+    int cells[3] = { 3 * map.bricks[0], 3 * map.bricks[1], 3 * map.bricks[2] };
+    float f[3], frac[3];
+    gridCoordinates(map.boundsMin, map.boundsMax, cells, pos, f);
+    int brick[3], texel[3];
+    for (int i = 0; i < 3; ++i) {
+        brick[i] = (int)(f[i] / 3.0f);
+        brick[i] = brick[i] < map.bricks[i] ? brick[i] : map.bricks[i] - 1;
+        float local = f[i] - 3.0f * brick[i];
+        int cell = (int)local < 2 ? (int)local : 2;
+        frac[i] = local - cell;
+        texel[i] = cell;
+    }
+    const unsigned char* entry = &map.indirection[(size_t)brickIndex(map, brick[0], brick[1], brick[2]) * 4];
+    size_t recordBytes = probeEncodedBytes(volumeFormatStorage(map.format), volumeFormatEncoding(map.format));
+    size_t width = (size_t)map.atlasBricks[0] * BRICK_PROBES, height = (size_t)map.atlasBricks[1] * BRICK_PROBES;
+    size_t step[3] = { recordBytes, width * recordBytes, width * height * recordBytes };
+    size_t t = atlasTexel(map, entry[0] * BRICK_PROBES + texel[0], entry[1] * BRICK_PROBES + texel[1],
+        entry[2] * BRICK_PROBES + texel[2]);
+    blendRecords(map.format, &map.atlas[t * recordBytes], step, frac, probe);
+}
+
+static void sampleDense(const ProbeVolume& volume, const unsigned char* records, const float pos[3], float* probe) {
+    int cells[3] = { volume.dim[0] - 1, volume.dim[1] - 1, volume.dim[2] - 1 };
+    float f[3], frac[3];
+    gridCoordinates(volume.boundsMin, volume.boundsMax, cells, pos, f);
+    int texel[3];
+    for (int i = 0; i < 3; ++i) {
+        texel[i] = (int)f[i] < cells[i] - 1 ? (int)f[i] : cells[i] - 1;
+        frac[i] = f[i] - texel[i];
+    }
+    size_t recordBytes = probeEncodedBytes(volumeFormatStorage(volume.format), volumeFormatEncoding(volume.format));
+    size_t step[3] = { recordBytes, volume.dim[0] * recordBytes, (size_t)volume.dim[0] * volume.dim[1] * recordBytes };
+    size_t t = ((size_t)texel[2] * volume.dim[1] + texel[1]) * volume.dim[0] + texel[0];
+    blendRecords(volume.format, records + t * recordBytes, step, frac, probe);
+}
+
+void benchmarkBrickMap(const BrickMap& map, const ProbeSource& source, int lookupCount) {
+    ProbeVolume volume;
+    for (int i = 0; i < 3; ++i) {
+        volume.dim[i] = 3 * map.bricks[i] + 1;
+        volume.boundsMin[i] = map.boundsMin[i];
+        volume.boundsMax[i] = map.boundsMax[i];
+    }
+    volume.format = map.format;
+    int recordBytes = probeEncodedBytes(volumeFormatStorage(map.format), volumeFormatEncoding(map.format));
+    size_t slice = (size_t)volume.dim[0] * volume.dim[1];
+    std::vector<unsigned char> dense(volumeBytes(volume.dim, volume.format));
+    bakeProbeVolume(volume, source, [&](int z, int t, const unsigned char* texels) {
+        int texelBytes = volumeTexelBytes(volume.format, t);
+        unsigned char* dst = &dense[(z * slice) * recordBytes + (size_t)t * texelBytes];
+        for (size_t p = 0; p < slice; ++p)
+            memcpy(dst + p * recordBytes, texels + p * texelBytes, texelBytes);
+    });
+
+    // Random positions inside occupied bricks, where both structures hold real probes.
+    std::vector<int> occupied;
+    for (int b = 0; b < map.bricks[0] * map.bricks[1] * map.bricks[2]; ++b) {
+        const unsigned char* entry = &map.indirection[(size_t)b * 4];
+        if (entry[0] | entry[1] | entry[2]) occupied.push_back(b);
+    }
+    if (occupied.empty()) return;
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::vector<float> positions((size_t)lookupCount * 3);
+    for (int l = 0; l < lookupCount; ++l) {
+        int b = occupied[rng() % occupied.size()];
+        int brick[3] = { b % map.bricks[0], b / map.bricks[0] % map.bricks[1], b / (map.bricks[0] * map.bricks[1]) };
+        for (int i = 0; i < 3; ++i) {
+            float t = (brick[i] + unit(rng)) / map.bricks[i];
+            positions[(size_t)l * 3 + i] = map.boundsMin[i] + (map.boundsMax[i] - map.boundsMin[i]) * t;
+        }
+    }
+
+    float probe[27];
+    double checksum = 0.0;
+    auto time = [&](auto lookup) {
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int l = 0; l < lookupCount; ++l) {
+            lookup(&positions[(size_t)l * 3], probe);
+            checksum += probe[0];
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        return std::chrono::duration<double>(end - start).count();
+    };
+    double denseSeconds = time([&](const float* pos, float* out) { sampleDense(volume, &dense[0], pos, out); });
+    double brickSeconds = time([&](const float* pos, float* out) { sampleBrickMap(map, pos, out); });
+
+    printf("Probe brick map, %s, %d^3 probes, %d of %d bricks occupied\n", volumeFormatName(map.format), volume.dim[0],
+        map.brickCount - 1, map.bricks[0] * map.bricks[1] * map.bricks[2]);
+    printf("  %-6s %10.2f MB %8.1f ns/lookup\n", "dense", dense.size() / 1048576.0, denseSeconds / lookupCount * 1e9);
+    printf("  %-6s %10.2f MB %8.1f ns/lookup (checksum %g)\n", "sparse", brickMapBytes(map) / 1048576.0,
+        brickSeconds / lookupCount * 1e9, checksum);
+}
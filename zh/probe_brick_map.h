@@ -0,0 +1,43 @@
+// probe_brick_map.h
+#pragma once
+#include <vector>
+#include "probe_volume.h"
+
+#define BRICK_PROBES 4        // probes along each edge of a brick
+#define BRICK_ATLAS_MAX 64    // bricks along each atlas axis: 256 texels, the GL 3.3 minimum
+
+// Sparse probe grid of bricks[0] x bricks[1] x bricks[2] bricks. A brick holds 4x4x4
+// probes spanning three probe spacings, sharing its boundary probes with its
+// neighbours, so the whole grid has 3 * bricks + 1 probes per axis and trilinear
+// filtering inside a brick of the atlas never reads another brick. Empty bricks
+// point at atlas slot 0, filled with a fallback probe, so lookups need no branch.
+struct BrickMap {
+    int bricks[3];
+    float boundsMin[3];   // position of probe (0, 0, 0)
+    float boundsMax[3];   // position of probe 3 * bricks
+    VolumeFormat format;
+    int atlasBricks[3];
+    int brickCount;       // occupied bricks plus the fallback
+    std::vector<unsigned char> indirection;  // RGBA8UI atlas slot per brick, x fastest
+    std::vector<unsigned char> atlas;        // encoded records in atlas texel order
+};
+
+// Build the map from probeCount probes on the fine grid: probe p sits at probe
+// coordinates cells[3p..3p+2] and has cosine-convolved SH probes[27p..27p+26]. A brick
+// is stored when it owns a listed probe, one with c / 3 == brick on every axis (the
+// last brick also owns the far face), so probes on shared faces never occupy a
+// neighbour by themselves. Unlisted probes of stored bricks take fallback.
+void buildBrickMap(const int bricks[3], const float boundsMin[3], const float boundsMax[3], VolumeFormat format,
+    const int* cells, const float* probes, int probeCount, const float fallback[9][3], BrickMap& map);
+
+size_t brickMapBytes(const BrickMap& map);
+// Copy texture `texture` of the atlas (see probe_volume.h) into dst, one texel per atlas probe.
+void brickAtlasTexels(const BrickMap& map, int texture, unsigned char* dst);
+
+// Trilinearly blended stored probe (see probe_storage.h) at pos, the CPU twin of the
+// two-level lookup in shader_volume.frag.
+void sampleBrickMap(const BrickMap& map, const float pos[3], float* probe);
+
+// Time lookups at lookupCount random positions inside occupied bricks in the map and
+// in a dense grid of the same resolution baked from source, and print both sizes.
+void benchmarkBrickMap(const BrickMap& map, const ProbeSource& source, int lookupCount);
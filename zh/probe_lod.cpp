@@ -0,0 +1,161 @@
+#include "probe_lod.h"
+#include "parallel_for.h"
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+static const int blockSpan = LOD_BLOCK_PROBES - 1;
+
+void lodFieldDim(const ProbeLodField& field, int dim[3]) {
+    for (int i = 0; i < 3; ++i) dim[i] = field.blocks[i] * blockSpan + 1;
+}
+
+void bakeLodField(const int blocks[3], const float boundsMin[3], const float boundsMax[3], const ProbeSource& source,
+    ProbeLodField& field) {
+    for (int i = 0; i < 3; ++i) {
+        field.blocks[i] = blocks[i];
+        field.boundsMin[i] = boundsMin[i];
+        field.boundsMax[i] = boundsMax[i];
+    }
+    ProbeVolume volume;
+    lodFieldDim(field, volume.dim);
+    for (int i = 0; i < 3; ++i) {
+        volume.boundsMin[i] = boundsMin[i];
+        volume.boundsMax[i] = boundsMax[i];
+    }
+    volume.format = VOLUME_ZH3_HALF;
+    int recordBytes = probeEncodedBytes(PROBE_STORAGE_ZH3, PROBE_ENCODING_HALF);
+    field.records.resize((size_t)volume.dim[0] * volume.dim[1] * volume.dim[2] * recordBytes);
+    parallelFor(volume.dim[1] * volume.dim[2], 16, [&](int begin, int end) {
+        std::vector<float> packed((size_t)volume.dim[0] * 15);
+        for (int row = begin; row < end; ++row) {
+            int y = row % volume.dim[1], z = row / volume.dim[1];
+            for (int x = 0; x < volume.dim[0]; ++x) {
+                float pos[3], sh[9][3];
+                volumeProbePosition(volume, x, y, z, pos);
+                source(pos, sh);
+                packProbe(PROBE_STORAGE_ZH3, sh, &packed[(size_t)x * 15]);
+            }
+            encodeProbes(PROBE_STORAGE_ZH3, PROBE_ENCODING_HALF, &packed[0], volume.dim[0],
+                &field.records[(size_t)row * volume.dim[0] * recordBytes]);
+        }
+    });
+}
+
+void lodBlockK2Texels(const ProbeLodField& field, int block, unsigned char* dst) {
+    int dim[3];
+    lodFieldDim(field, dim);
+    int recordBytes = probeEncodedBytes(PROBE_STORAGE_ZH3, PROBE_ENCODING_HALF);
+    int texelBytes = volumeTexelBytes(VOLUME_ZH3_HALF, 3);
+    int bx = block % field.blocks[0];
+    int by = block / field.blocks[0] % field.blocks[1];
+    int bz = block / (field.blocks[0] * field.blocks[1]);
+    for (int z = 0; z < LOD_BLOCK_PROBES; ++z) {
+        for (int y = 0; y < LOD_BLOCK_PROBES; ++y) {
+            for (int x = 0; x < LOD_BLOCK_PROBES; ++x) {
+                size_t probe = ((size_t)(bz * blockSpan + z) * dim[1] + by * blockSpan + y) * dim[0] + bx * blockSpan + x;
+                memcpy(dst, &field.records[probe * recordBytes + 3 * texelBytes], texelBytes);
+                dst += texelBytes;
+            }
+        }
+    }
+}
+
+void ProbeLodSelector::init(const ProbeLodField& field, int atlasSlots, float farDistance, float margin) {
+    lodField = &field;
+    farDist = farDistance;
+    keepMargin = margin;
+    int slots = std::min(atlasSlots + 1, LOD_ATLAS_MAX * LOD_ATLAS_MAX * LOD_ATLAS_MAX);
+    atlas[0] = std::min(slots, LOD_ATLAS_MAX);
+    atlas[1] = std::min((slots + atlas[0] - 1) / atlas[0], LOD_ATLAS_MAX);
+    atlas[2] = (slots + atlas[0] * atlas[1] - 1) / (atlas[0] * atlas[1]);
+    slotBlock.assign(slots, -1);
+    slotUse.assign(slots, -1);
+    int blockCount = field.blocks[0] * field.blocks[1] * field.blocks[2];
+    blockSlot.assign(blockCount, 0);
+    blockIndirection.assign((size_t)blockCount * 4, 0);
+    indirectionDirty = true;
+    frame = 0;
+    wanted = 0;
+}
+
+void ProbeLodSelector::setIndirection(int block, int slot) {
+    blockSlot[block] = slot;
+    unsigned char* entry = &blockIndirection[(size_t)block * 4];
+    entry[0] = (unsigned char)(slot % atlas[0]);
+    entry[1] = (unsigned char)(slot / atlas[0] % atlas[1]);
+    entry[2] = (unsigned char)(slot / (atlas[0] * atlas[1]));
+    indirectionDirty = true;
+}
+
+void ProbeLodSelector::update(const float cameraPos[3], int maxUploads, std::vector<LodUpload>& uploads) {
+    uploads.clear();
+    indirectionDirty = frame == 0;
+    ++frame;
+
+    // Blocks whose nearest point is within reach, nearest first.
+    const ProbeLodField& field = *lodField;
+    float reach = farDist + keepMargin;
+    float size[3];
+    int lo[3], hi[3];
+    for (int i = 0; i < 3; ++i) {
+        size[i] = (field.boundsMax[i] - field.boundsMin[i]) / field.blocks[i];
+        lo[i] = std::max(0, (int)floorf((cameraPos[i] - reach - field.boundsMin[i]) / size[i]));
+        hi[i] = std::min(field.blocks[i] - 1, (int)floorf((cameraPos[i] + reach - field.boundsMin[i]) / size[i]));
+    }
+    std::vector<std::pair<float, int>> inReach;
+    int index[3];
+    for (index[2] = lo[2]; index[2] <= hi[2]; ++index[2]) {
+        for (index[1] = lo[1]; index[1] <= hi[1]; ++index[1]) {
+            for (index[0] = lo[0]; index[0] <= hi[0]; ++index[0]) {
+                float d2 = 0.0f;
+                for (int i = 0; i < 3; ++i) {
+                    float a = field.boundsMin[i] + size[i] * index[i];
+                    float d = cameraPos[i] < a ? a - cameraPos[i] : (cameraPos[i] > a + size[i] ? cameraPos[i] - a - size[i] : 0.0f);
+                    d2 += d * d;
+                }
+                if (d2 <= reach * reach)
+                    inReach.push_back(std::make_pair(d2, (index[2] * field.blocks[1] + index[1]) * field.blocks[0] + index[0]));
+            }
+        }
+    }
+    std::sort(inReach.begin(), inReach.end());
+    wanted = (int)inReach.size();
+
+    // Claim the slots of resident blocks first so a nearer block never evicts a
+    // farther one that is still wanted.
+    for (size_t w = 0; w < inReach.size(); ++w) {
+        int slot = blockSlot[inReach[w].second];
+        if (slot > 0) slotUse[slot] = frame;
+    }
+    for (size_t w = 0; w < inReach.size() && (int)uploads.size() < maxUploads; ++w) {
+        int block = inReach[w].second;
+        if (blockSlot[block] > 0) continue;
+        int victim = -1;
+        for (int s = 1; s < (int)slotBlock.size(); ++s)
+            if (slotUse[s] < frame && (victim < 0 || slotUse[s] < slotUse[victim])) victim = s;
+        if (victim < 0) break;
+        if (slotBlock[victim] >= 0) setIndirection(slotBlock[victim], 0);
+        slotBlock[victim] = block;
+        slotUse[victim] = frame;
+        setIndirection(block, victim);
+        LodUpload upload = { block, victim };
+        uploads.push_back(upload);
+    }
+}
+
+ProbeLodStats ProbeLodSelector::stats() const {
+    const ProbeLodField& field = *lodField;
+    int dim[3];
+    lodFieldDim(field, dim);
+    size_t probes = (size_t)dim[0] * dim[1] * dim[2];
+    size_t k2Bytes = volumeTexelBytes(VOLUME_ZH3_HALF, 3);
+    size_t blockBytes = (size_t)LOD_BLOCK_PROBES * LOD_BLOCK_PROBES * LOD_BLOCK_PROBES * k2Bytes;
+    ProbeLodStats s;
+    s.fullBlocks = 0;
+    for (size_t b = 0; b < blockSlot.size(); ++b) s.fullBlocks += blockSlot[b] > 0;
+    s.wantedBlocks = wanted;
+    s.fullBytes = volumeBytes(dim, VOLUME_ZH3_HALF);
+    s.residentBytes = s.fullBytes - probes * k2Bytes + s.fullBlocks * blockBytes;
+    return s;
+}
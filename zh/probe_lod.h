@@ -0,0 +1,73 @@
+// probe_lod.h
+#pragma once
+#include <vector>
+#include "probe_volume.h"
+
+#define LOD_BLOCK_PROBES 8     // probes along each edge of a K2 block
+#define LOD_ATLAS_MAX 32       // blocks along each atlas axis: 256 texels, the GL 3.3 minimum
+
+// Probe field stored in two levels of detail. Every probe keeps L0 and L1 as the
+// first three textures of VOLUME_ZH3_HALF, which is all hallucinated ZH3 needs; the
+// K2 texture, the fourth, is only resident for blocks near the camera. Like bricks,
+// blocks share their boundary probes, so the field has 7 * blocks + 1 probes per
+// axis and filtering inside a block of the K2 atlas never reads another block.
+struct ProbeLodField {
+    int blocks[3];
+    float boundsMin[3];   // position of probe (0, 0, 0)
+    float boundsMax[3];   // position of probe 7 * blocks
+    std::vector<unsigned char> records;  // VOLUME_ZH3_HALF records of every probe, x fastest
+};
+
+void lodFieldDim(const ProbeLodField& field, int dim[3]);
+// Project every probe from source and encode it.
+void bakeLodField(const int blocks[3], const float boundsMin[3], const float boundsMax[3], const ProbeSource& source,
+    ProbeLodField& field);
+// Copy the K2 texels of a block, LOD_BLOCK_PROBES^3 of volumeTexelBytes(VOLUME_ZH3_HALF, 3), into dst.
+void lodBlockK2Texels(const ProbeLodField& field, int block, unsigned char* dst);
+
+// A block whose K2 goes to its atlas slot this frame.
+struct LodUpload {
+    int block;
+    int slot;
+};
+
+struct ProbeLodStats {
+    int fullBlocks;       // blocks with K2 resident
+    int wantedBlocks;     // blocks within the transition band's far edge plus margin
+    size_t residentBytes; // L0 and L1 of every probe plus resident K2 blocks
+    size_t fullBytes;     // the whole field as full ZH3
+};
+
+// Chooses each frame which blocks keep full ZH3. The shader blends stored K2 into
+// hallucinated K2 over a band of distances from the camera ending at farDistance, so
+// a block is needed in full while any of it is closer than that. margin loads blocks
+// before they enter that range and keeps them after, so residency changes only where
+// the hallucinated form is already shown alone. Blocks are granted slots nearest
+// first, at most maxUploads a frame; atlas slot 0 is never handed out and marks
+// blocks the shader treats as far.
+class ProbeLodSelector {
+public:
+    void init(const ProbeLodField& field, int atlasSlots, float farDistance, float margin);
+    void update(const float cameraPos[3], int maxUploads, std::vector<LodUpload>& uploads);
+
+    const int* atlasBlocks() const { return atlas; }
+    // RGBA8UI atlas slot of every block, x fastest, and whether update changed it.
+    const std::vector<unsigned char>& indirection() const { return blockIndirection; }
+    bool indirectionChanged() const { return indirectionDirty; }
+    ProbeLodStats stats() const;
+
+private:
+    void setIndirection(int block, int slot);
+
+    const ProbeLodField* lodField = nullptr;
+    float farDist = 0.0f;
+    float keepMargin = 0.0f;
+    int atlas[3] = { 0, 0, 0 };
+    long long frame = 0;
+    int wanted = 0;
+    std::vector<int> slotBlock;
+    std::vector<long long> slotUse;
+    std::vector<int> blockSlot;
+    std::vector<unsigned char> blockIndirection;
+    bool indirectionDirty = false;
+};
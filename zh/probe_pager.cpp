@@ -0,0 +1,276 @@
+#include "probe_pager.h"
+#include "parallel_for.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <fstream>
+
+static const char pageMagic[4] = { 'P', 'R', 'P', 'G' };
+#define PAGE_HEADER_BYTES 64
+
+size_t probePageBytes(VolumeFormat format) {
+    return (size_t)PAGE_PROBES * PAGE_PROBES * PAGE_PROBES
+        * probeEncodedBytes(volumeFormatStorage(format), volumeFormatEncoding(format));
+}
+
+bool writeProbePages(const char* path, const ProbePageLayout& layout, const ProbeSource& source) {
+    std::ofstream file(path, std::ios::binary);
+    if (!file) return false;
+    unsigned char header[PAGE_HEADER_BYTES] = { 0 };
+    int fields[5] = { layout.pages[0], layout.pages[1], layout.pages[2], (int)layout.format, PAGE_PROBES };
+    memcpy(header, pageMagic, 4);
+    memcpy(header + 4, fields, sizeof(fields));
+    memcpy(header + 24, layout.boundsMin, 12);
+    memcpy(header + 36, layout.boundsMax, 12);
+    file.write((const char*)header, PAGE_HEADER_BYTES);
+
+    ProbeStorage storage = volumeFormatStorage(layout.format);
+    ProbeEncoding encoding = volumeFormatEncoding(layout.format);
+    int floats = probeStorageFloats(storage);
+    int recordBytes = probeEncodedBytes(storage, encoding);
+    const int span = PAGE_PROBES - 1;
+    std::vector<unsigned char> records(probePageBytes(layout.format));
+    for (int pz = 0; pz < layout.pages[2]; ++pz) {
+        for (int py = 0; py < layout.pages[1]; ++py) {
+            for (int px = 0; px < layout.pages[0]; ++px) {
+                int page[3] = { px, py, pz };
+                parallelFor(PAGE_PROBES * PAGE_PROBES, 16, [&](int begin, int end) {
+                    std::vector<float> packed((size_t)PAGE_PROBES * floats);
+                    for (int row = begin; row < end; ++row) {
+                        int local[3] = { 0, row % PAGE_PROBES, row / PAGE_PROBES };
+                        for (local[0] = 0; local[0] < PAGE_PROBES; ++local[0]) {
+                            float pos[3], sh[9][3];
+                            for (int i = 0; i < 3; ++i) {
+                                float t = (float)(page[i] * span + local[i]) / (layout.pages[i] * span);
+                                pos[i] = layout.boundsMin[i] + (layout.boundsMax[i] - layout.boundsMin[i]) * t;
+                            }
+                            source(pos, sh);
+                            packProbe(storage, sh, &packed[(size_t)local[0] * floats]);
+                        }
+                        encodeProbes(storage, encoding, &packed[0], PAGE_PROBES,
+                            &records[(size_t)row * PAGE_PROBES * recordBytes]);
+                    }
+                });
+                file.write((const char*)&records[0], records.size());
+            }
+        }
+    }
+    return (bool)file;
+}
+
+ProbePager::~ProbePager() {
+    close();
+}
+
+bool ProbePager::open(const char* filePath, int cpuPageCount, int gpuSlots, float prefetchRadius, float lookaheadSeconds) {
+    close();
+    std::ifstream file(filePath, std::ios::binary);
+    unsigned char header[PAGE_HEADER_BYTES];
+    if (!file.read((char*)header, PAGE_HEADER_BYTES) || memcmp(header, pageMagic, 4) != 0) {
+        printf("Failed to open probe pages %s\n", filePath);
+        return false;
+    }
+    int fields[5];
+    memcpy(fields, header + 4, sizeof(fields));
+    if (fields[3] < 0 || fields[3] >= VOLUME_FORMAT_COUNT || fields[4] != PAGE_PROBES) {
+        printf("Unsupported probe pages %s\n", filePath);
+        return false;
+    }
+    for (int i = 0; i < 3; ++i) pageLayout.pages[i] = fields[i];
+    pageLayout.format = (VolumeFormat)fields[3];
+    memcpy(pageLayout.boundsMin, header + 24, 12);
+    memcpy(pageLayout.boundsMax, header + 36, 12);
+
+    path = filePath;
+    headerBytes = PAGE_HEADER_BYTES;
+    pageBytes = probePageBytes(pageLayout.format);
+    cpuCapacity = cpuPageCount;
+    radius = prefetchRadius;
+    lookahead = lookaheadSeconds;
+
+    // Slot 0 is the caller's fallback page; the rest are handed out least recently used first.
+    int slots = std::min(gpuSlots + 1, PAGE_ATLAS_MAX * PAGE_ATLAS_MAX * PAGE_ATLAS_MAX);
+    atlas[0] = std::min(slots, PAGE_ATLAS_MAX);
+    atlas[1] = std::min((slots + atlas[0] - 1) / atlas[0], PAGE_ATLAS_MAX);
+    atlas[2] = (slots + atlas[0] * atlas[1] - 1) / (atlas[0] * atlas[1]);
+    slotPage.assign(slots, -1);
+    slotUse.assign(slots, -1);
+    pageSlot.clear();
+    cpuPages.clear();
+    pageIndirection.assign((size_t)pageLayout.pages[0] * pageLayout.pages[1] * pageLayout.pages[2] * 4, 0);
+    indirectionDirty = true;
+    frame = 0;
+    uploadCount = 0;
+
+    quit = false;
+    loadCount = 0;
+    loadedBytes = 0;
+    loader = std::thread(&ProbePager::loaderMain, this);
+    return true;
+}
+
+void ProbePager::close() {
+    if (!loader.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+        requests.clear();
+    }
+    wake.notify_all();
+    loader.join();
+    completed.clear();
+    loading.clear();
+}
+
+void ProbePager::loaderMain() {
+    std::ifstream file(path, std::ios::binary);
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        wake.wait(lock, [&]() { return quit || !requests.empty(); });
+        if (quit) return;
+        int page = requests.front();
+        requests.pop_front();
+        loading.insert(page);
+        lock.unlock();
+
+        std::vector<unsigned char> records(pageBytes);
+        file.seekg((std::streamoff)(headerBytes + (size_t)page * pageBytes));
+        bool ok = (bool)file.read((char*)&records[0], pageBytes);
+        file.clear();
+
+        lock.lock();
+        loading.erase(page);
+        if (ok) {
+            completed.push_back(std::make_pair(page, std::move(records)));
+            loadCount++;
+            loadedBytes += pageBytes;
+        }
+    }
+}
+
+void ProbePager::setIndirection(int page, int slot) {
+    unsigned char* entry = &pageIndirection[(size_t)page * 4];
+    entry[0] = (unsigned char)(slot % atlas[0]);
+    entry[1] = (unsigned char)(slot / atlas[0] % atlas[1]);
+    entry[2] = (unsigned char)(slot / (atlas[0] * atlas[1]));
+    indirectionDirty = true;
+}
+
+// Distance from p to the box of page index along each axis, 0 inside.
+static float pageDistance(const ProbePageLayout& layout, const int index[3], const float p[3]) {
+    float d2 = 0.0f;
+    for (int i = 0; i < 3; ++i) {
+        float size = (layout.boundsMax[i] - layout.boundsMin[i]) / layout.pages[i];
+        float lo = layout.boundsMin[i] + size * index[i];
+        float d = p[i] < lo ? lo - p[i] : (p[i] > lo + size ? p[i] - lo - size : 0.0f);
+        d2 += d * d;
+    }
+    return sqrtf(d2);
+}
+
+void ProbePager::update(const float position[3], const float velocity[3], int maxUploads,
+    std::vector<PageUpload>& uploads) {
+    uploads.clear();
+    indirectionDirty = frame == 0;
+    ++frame;
+
+    std::vector<std::pair<int, std::vector<unsigned char>>> done;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        done.swap(completed);
+    }
+    for (size_t i = 0; i < done.size(); ++i) {
+        CpuPage& page = cpuPages[done[i].first];
+        page.records.swap(done[i].second);
+        page.lastUse = frame;
+    }
+    while ((int)cpuPages.size() > cpuCapacity) {
+        auto oldest = cpuPages.begin();
+        for (auto it = cpuPages.begin(); it != cpuPages.end(); ++it)
+            if (it->second.lastUse < oldest->second.lastUse) oldest = it;
+        cpuPages.erase(oldest);
+    }
+
+    // Pages near the camera now or where its velocity takes it, nearest first.
+    float predicted[3];
+    int lo[3], hi[3];
+    for (int i = 0; i < 3; ++i) {
+        predicted[i] = position[i] + velocity[i] * lookahead;
+        float size = (pageLayout.boundsMax[i] - pageLayout.boundsMin[i]) / pageLayout.pages[i];
+        float a = (std::min(position[i], predicted[i]) - radius - pageLayout.boundsMin[i]) / size;
+        float b = (std::max(position[i], predicted[i]) + radius - pageLayout.boundsMin[i]) / size;
+        lo[i] = std::max(0, (int)floorf(a));
+        hi[i] = std::min(pageLayout.pages[i] - 1, (int)floorf(b));
+    }
+    std::vector<std::pair<float, int>> wanted;
+    int index[3];
+    for (index[2] = lo[2]; index[2] <= hi[2]; ++index[2]) {
+        for (index[1] = lo[1]; index[1] <= hi[1]; ++index[1]) {
+            for (index[0] = lo[0]; index[0] <= hi[0]; ++index[0]) {
+                float d = std::min(pageDistance(pageLayout, index, position), pageDistance(pageLayout, index, predicted));
+                if (d <= radius)
+                    wanted.push_back(std::make_pair(d, (index[2] * pageLayout.pages[1] + index[1]) * pageLayout.pages[0] + index[0]));
+            }
+        }
+    }
+    std::sort(wanted.begin(), wanted.end());
+
+    std::vector<int> loads;
+    for (size_t w = 0; w < wanted.size(); ++w) {
+        int page = wanted[w].second;
+        auto cpu = cpuPages.find(page);
+        if (cpu != cpuPages.end()) cpu->second.lastUse = frame;
+        auto gpu = pageSlot.find(page);
+        if (gpu != pageSlot.end()) {
+            slotUse[gpu->second] = frame;
+            continue;
+        }
+        if (cpu == cpuPages.end()) {
+            loads.push_back(page);
+            continue;
+        }
+        if ((int)uploads.size() >= maxUploads) continue;
+        // Replace the least recently used slot that no nearer page claimed this frame.
+        int victim = -1;
+        for (int s = 1; s < (int)slotPage.size(); ++s)
+            if (slotUse[s] < frame && (victim < 0 || slotUse[s] < slotUse[victim])) victim = s;
+        if (victim < 0) continue;
+        if (slotPage[victim] >= 0) {
+            pageSlot.erase(slotPage[victim]);
+            setIndirection(slotPage[victim], 0);
+        }
+        slotPage[victim] = page;
+        slotUse[victim] = frame;
+        pageSlot[page] = victim;
+        setIndirection(page, victim);
+        PageUpload upload = { page, victim, &cpu->second.records[0] };
+        uploads.push_back(upload);
+    }
+    uploadCount += uploads.size();
+
+    // Replace the loader's queue so it always works on what is nearest now.
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        requests.clear();
+        for (size_t i = 0; i < loads.size(); ++i) {
+            bool arrived = false;
+            for (size_t c = 0; c < completed.size() && !arrived; ++c)
+                arrived = completed[c].first == loads[i];
+            if (!arrived && !loading.count(loads[i])) requests.push_back(loads[i]);
+        }
+    }
+    wake.notify_one();
+}
+
+ProbePagerStats ProbePager::stats() {
+    ProbePagerStats s;
+    s.cpuResident = (int)cpuPages.size();
+    s.gpuResident = (int)pageSlot.size();
+    s.uploads = uploadCount;
+    std::lock_guard<std::mutex> lock(mutex);
+    s.pending = (int)(requests.size() + loading.size());
+    s.loads = loadCount;
+    s.bytesLoaded = loadedBytes;
+    return s;
+}
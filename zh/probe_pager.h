@@ -0,0 +1,104 @@
+// probe_pager.h
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "probe_volume.h"
+
+#define PAGE_PROBES 16          // probes along each edge of a page
+#define PAGE_ATLAS_MAX 16       // pages along each atlas axis: 256 texels, the GL 3.3 minimum
+
+// A probe world on disk: pages[0] x pages[1] x pages[2] pages of 16^3 probes. Like the
+// bricks of probe_brick_map.h, neighbouring pages share their boundary probes, so a
+// page spans 15 probe spacings and is filtered on its own in the atlas. Pages are
+// stored back to back after a small header as encoded records of format.
+struct ProbePageLayout {
+    int pages[3];
+    float boundsMin[3];   // position of probe (0, 0, 0)
+    float boundsMax[3];   // position of probe 15 * pages
+    VolumeFormat format;
+};
+
+size_t probePageBytes(VolumeFormat format);
+// Bake every page from source, page by page, and write the file; false on I/O failure.
+bool writeProbePages(const char* path, const ProbePageLayout& layout, const ProbeSource& source);
+
+// A page ready for its atlas slot; records stay valid until the next update.
+struct PageUpload {
+    int page;
+    int slot;
+    const unsigned char* records;
+};
+
+struct ProbePagerStats {
+    int cpuResident;
+    int gpuResident;
+    int pending;
+    long long loads;
+    long long uploads;
+    long long bytesLoaded;
+};
+
+// Streams pages around the camera. A background thread reads pages nearest the camera
+// and its predicted position first into an LRU set of cpuPages pages in memory; each
+// update hands at most maxUploads of them to the caller for an LRU set of gpuSlots
+// atlas slots and rewrites the indirection, without ever waiting on the loader.
+// Slot 0 of the atlas is left to the caller for a fallback page, and pages that are
+// not resident point at it.
+class ProbePager {
+public:
+    ~ProbePager();
+    // prefetchRadius is in world units; velocity is extrapolated lookahead seconds.
+    bool open(const char* path, int cpuPages, int gpuSlots, float prefetchRadius, float lookahead);
+    void close();
+    void update(const float position[3], const float velocity[3], int maxUploads, std::vector<PageUpload>& uploads);
+
+    const ProbePageLayout& layout() const { return pageLayout; }
+    const int* atlasPages() const { return atlas; }
+    // RGBA8UI atlas slot of every page, x fastest, and whether update changed it.
+    const std::vector<unsigned char>& indirection() const { return pageIndirection; }
+    bool indirectionChanged() const { return indirectionDirty; }
+    ProbePagerStats stats();
+
+private:
+    struct CpuPage {
+        std::vector<unsigned char> records;
+        long long lastUse;
+    };
+    void loaderMain();
+    void setIndirection(int page, int slot);
+
+    ProbePageLayout pageLayout;
+    std::string path;
+    size_t headerBytes = 0;
+    size_t pageBytes = 0;
+    int cpuCapacity = 0;
+    float radius = 0.0f;
+    float lookahead = 0.0f;
+    int atlas[3] = { 0, 0, 0 };
+    long long frame = 0;
+
+    std::unordered_map<int, CpuPage> cpuPages;
+    std::vector<int> slotPage;
+    std::vector<long long> slotUse;
+    std::unordered_map<int, int> pageSlot;
+    std::vector<unsigned char> pageIndirection;
+    bool indirectionDirty = false;
+    long long uploadCount = 0;
+
+    // Shared with the loader thread.
+    std::thread loader;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<int> requests;
+    std::unordered_set<int> loading;
+    std::vector<std::pair<int, std::vector<unsigned char>>> completed;
+    bool quit = false;
+    long long loadCount = 0;
+    long long loadedBytes = 0;
+};
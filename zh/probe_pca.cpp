@@ -0,0 +1,188 @@
+#include "probe_pca.h"
+#include "error_metrics.h"
+#include "parallel_for.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+
+static float probeScale(const float* probe) {
+    float lum = 0.2126f * probe[0] + 0.7152f * probe[1] + 0.0722f * probe[2];
+    return lum > 1e-8f ? lum : 1e-8f;
+}
+
+// Cyclic Jacobi rotations on a symmetric n x n matrix; a ends up diagonal and the
+// columns of v hold the eigenvectors.
+static void jacobiEigen(double* a, double* v, int n) {
+    for (int i = 0; i < n; ++i)
+        for (int j = 0; j < n; ++j)
+            v[i * n + j] = i == j ? 1.0 : 0.0;
+    for (int sweep = 0; sweep < 64; ++sweep) {
+        double off = 0.0;
+        for (int i = 0; i < n; ++i)
+            for (int j = i + 1; j < n; ++j)
+                off += a[i * n + j] * a[i * n + j];
+        if (off < 1e-30) break;
+        for (int p = 0; p < n; ++p) {
+            for (int q = p + 1; q < n; ++q) {
+                double apq = a[p * n + q];
+                if (fabs(apq) < 1e-300) continue;
+                double theta = (a[q * n + q] - a[p * n + p]) / (2.0 * apq);
+                double t = (theta >= 0.0 ? 1.0 : -1.0) / (fabs(theta) + sqrt(theta * theta + 1.0));
+                double c = 1.0 / sqrt(t * t + 1.0);
+                double s = t * c;
+                for (int k = 0; k < n; ++k) {
+                    double akp = a[k * n + p], akq = a[k * n + q];
+                    a[k * n + p] = c * akp - s * akq;
+                    a[k * n + q] = s * akp + c * akq;
+                }
+                for (int k = 0; k < n; ++k) {
+                    double apk = a[p * n + k], aqk = a[q * n + k];
+                    a[p * n + k] = c * apk - s * aqk;
+                    a[q * n + k] = s * apk + c * aqk;
+                }
+                for (int k = 0; k < n; ++k) {
+                    double vkp = v[k * n + p], vkq = v[k * n + q];
+                    v[k * n + p] = c * vkp - s * vkq;
+                    v[k * n + q] = s * vkp + c * vkq;
+                }
+            }
+        }
+    }
+}
+
+void buildProbePCA(const float* probes, int count, int components, ProbePCA& pca) {
+    if (components > PCA_MAX_COMPONENTS) components = PCA_MAX_COMPONENTS;
+    if (components > 27) components = 27;
+    pca.components = components;
+
+    double mean[27] = { 0.0 };
+    for (int p = 0; p < count; ++p) {
+        const float* x = probes + (size_t)p * 27;
+        float s = probeScale(x);
+        for (int i = 0; i < 27; ++i) mean[i] += x[i] / s;
+    }
+    for (int i = 0; i < 27; ++i) {
+        mean[i] /= count > 0 ? count : 1;
+        pca.mean[i] = (float)mean[i];
+    }
+
+    double cov[27 * 27];
+    memset(cov, 0, sizeof(cov));
+    for (int p = 0; p < count; ++p) {
+        const float* x = probes + (size_t)p * 27;
+        float s = probeScale(x);
+        double d[27];
+        for (int i = 0; i < 27; ++i) d[i] = x[i] / s - mean[i];
+        for (int i = 0; i < 27; ++i)
+            for (int j = i; j < 27; ++j)
+                cov[i * 27 + j] += d[i] * d[j];
+    }
+    for (int i = 0; i < 27; ++i)
+        for (int j = 0; j < i; ++j)
+            cov[i * 27 + j] = cov[j * 27 + i];
+
+    double vectors[27 * 27];
+    jacobiEigen(cov, vectors, 27);
+
+    int order[27];
+    for (int i = 0; i < 27; ++i) order[i] = i;
+    for (int i = 0; i < 27; ++i)
+        for (int j = i + 1; j < 27; ++j)
+            if (cov[order[j] * 27 + order[j]] > cov[order[i] * 27 + order[i]]) {
+                int t = order[i];
+                order[i] = order[j];
+                order[j] = t;
+            }
+
+    pca.basis.assign((size_t)components * 27, 0.0f);
+    pca.variance.assign(components, 0.0f);
+    for (int c = 0; c < components; ++c) {
+        int e = order[c];
+        pca.variance[c] = (float)(cov[e * 27 + e] / (count > 0 ? count : 1));
+        for (int i = 0; i < 27; ++i)
+            pca.basis[(size_t)c * 27 + i] = (float)vectors[i * 27 + e];
+    }
+}
+
+void encodeProbePCA(const ProbePCA& pca, const float* probes, int count, float* weights) {
+    int stride = pca.components + 1;
+    parallelFor(count, 1024, [&](int begin, int end) {
+        for (int p = begin; p < end; ++p) {
+            const float* x = probes + (size_t)p * 27;
+            float* w = weights + (size_t)p * stride;
+            float s = probeScale(x);
+            w[0] = s;
+            for (int c = 0; c < pca.components; ++c) {
+                const float* b = &pca.basis[(size_t)c * 27];
+                float dot = 0.0f;
+                for (int i = 0; i < 27; ++i)
+                    dot += (x[i] / s - pca.mean[i]) * b[i];
+                w[c + 1] = dot;
+            }
+        }
+    });
+}
+
+void decodeProbePCA(const ProbePCA& pca, const float* weights, int count, float* probes) {
+    int stride = pca.components + 1;
+    parallelFor(count, 1024, [&](int begin, int end) {
+        for (int p = begin; p < end; ++p) {
+            const float* w = weights + (size_t)p * stride;
+            float x[27];
+            for (int i = 0; i < 27; ++i) x[i] = pca.mean[i];
+            for (int c = 0; c < pca.components; ++c) {
+                const float* b = &pca.basis[(size_t)c * 27];
+                float wc = w[c + 1];
+                for (int i = 0; i < 27; ++i)
+                    x[i] += wc * b[i];
+            }
+            float* out = probes + (size_t)p * 27;
+            for (int i = 0; i < 27; ++i)
+                out[i] = x[i] * w[0];
+        }
+    });
+}
+
+void reportProbePCA(const float* probes, int count, int maxComponents, const NormalSet& normals) {
+    if (count <= 0) return;
+    if (maxComponents > PCA_MAX_COMPONENTS) maxComponents = PCA_MAX_COMPONENTS;
+    printf("PCA over %d probes (%.1f KB uncompressed)\n", count, count * 27 * 4 / 1024.0);
+    printf("  %10s %10s %8s %12s %12s %12s\n", "components", "KB", "ratio", "coeff rms", "irr rms", "irr max");
+
+    std::vector<float> weights;
+    std::vector<float> decoded((size_t)count * 27);
+    std::vector<float> target((size_t)normals.count * 3);
+    static const float noK2[3] = { 0.0f, 0.0f, 0.0f };
+    for (int k = 1; k <= maxComponents; ++k) {
+        ProbePCA pca;
+        buildProbePCA(probes, count, k, pca);
+        weights.resize((size_t)count * (k + 1));
+        encodeProbePCA(pca, probes, count, &weights[0]);
+        decodeProbePCA(pca, &weights[0], count, &decoded[0]);
+
+        double coeffErr = 0.0, coeffRef = 0.0;
+        IrradianceError irr = {};
+        float irrMax = 0.0f;
+        for (int p = 0; p < count; ++p) {
+            const float* x = probes + (size_t)p * 27;
+            const float* y = &decoded[(size_t)p * 27];
+            for (int i = 0; i < 27; ++i) {
+                coeffErr += (double)(x[i] - y[i]) * (x[i] - y[i]);
+                coeffRef += (double)x[i] * x[i];
+            }
+            IrradiancePoly exact, approx;
+            buildIrradiancePoly(IRRADIANCE_SH3, (const float (*)[3])x, noK2, exact);
+            buildIrradiancePoly(IRRADIANCE_SH3, (const float (*)[3])y, noK2, approx);
+            evalIrradianceNormals(exact, normals, &target[0]);
+            IrradianceError error = {};
+            accumulateIrradianceError(approx, normals, &target[0], error);
+            irr.sumSq += error.sumSq;
+            irr.targetSq += error.targetSq;
+            irrMax = fmaxf(irrMax, errorRelativeMax(error));
+        }
+        double bytes = (double)count * (k + 1) * 4 + (k + 1) * 27 * 4;
+        printf("  %10d %10.1f %7.1fx %11.4f%% %11.4f%% %11.4f%%\n", k, bytes / 1024.0, count * 27 * 4 / bytes,
+            100.0 * sqrt(coeffErr / coeffRef), 100.0f * errorRelativeRms(irr), 100.0f * irrMax);
+    }
+}
@@ -0,0 +1,27 @@
+// probe_pca.h
+#pragma once
+#include <vector>
+#include "irradiance.h"
+
+#define PCA_MAX_COMPONENTS 8
+
+// Shared basis for a set of quadratic SH probes (27 floats each, laid out like
+// shCoeffs). Probes are normalized by their L0 luminance before the analysis so
+// bright and dim probes share the same basis; each probe is then stored as that
+// scale followed by `components` weights.
+struct ProbePCA {
+    int components = 0;
+    float mean[27];
+    std::vector<float> basis;     // components x 27, strongest first
+    std::vector<float> variance;  // per component
+};
+
+void buildProbePCA(const float* probes, int count, int components, ProbePCA& pca);
+// weights receives count records of components + 1 floats.
+void encodeProbePCA(const ProbePCA& pca, const float* probes, int count, float* weights);
+// Decode count records in one streaming pass, chunks spread over all cores.
+void decodeProbePCA(const ProbePCA& pca, const float* weights, int count, float* probes);
+
+// Print compressed size and coefficient/irradiance error against the input probes
+// for every component count up to maxComponents, irradiance measured at normals.
+void reportProbePCA(const float* probes, int count, int maxComponents, const NormalSet& normals);
@@ -0,0 +1,248 @@
+#include "probe_quantize.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#if defined(__F16C__) || defined(__AVX2__)
+#include <immintrin.h>
+#define PROBE_QUANTIZE_F16C
+#endif
+
+// Largest |coefficient / L0| of a single directional light after cosine convolution:
+// L1 is 2/3 * sqrt(3), every L2 term (and K2) at most 1/4 * sqrt(5).
+#define RATIO_RANGE_L1 1.2f
+#define RATIO_RANGE_L2 0.6f
+
+#define RGB9E5_BIAS 15
+#define RGB9E5_MANTISSA 9
+#define RGB9E5_MAX 65408.0f
+
+
+const char* probeEncodingName(ProbeEncoding encoding) {
+    switch (encoding) {
+    case PROBE_ENCODING_FLOAT: return "float";
+    case PROBE_ENCODING_HALF: return "half";
+    case PROBE_ENCODING_RATIO16: return "rgb9e5 + ratio16";
+    case PROBE_ENCODING_RATIO8: return "rgb9e5 + ratio8";
+    }
+    return "?";
+}
+
+int probeEncodedBytes(ProbeStorage storage, ProbeEncoding encoding) {
+    int floats = probeStorageFloats(storage);
+    int bytes = 0;
+    switch (encoding) {
+    case PROBE_ENCODING_FLOAT: bytes = floats * 4; break;
+    case PROBE_ENCODING_HALF: bytes = floats * 2; break;
+    case PROBE_ENCODING_RATIO16: bytes = 4 + (floats - 3) * 2; break;
+    case PROBE_ENCODING_RATIO8: bytes = 4 + (floats - 3); break;
+    }
+    return (bytes + 3) & ~3;
+}
+
+unsigned int encodeRGB9E5(const float rgb[3]) {
+    float c[3];
+    for (int i = 0; i < 3; ++i) {
+        float v = rgb[i] > 0.0f ? rgb[i] : 0.0f;
+        c[i] = v < RGB9E5_MAX ? v : RGB9E5_MAX;
+    }
+    float maxc = c[0] > c[1] ? c[0] : c[1];
+    maxc = maxc > c[2] ? maxc : c[2];
+    int exponent = maxc > 0.0f ? (int)floorf(log2f(maxc)) : -RGB9E5_BIAS - 1;
+    if (exponent < -RGB9E5_BIAS - 1) exponent = -RGB9E5_BIAS - 1;
+    exponent += 1 + RGB9E5_BIAS;
+    float scale = ldexpf(1.0f, exponent - RGB9E5_BIAS - RGB9E5_MANTISSA);
+    if ((int)floorf(maxc / scale + 0.5f) == (1 << RGB9E5_MANTISSA)) {
+        exponent += 1;
+        scale *= 2.0f;
+    }
+    unsigned int m[3];
+    for (int i = 0; i < 3; ++i) {
+        int v = (int)floorf(c[i] / scale + 0.5f);
+        m[i] = (unsigned int)(v > 511 ? 511 : v);
+    }
+    return m[0] | (m[1] << 9) | (m[2] << 18) | ((unsigned int)exponent << 27);
+}
+
+void decodeRGB9E5(unsigned int packed, float rgb[3]) {
+    float scale = ldexpf(1.0f, (int)(packed >> 27) - RGB9E5_BIAS - RGB9E5_MANTISSA);
+    rgb[0] = (float)(packed & 511u) * scale;
+    rgb[1] = (float)((packed >> 9) & 511u) * scale;
+    rgb[2] = (float)((packed >> 18) & 511u) * scale;
+}
+
+unsigned short floatToHalf(float value) {
+    unsigned int bits;
+    memcpy(&bits, &value, 4);
+    unsigned int sign = (bits >> 16) & 0x8000u;
+    int exponent = (int)((bits >> 23) & 0xffu) - 127 + 15;
+    unsigned int mantissa = bits & 0x7fffffu;
+    if (exponent >= 31) return (unsigned short)(sign | 0x7c00u);
+    if (exponent <= 0) {
+        if (exponent < -10) return (unsigned short)sign;
+        mantissa |= 0x800000u;
+        unsigned int shift = (unsigned int)(14 - exponent);
+        unsigned int half = mantissa >> shift;
+        if ((mantissa >> (shift - 1)) & 1u) half += 1;
+        return (unsigned short)(sign | half);
+    }
+    unsigned int half = sign | ((unsigned int)exponent << 10) | (mantissa >> 13);
+    if (mantissa & 0x1000u) half += 1;
+    return (unsigned short)half;
+}
+
+float halfToFloat(unsigned short value) {
+    unsigned int sign = (unsigned int)(value & 0x8000u) << 16;
+    int exponent = (value >> 10) & 0x1f;
+    unsigned int mantissa = value & 0x3ffu;
+    unsigned int bits;
+    if (exponent == 0) {
+        float f = ldexpf((float)mantissa, -24);
+        return sign ? -f : f;
+    }
+    if (exponent == 31)
+        bits = sign | 0x7f800000u | (mantissa << 13);
+    else
+        bits = sign | ((unsigned int)(exponent - 15 + 127) << 23) | (mantissa << 13);
+    float f;
+    memcpy(&f, &bits, 4);
+    return f;
+}
+
+static void halfEncodeRow(const float* src, int count, unsigned short* dst) {
+    int i = 0;
+#ifdef PROBE_QUANTIZE_F16C
+    for (; i + 8 <= count; i += 8)
+        _mm_storeu_si128((__m128i*)(dst + i), _mm256_cvtps_ph(_mm256_loadu_ps(src + i), 0));
+#endif
+    for (; i < count; ++i)
+        dst[i] = floatToHalf(src[i]);
+}
+
+static void halfDecodeRow(const unsigned short* src, int count, float* dst) {
+    int i = 0;
+#ifdef PROBE_QUANTIZE_F16C
+    for (; i + 8 <= count; i += 8)
+        _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(src + i))));
+#endif
+    for (; i < count; ++i)
+        dst[i] = halfToFloat(src[i]);
+}
+
+// Range of component k of a stored probe; components 0..2 are L0.
+static float ratioRange(int k) {
+    return k / 3 <= 3 ? RATIO_RANGE_L1 : RATIO_RANGE_L2;
+}
+
+void encodeProbes(ProbeStorage storage, ProbeEncoding encoding, const float* probes, int count, unsigned char* dst) {
+    int floats = probeStorageFloats(storage);
+    int stride = probeEncodedBytes(storage, encoding);
+    memset(dst, 0, (size_t)stride * count);
+
+    if (encoding == PROBE_ENCODING_FLOAT) {
+        for (int p = 0; p < count; ++p)
+            memcpy(dst + (size_t)p * stride, probes + (size_t)p * floats, floats * sizeof(float));
+        return;
+    }
+    if (encoding == PROBE_ENCODING_HALF) {
+        for (int p = 0; p < count; ++p)
+            halfEncodeRow(probes + (size_t)p * floats, floats, (unsigned short*)(dst + (size_t)p * stride));
+        return;
+    }
+
+    int levels = encoding == PROBE_ENCODING_RATIO8 ? 127 : 32767;
+    for (int p = 0; p < count; ++p) {
+        const float* src = probes + (size_t)p * floats;
+        unsigned char* out = dst + (size_t)p * stride;
+        unsigned int l0Packed = encodeRGB9E5(src);
+        memcpy(out, &l0Packed, 4);
+        // Normalize by the decoded L0 so the ratio absorbs the RGB9E5 rounding.
+        float l0[3];
+        decodeRGB9E5(l0Packed, l0);
+        for (int k = 3; k < floats; ++k) {
+            float base = l0[k % 3];
+            float ratio = base > 0.0f ? src[k] / (base * ratioRange(k)) : 0.0f;
+            ratio = ratio < -1.0f ? -1.0f : (ratio > 1.0f ? 1.0f : ratio);
+            int q = (int)floorf(ratio * levels + 0.5f);
+            if (encoding == PROBE_ENCODING_RATIO8)
+                ((signed char*)(out + 4))[k - 3] = (signed char)q;
+            else {
+                short s = (short)q;
+                memcpy(out + 4 + (k - 3) * 2, &s, 2);
+            }
+        }
+    }
+}
+
+void decodeProbes(ProbeStorage storage, ProbeEncoding encoding, const unsigned char* src, int count, float* probes) {
+    int floats = probeStorageFloats(storage);
+    int stride = probeEncodedBytes(storage, encoding);
+
+    if (encoding == PROBE_ENCODING_FLOAT) {
+        for (int p = 0; p < count; ++p)
+            memcpy(probes + (size_t)p * floats, src + (size_t)p * stride, floats * sizeof(float));
+        return;
+    }
+    if (encoding == PROBE_ENCODING_HALF) {
+        for (int p = 0; p < count; ++p)
+            halfDecodeRow((const unsigned short*)(src + (size_t)p * stride), floats, probes + (size_t)p * floats);
+        return;
+    }
+
+    // Per-component scale, so the inner loop is a branch-free widen and multiply.
+    float scale[27];
+    int levels = encoding == PROBE_ENCODING_RATIO8 ? 127 : 32767;
+    for (int k = 3; k < floats; ++k)
+        scale[k] = ratioRange(k) / levels;
+
+    for (int p = 0; p < count; ++p) {
+        const unsigned char* in = src + (size_t)p * stride;
+        float* out = probes + (size_t)p * floats;
+        unsigned int l0Packed;
+        memcpy(&l0Packed, in, 4);
+        decodeRGB9E5(l0Packed, out);
+        float base[27];
+        for (int k = 3; k < floats; ++k)
+            base[k] = out[k % 3] * scale[k];
+        if (encoding == PROBE_ENCODING_RATIO8) {
+            const signed char* q = (const signed char*)(in + 4);
+            for (int k = 3; k < floats; ++k)
+                out[k] = (float)q[k - 3] * base[k];
+        }
+        else {
+            short q[24];
+            memcpy(q, in + 4, (floats - 3) * sizeof(short));
+            for (int k = 3; k < floats; ++k)
+                out[k] = (float)q[k - 3] * base[k];
+        }
+    }
+}
+
+void reportProbeEncodings(const char* name, const float sh[9][3], const NormalSet& normals) {
+    std::vector<float> target((size_t)normals.count * 3);
+    printf("%s\n", name);
+    printf("  %-17s %-17s %6s %8s %10s %10s\n", "storage", "encoding", "bytes", "saving", "rms", "max");
+    for (int s = 0; s < PROBE_STORAGE_COUNT; ++s) {
+        ProbeStorage storage = (ProbeStorage)s;
+        float packed[27];
+        packProbe(storage, sh, packed);
+        IrradiancePoly exact;
+        unpackProbe(storage, packed, exact);
+        evalIrradianceNormals(exact, normals, &target[0]);
+        for (int e = 0; e < PROBE_ENCODING_COUNT; ++e) {
+            ProbeEncoding encoding = (ProbeEncoding)e;
+            unsigned char encoded[108];
+            float decoded[27];
+            encodeProbes(storage, encoding, packed, 1, encoded);
+            decodeProbes(storage, encoding, encoded, 1, decoded);
+            IrradiancePoly poly;
+            unpackProbe(storage, decoded, poly);
+
+            IrradianceError error = {};
+            accumulateIrradianceError(poly, normals, &target[0], error);
+            int bytes = probeEncodedBytes(storage, encoding);
+            printf("  %-17s %-17s %6d %7.2fx %9.4f%% %9.4f%%\n", probeStorageName(storage), probeEncodingName(encoding),
+                bytes, (float)probeEncodedBytes(storage, PROBE_ENCODING_FLOAT) / bytes,
+                100.0f * errorRelativeRms(error), 100.0f * errorRelativeMax(error));
+        }
+    }
+}
@@ -0,0 +1,31 @@
+// probe_quantize.h
+#pragma once
+#include "probe_storage.h"
+
+// Encodings of a stored probe (see probe_storage.h). The ratio encodings keep L0 as
+// shared-exponent RGB9E5 and every other coefficient as a signed fraction of its
+// channel's L0, the ratio used by ZH3Hallucinate_EvalIrradianceLumAxis in st.cpp.
+enum ProbeEncoding {
+    PROBE_ENCODING_FLOAT,
+    PROBE_ENCODING_HALF,
+    PROBE_ENCODING_RATIO16,
+    PROBE_ENCODING_RATIO8
+};
+
+#define PROBE_ENCODING_COUNT 4
+
+const char* probeEncodingName(ProbeEncoding encoding);
+// Bytes per encoded probe, padded to a multiple of 4 so records can be read as uints.
+int probeEncodedBytes(ProbeStorage storage, ProbeEncoding encoding);
+
+// probes holds count records of probeStorageFloats(storage) floats each.
+void encodeProbes(ProbeStorage storage, ProbeEncoding encoding, const float* probes, int count, unsigned char* dst);
+void decodeProbes(ProbeStorage storage, ProbeEncoding encoding, const unsigned char* src, int count, float* probes);
+
+unsigned int encodeRGB9E5(const float rgb[3]);
+void decodeRGB9E5(unsigned int packed, float rgb[3]);
+unsigned short floatToHalf(float value);
+float halfToFloat(unsigned short value);
+
+// Print memory and reconstruction error of every encoding of every storage mode.
+void reportProbeEncodings(const char* name, const float sh[9][3], const NormalSet& normals);
@@ -0,0 +1,83 @@
+#include "probe_storage.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+int probeStorageFloats(ProbeStorage storage) {
+    switch (storage) {
+    case PROBE_STORAGE_SH3: return 27;
+    case PROBE_STORAGE_ZH3: return 15;
+    case PROBE_STORAGE_ZH3_HALLUCINATED: return 12;
+    }
+    return 0;
+}
+
+const char* probeStorageName(ProbeStorage storage) {
+    switch (storage) {
+    case PROBE_STORAGE_SH3: return "SH3";
+    case PROBE_STORAGE_ZH3: return "ZH3";
+    case PROBE_STORAGE_ZH3_HALLUCINATED: return "ZH3 hallucinated";
+    }
+    return "?";
+}
+
+void packProbe(ProbeStorage storage, const float sh[9][3], float* dst) {
+    if (storage == PROBE_STORAGE_SH3) {
+        memcpy(dst, sh, 27 * sizeof(float));
+        return;
+    }
+    memcpy(dst, sh, 12 * sizeof(float));
+    if (storage == PROBE_STORAGE_ZH3) {
+        float axis[3];
+        zh3LuminanceAxis(sh, axis);
+        zh3ExtractK2(sh, axis, dst + 12);
+    }
+}
+
+void unpackProbe(ProbeStorage storage, const float* src, IrradiancePoly& poly) {
+    const float (*sh)[3] = (const float (*)[3])src;
+    static const float noK2[3] = { 0.0f, 0.0f, 0.0f };
+    if (storage == PROBE_STORAGE_SH3) {
+        buildIrradiancePoly(IRRADIANCE_SH3, sh, noK2, poly);
+        return;
+    }
+    ZH3Packet packet;
+    if (storage == PROBE_STORAGE_ZH3)
+        makeZH3Packet(sh, src + 12, packet);
+    else
+        fitZH3Hallucinated(sh, packet);
+    buildIrradiancePoly(packet, poly);
+}
+
+void reportProbeStorage(const char* name, const float sh[9][3], const NormalSet& normals, const float* referenceTargets) {
+    IrradiancePoly sh3;
+    float sh3Packed[27];
+    packProbe(PROBE_STORAGE_SH3, sh, sh3Packed);
+    unpackProbe(PROBE_STORAGE_SH3, sh3Packed, sh3);
+    std::vector<float> sh3Target((size_t)normals.count * 3);
+    evalIrradianceNormals(sh3, normals, &sh3Target[0]);
+
+    printf("%s\n", name);
+    printf("  %-17s %6s %12s %12s %10s %10s %10s %10s\n", "storage", "bytes", "MB/1M probes", "fetch B/px",
+        "rms/SH3", "max/SH3", "rms/ref", "max/ref");
+    for (int s = 0; s < PROBE_STORAGE_COUNT; ++s) {
+        ProbeStorage storage = (ProbeStorage)s;
+        float packed[27];
+        packProbe(storage, sh, packed);
+        IrradiancePoly poly;
+        unpackProbe(storage, packed, poly);
+
+        IrradianceError vsSH3 = {};
+        IrradianceError vsRef = {};
+        accumulateIrradianceError(poly, normals, &sh3Target[0], vsSH3);
+        if (referenceTargets)
+            accumulateIrradianceError(poly, normals, referenceTargets, vsRef);
+
+        int bytes = probeStorageFloats(storage) * (int)sizeof(float);
+        printf("  %-17s %6d %12.1f %12d %9.3f%% %9.3f%%", probeStorageName(storage), bytes,
+            bytes * 1e6 / (1024.0 * 1024.0), bytes, 100.0f * errorRelativeRms(vsSH3), 100.0f * errorRelativeMax(vsSH3));
+        if (referenceTargets)
+            printf(" %9.3f%% %9.3f%%", 100.0f * errorRelativeRms(vsRef), 100.0f * errorRelativeMax(vsRef));
+        printf("\n");
+    }
+}
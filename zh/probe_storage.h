@@ -0,0 +1,24 @@
+// probe_storage.h
+#pragma once
+#include "irradiance.h"
+#include "error_metrics.h"
+
+// Layouts for storing a probe's cosine-convolved SH in grids and buffers.
+enum ProbeStorage {
+    PROBE_STORAGE_SH3,              // 27 floats: all nine coefficients
+    PROBE_STORAGE_ZH3,              // 15 floats: L0, L1 and shared-axis K2, axis rederived from L1
+    PROBE_STORAGE_ZH3_HALLUCINATED  // 12 floats: L0 and L1, K2 hallucinated at evaluation
+};
+
+#define PROBE_STORAGE_COUNT 3
+
+int probeStorageFloats(ProbeStorage storage);
+const char* probeStorageName(ProbeStorage storage);
+void packProbe(ProbeStorage storage, const float sh[9][3], float* dst);
+// Expand a stored probe into the polynomial it reconstructs.
+void unpackProbe(ProbeStorage storage, const float* src, IrradiancePoly& poly);
+
+// Print size, fetch bandwidth and error of every storage mode for one probe, against
+// quadratic SH and, when referenceTargets is not null, reference values at the normals
+// laid out like evalIrradianceNormals and scaled like sh.
+void reportProbeStorage(const char* name, const float sh[9][3], const NormalSet& normals, const float* referenceTargets);
@@ -0,0 +1,126 @@
+#include "probe_volume.h"
+#include "parallel_for.h"
+#include <math.h>
+#include <string.h>
+#include <vector>
+
+#define PI 3.14159265358979
+
+static const float c0 = (float)(1.0 / (2.0 * sqrt(PI)));
+static const float c1 = (float)sqrt(3.0 / (4.0 * PI));
+static const float c2 = (float)sqrt(15.0 / (4.0 * PI));
+static const float c3 = (float)sqrt(5.0 / (16.0 * PI));
+static const float c4 = (float)sqrt(15.0 / (16.0 * PI));
+
+const char* volumeFormatName(VolumeFormat format) {
+    switch (format) {
+    case VOLUME_SH3_HALF: return "SH3 half";
+    case VOLUME_ZH3_HALF: return "ZH3 half";
+    case VOLUME_ZH3_RATIO8: return "ZH3 rgb9e5 + ratio8";
+    }
+    return "";
+}
+
+ProbeStorage volumeFormatStorage(VolumeFormat format) {
+    return format == VOLUME_SH3_HALF ? PROBE_STORAGE_SH3 : PROBE_STORAGE_ZH3;
+}
+
+ProbeEncoding volumeFormatEncoding(VolumeFormat format) {
+    return format == VOLUME_ZH3_RATIO8 ? PROBE_ENCODING_RATIO8 : PROBE_ENCODING_HALF;
+}
+
+int volumeTextureCount(VolumeFormat format) {
+    return probeEncodedBytes(volumeFormatStorage(format), volumeFormatEncoding(format)) / volumeTexelBytes(format, 0);
+}
+
+int volumeTexelBytes(VolumeFormat format, int texture) {
+    // RGBA16F for half records; RGB9_E5 and RGBA8_SNORM are both 4 bytes.
+    (void)texture;
+    return format == VOLUME_ZH3_RATIO8 ? 4 : 8;
+}
+
+size_t volumeBytes(const int dim[3], VolumeFormat format) {
+    return (size_t)dim[0] * dim[1] * dim[2] * probeEncodedBytes(volumeFormatStorage(format), volumeFormatEncoding(format));
+}
+
+bool chooseVolumeFormat(const int dim[3], size_t budgetBytes, VolumeFormat& format) {
+    for (int f = 0; f < VOLUME_FORMAT_COUNT; ++f) {
+        if (volumeBytes(dim, (VolumeFormat)f) <= budgetBytes) {
+            format = (VolumeFormat)f;
+            return true;
+        }
+    }
+    return false;
+}
+
+void deinterleaveVolumeTexels(VolumeFormat format, const unsigned char* records, size_t count, int texture,
+    unsigned char* dst) {
+    int recordBytes = probeEncodedBytes(volumeFormatStorage(format), volumeFormatEncoding(format));
+    int texelBytes = volumeTexelBytes(format, texture);
+    const unsigned char* src = records + (size_t)texture * texelBytes;
+    for (size_t p = 0; p < count; ++p)
+        memcpy(dst + p * texelBytes, src + p * recordBytes, texelBytes);
+}
+
+void volumeProbePosition(const ProbeVolume& volume, int x, int y, int z, float pos[3]) {
+    int index[3] = { x, y, z };
+    for (int i = 0; i < 3; ++i) {
+        float t = volume.dim[i] > 1 ? (float)index[i] / (volume.dim[i] - 1) : 0.5f;
+        pos[i] = volume.boundsMin[i] + (volume.boundsMax[i] - volume.boundsMin[i]) * t;
+    }
+}
+
+void bakeProbeVolume(const ProbeVolume& volume, const ProbeSource& source, const VolumeSliceSink& sink) {
+    ProbeStorage storage = volumeFormatStorage(volume.format);
+    ProbeEncoding encoding = volumeFormatEncoding(volume.format);
+    int floats = probeStorageFloats(storage);
+    int recordBytes = probeEncodedBytes(storage, encoding);
+    int textureCount = volumeTextureCount(volume.format);
+    int width = volume.dim[0], height = volume.dim[1];
+    size_t sliceProbes = (size_t)width * height;
+
+    std::vector<unsigned char> records(sliceProbes * recordBytes);
+    std::vector<unsigned char> texels(sliceProbes * recordBytes);
+    for (int z = 0; z < volume.dim[2]; ++z) {
+        parallelFor(height, 4, [&](int begin, int end) {
+            std::vector<float> packed((size_t)width * floats);
+            for (int y = begin; y < end; ++y) {
+                for (int x = 0; x < width; ++x) {
+                    float pos[3], sh[9][3];
+                    volumeProbePosition(volume, x, y, z, pos);
+                    source(pos, sh);
+                    packProbe(storage, sh, &packed[(size_t)x * floats]);
+                }
+                encodeProbes(storage, encoding, &packed[0], width, &records[(size_t)y * width * recordBytes]);
+            }
+        });
+        for (int t = 0; t < textureCount; ++t) {
+            deinterleaveVolumeTexels(volume.format, &records[0], sliceProbes, t, &texels[0]);
+            sink(z, t, &texels[0]);
+        }
+    }
+}
+
+void addPointLightSH(const float pos[3], const float lightPos[3], const float rgb[3], float sh[9][3]) {
+    float d[3] = { lightPos[0] - pos[0], lightPos[1] - pos[1], lightPos[2] - pos[2] };
+    float dist2 = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+    if (dist2 < 1e-8f) return;
+    float inv = 1.0f / sqrtf(dist2);
+    float x = d[0] * inv, y = d[1] * inv, z = d[2] * inv;
+    // The shader's basis carries the Condon-Shortley signs on the odd terms, so the
+    // delta is projected with them too; the bands are then convolved with the cosine lobe.
+    float basis[9] = {
+        c0,
+        -c1 * y * (2.0f / 3.0f),
+        c1 * z * (2.0f / 3.0f),
+        -c1 * x * (2.0f / 3.0f),
+        c2 * x * y * 0.25f,
+        -c2 * y * z * 0.25f,
+        c3 * (3.0f * z * z - 1.0f) * 0.25f,
+        -c2 * x * z * 0.25f,
+        c4 * (x * x - y * y) * 0.25f
+    };
+    for (int i = 0; i < 9; ++i)
+        for (int col = 0; col < 3; ++col)
+            sh[i][col] += basis[i] * rgb[col] / dist2;
+}
@@ -0,0 +1,57 @@
+// probe_volume.h
+#pragma once
+#include <stddef.h>
+#include <functional>
+#include "probe_quantize.h"
+
+// Texture layouts for a grid of probes. Each is an encoded record of probe_quantize.h
+// split into consecutive 3D textures, so hardware trilinear filtering interpolates
+// the stored coefficients directly.
+enum VolumeFormat {
+    VOLUME_SH3_HALF,    // 7 x RGBA16F, 56 B per probe
+    VOLUME_ZH3_HALF,    // 4 x RGBA16F, 32 B per probe
+    VOLUME_ZH3_RATIO8   // RGB9_E5 L0 + 3 x RGBA8_SNORM ratios, 16 B per probe
+};
+
+#define VOLUME_FORMAT_COUNT 3
+#define VOLUME_MAX_TEXTURES 7
+
+// Grid of dim[0] x dim[1] x dim[2] probes with probe (0, 0, 0) at boundsMin and the
+// last one at boundsMax.
+struct ProbeVolume {
+    int dim[3];
+    float boundsMin[3];
+    float boundsMax[3];
+    VolumeFormat format;
+};
+
+const char* volumeFormatName(VolumeFormat format);
+ProbeStorage volumeFormatStorage(VolumeFormat format);
+ProbeEncoding volumeFormatEncoding(VolumeFormat format);
+int volumeTextureCount(VolumeFormat format);
+// Bytes per texel of texture index `texture`; the textures of a format add up to
+// probeEncodedBytes of its storage and encoding.
+int volumeTexelBytes(VolumeFormat format, int texture);
+size_t volumeBytes(const int dim[3], VolumeFormat format);
+// Most accurate format whose textures fit in budgetBytes; false when none does.
+bool chooseVolumeFormat(const int dim[3], size_t budgetBytes, VolumeFormat& format);
+
+// Copy texture `texture`'s share of count encoded records into dst, count texels.
+void deinterleaveVolumeTexels(VolumeFormat format, const unsigned char* records, size_t count, int texture,
+    unsigned char* dst);
+
+void volumeProbePosition(const ProbeVolume& volume, int x, int y, int z, float pos[3]);
+
+// Fills sh with the cosine-convolved SH of the probe at pos.
+typedef std::function<void(const float* pos, float (*sh)[3])> ProbeSource;
+// Receives one z slice of texture `texture`: dim[0] * dim[1] texels of volumeTexelBytes.
+typedef std::function<void(int z, int texture, const unsigned char* texels)> VolumeSliceSink;
+
+// Project, pack and encode every probe one z slice at a time, rows of a slice spread
+// over all cores, and hand each slice to sink before moving on. Only one slice is
+// ever held in memory, so the grid size is limited by the GPU budget alone.
+void bakeProbeVolume(const ProbeVolume& volume, const ProbeSource& source, const VolumeSliceSink& sink);
+
+// Add a point light of intensity rgb at lightPos, seen from pos, to cosine-convolved
+// SH in the frame shader.frag evaluates in. A stand-in local source for the baker.
+void addPointLightSH(const float pos[3], const float lightPos[3], const float rgb[3], float sh[9][3]);
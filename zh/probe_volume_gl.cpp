@@ -0,0 +1,337 @@
+#include "probe_volume_gl.h"
+#include <string.h>
+#include <algorithm>
+#include <string>
+
+void volumeTexelFormat(VolumeFormat volumeFormat, int t, GLenum& format, GLenum& type) {
+    format = GL_RGBA;
+    type = GL_HALF_FLOAT;
+    if (volumeFormat == VOLUME_ZH3_RATIO8) {
+        format = t == 0 ? GL_RGB : GL_RGBA;
+        type = t == 0 ? GL_UNSIGNED_INT_5_9_9_9_REV : GL_BYTE;
+    }
+}
+
+void createVolumeTextures(VolumeFormat volumeFormat, const int dim[3], const unsigned char* const* texels,
+    GLuint textures[VOLUME_MAX_TEXTURES]) {
+    int count = volumeTextureCount(volumeFormat);
+    glGenTextures(count, textures);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    for (int t = 0; t < count; t++) {
+        GLenum internalFormat = GL_RGBA16F;
+        if (volumeFormat == VOLUME_ZH3_RATIO8) {
+            internalFormat = t == 0 ? GL_RGB9_E5 : GL_RGBA8_SNORM;
+        }
+        GLenum format, type;
+        volumeTexelFormat(volumeFormat, t, format, type);
+        glBindTexture(GL_TEXTURE_3D, textures[t]);
+        glTexImage3D(GL_TEXTURE_3D, 0, internalFormat, dim[0], dim[1], dim[2], 0, format, type, texels ? texels[t] : NULL);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    }
+    glBindTexture(GL_TEXTURE_3D, 0);
+}
+
+void initVolumeBinding(const ProbeVolume& volume, VolumeBinding& binding) {
+    binding.format = volume.format;
+    for (int i = 0; i < 3; i++) {
+        binding.boundsMin[i] = volume.boundsMin[i];
+        binding.boundsMax[i] = volume.boundsMax[i];
+        binding.dim[i] = volume.dim[i];
+    }
+}
+
+void bakeVolumeTextures(const ProbeVolume& volume, const ProbeSource& source, GLuint textures[VOLUME_MAX_TEXTURES]) {
+    createVolumeTextures(volume.format, volume.dim, NULL, textures);
+    bakeProbeVolume(volume, source, [&](int z, int t, const unsigned char* texels) {
+        GLenum format, type;
+        volumeTexelFormat(volume.format, t, format, type);
+        glBindTexture(GL_TEXTURE_3D, textures[t]);
+        glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, z, volume.dim[0], volume.dim[1], 1, format, type, texels);
+    });
+    glBindTexture(GL_TEXTURE_3D, 0);
+}
+
+void uploadVolumeBox(VolumeFormat volumeFormat, const int offset[3], const int size[3], const float* probes,
+    GLuint textures[VOLUME_MAX_TEXTURES]) {
+    ProbeStorage storage = volumeFormatStorage(volumeFormat);
+    ProbeEncoding encoding = volumeFormatEncoding(volumeFormat);
+    int count = size[0] * size[1] * size[2];
+    std::vector<unsigned char> records((size_t)count * probeEncodedBytes(storage, encoding));
+    std::vector<unsigned char> texels((size_t)count * 8);
+    encodeProbes(storage, encoding, probes, count, &records[0]);
+    for (int t = 0; t < volumeTextureCount(volumeFormat); t++) {
+        GLenum format, type;
+        volumeTexelFormat(volumeFormat, t, format, type);
+        deinterleaveVolumeTexels(volumeFormat, &records[0], count, t, &texels[0]);
+        glBindTexture(GL_TEXTURE_3D, textures[t]);
+        glTexSubImage3D(GL_TEXTURE_3D, 0, offset[0], offset[1], offset[2], size[0], size[1], size[2], format, type,
+            &texels[0]);
+    }
+    glBindTexture(GL_TEXTURE_3D, 0);
+}
+
+void uploadVolumeProbes(VolumeFormat volumeFormat, const int dim[3], const float* probes, GLuint textures[VOLUME_MAX_TEXTURES]) {
+    const int origin[3] = { 0, 0, 0 };
+    uploadVolumeBox(volumeFormat, origin, dim, probes, textures);
+}
+
+int uploadMarkedProbes(VolumeFormat volumeFormat, const int dim[3], const float* probes,
+    const std::vector<unsigned char>& marked, GLuint textures[VOLUME_MAX_TEXTURES]) {
+    const int box = 8;
+    int floats = probeStorageFloats(volumeFormatStorage(volumeFormat));
+    int boxes[3];
+    for (int i = 0; i < 3; i++) {
+        boxes[i] = (dim[i] + box - 1) / box;
+    }
+    std::vector<unsigned char> touched((size_t)boxes[0] * boxes[1] * boxes[2], 0);
+    for (size_t p = 0; p < marked.size(); p++) {
+        if (!marked[p]) continue;
+        int x = (int)(p % dim[0]), y = (int)(p / dim[0] % dim[1]), z = (int)(p / ((size_t)dim[0] * dim[1]));
+        touched[((size_t)(z / box) * boxes[1] + y / box) * boxes[0] + x / box] = 1;
+    }
+    std::vector<float> packed((size_t)box * box * box * floats);
+    int uploaded = 0;
+    for (size_t b = 0; b < touched.size(); b++) {
+        if (!touched[b]) continue;
+        int offset[3] = { (int)(b % boxes[0]) * box, (int)(b / boxes[0] % boxes[1]) * box,
+            (int)(b / ((size_t)boxes[0] * boxes[1])) * box };
+        int size[3];
+        for (int i = 0; i < 3; i++) {
+            size[i] = std::min(box, dim[i] - offset[i]);
+        }
+        float* dst = &packed[0];
+        for (int z = 0; z < size[2]; z++) {
+            for (int y = 0; y < size[1]; y++) {
+                size_t row = ((size_t)(offset[2] + z) * dim[1] + offset[1] + y) * dim[0] + offset[0];
+                memcpy(dst, &probes[row * floats], sizeof(float) * size[0] * floats);
+                dst += size[0] * floats;
+            }
+        }
+        uploadVolumeBox(volumeFormat, offset, size, &packed[0], textures);
+        uploaded++;
+    }
+    return uploaded;
+}
+
+void createBrickMapTextures(const BrickMap& map, VolumeBinding& binding) {
+    binding.format = map.format;
+    binding.brickProbes = BRICK_PROBES;
+    for (int i = 0; i < 3; i++) {
+        binding.boundsMin[i] = map.boundsMin[i];
+        binding.boundsMax[i] = map.boundsMax[i];
+        binding.dim[i] = map.bricks[i] * (BRICK_PROBES - 1) + 1;
+        binding.grid[i] = map.bricks[i];
+        binding.atlas[i] = map.atlasBricks[i];
+    }
+    int dim[3] = { map.atlasBricks[0] * BRICK_PROBES, map.atlasBricks[1] * BRICK_PROBES, map.atlasBricks[2] * BRICK_PROBES };
+    int count = volumeTextureCount(map.format);
+    size_t atlasTexels = (size_t)dim[0] * dim[1] * dim[2];
+    std::vector<std::vector<unsigned char>> texels(count);
+    const unsigned char* data[VOLUME_MAX_TEXTURES];
+    for (int t = 0; t < count; t++) {
+        texels[t].resize(atlasTexels * volumeTexelBytes(map.format, t));
+        brickAtlasTexels(map, t, &texels[t][0]);
+        data[t] = &texels[t][0];
+    }
+    createVolumeTextures(map.format, dim, data, binding.textures);
+
+    glGenTextures(1, &binding.indirection);
+    glBindTexture(GL_TEXTURE_3D, binding.indirection);
+    glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA8UI, map.bricks[0], map.bricks[1], map.bricks[2], 0,
+        GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, &map.indirection[0]);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_3D, 0);
+}
+
+void createPagerTextures(const ProbePager& pager, const float fallback[9][3], VolumeBinding& binding) {
+    const ProbePageLayout& layout = pager.layout();
+    const int* atlas = pager.atlasPages();
+    binding.format = layout.format;
+    binding.brickProbes = PAGE_PROBES;
+    for (int i = 0; i < 3; i++) {
+        binding.boundsMin[i] = layout.boundsMin[i];
+        binding.boundsMax[i] = layout.boundsMax[i];
+        binding.dim[i] = layout.pages[i] * (PAGE_PROBES - 1) + 1;
+        binding.grid[i] = layout.pages[i];
+        binding.atlas[i] = atlas[i];
+    }
+    int dim[3] = { atlas[0] * PAGE_PROBES, atlas[1] * PAGE_PROBES, atlas[2] * PAGE_PROBES };
+    createVolumeTextures(layout.format, dim, NULL, binding.textures);
+
+    ProbeStorage storage = volumeFormatStorage(layout.format);
+    ProbeEncoding encoding = volumeFormatEncoding(layout.format);
+    int probeCount = PAGE_PROBES * PAGE_PROBES * PAGE_PROBES;
+    std::vector<float> packed((size_t)probeStorageFloats(storage) * probeCount);
+    for (int p = 0; p < probeCount; p++) {
+        packProbe(storage, fallback, &packed[(size_t)p * probeStorageFloats(storage)]);
+    }
+    std::vector<unsigned char> records(probePageBytes(layout.format));
+    std::vector<unsigned char> texels(records.size());
+    encodeProbes(storage, encoding, &packed[0], probeCount, &records[0]);
+    for (int t = 0; t < volumeTextureCount(layout.format); t++) {
+        GLenum format, type;
+        volumeTexelFormat(layout.format, t, format, type);
+        deinterleaveVolumeTexels(layout.format, &records[0], probeCount, t, &texels[0]);
+        glBindTexture(GL_TEXTURE_3D, binding.textures[t]);
+        glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, PAGE_PROBES, PAGE_PROBES, PAGE_PROBES, format, type, &texels[0]);
+    }
+
+    glGenTextures(1, &binding.indirection);
+    glBindTexture(GL_TEXTURE_3D, binding.indirection);
+    glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA8UI, layout.pages[0], layout.pages[1], layout.pages[2], 0,
+        GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, &pager.indirection()[0]);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_3D, 0);
+}
+
+void uploadPagerPages(const ProbePager& pager, const std::vector<PageUpload>& uploads, xStreamBuffer& stream,
+    unsigned char* staging, const VolumeBinding& binding) {
+    if (!staging) {
+        return;
+    }
+    VolumeFormat volumeFormat = pager.layout().format;
+    int probeCount = PAGE_PROBES * PAGE_PROBES * PAGE_PROBES;
+    int textureCount = volumeTextureCount(volumeFormat);
+    size_t offset = 0;
+    for (size_t u = 0; u < uploads.size(); u++) {
+        for (int t = 0; t < textureCount; t++) {
+            deinterleaveVolumeTexels(volumeFormat, uploads[u].records, probeCount, t, staging + offset);
+            offset += (size_t)probeCount * volumeTexelBytes(volumeFormat, t);
+        }
+    }
+    stream.unmap();
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, stream.buffer);
+    offset = 0;
+    for (size_t u = 0; u < uploads.size(); u++) {
+        const int* atlas = pager.atlasPages();
+        int slot = uploads[u].slot;
+        int x = slot % atlas[0] * PAGE_PROBES;
+        int y = slot / atlas[0] % atlas[1] * PAGE_PROBES;
+        int z = slot / (atlas[0] * atlas[1]) * PAGE_PROBES;
+        for (int t = 0; t < textureCount; t++) {
+            GLenum format, type;
+            volumeTexelFormat(volumeFormat, t, format, type);
+            glBindTexture(GL_TEXTURE_3D, binding.textures[t]);
+            glTexSubImage3D(GL_TEXTURE_3D, 0, x, y, z, PAGE_PROBES, PAGE_PROBES, PAGE_PROBES, format, type,
+                (void*)(stream.regionOffset() + offset));
+            offset += (size_t)probeCount * volumeTexelBytes(volumeFormat, t);
+        }
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    stream.fence();
+    if (pager.indirectionChanged()) {
+        const ProbePageLayout& layout = pager.layout();
+        glBindTexture(GL_TEXTURE_3D, binding.indirection);
+        glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, layout.pages[0], layout.pages[1], layout.pages[2],
+            GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, &pager.indirection()[0]);
+    }
+    glBindTexture(GL_TEXTURE_3D, 0);
+}
+
+void createLodTextures(const ProbeLodField& field, const ProbeLodSelector& selector, VolumeBinding& binding) {
+    int dim[3];
+    lodFieldDim(field, dim);
+    const int* atlas = selector.atlasBlocks();
+    binding.format = VOLUME_ZH3_HALF;
+    binding.brickProbes = LOD_BLOCK_PROBES;
+    binding.lod = true;
+    for (int i = 0; i < 3; i++) {
+        binding.boundsMin[i] = field.boundsMin[i];
+        binding.boundsMax[i] = field.boundsMax[i];
+        binding.dim[i] = dim[i];
+        binding.grid[i] = field.blocks[i];
+        binding.atlas[i] = atlas[i];
+    }
+    size_t count = (size_t)dim[0] * dim[1] * dim[2];
+    std::vector<std::vector<unsigned char>> texels(3);
+    const unsigned char* data[4] = { NULL, NULL, NULL, NULL };
+    for (int t = 0; t < 3; t++) {
+        texels[t].resize(count * volumeTexelBytes(VOLUME_ZH3_HALF, t));
+        deinterleaveVolumeTexels(VOLUME_ZH3_HALF, &field.records[0], count, t, &texels[t][0]);
+        data[t] = &texels[t][0];
+    }
+    createVolumeTextures(VOLUME_ZH3_HALF, dim, data, binding.textures);
+    GLenum format, type;
+    volumeTexelFormat(VOLUME_ZH3_HALF, 3, format, type);
+    // Slot 0 stands for every far block and is never uploaded, so the atlas starts
+    // defined rather than as whatever the allocation held.
+    std::vector<unsigned char> zeroAtlas((size_t)atlas[0] * atlas[1] * atlas[2] * LOD_BLOCK_PROBES * LOD_BLOCK_PROBES
+        * LOD_BLOCK_PROBES * volumeTexelBytes(VOLUME_ZH3_HALF, 3), 0);
+    glBindTexture(GL_TEXTURE_3D, binding.textures[3]);
+    glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA16F, atlas[0] * LOD_BLOCK_PROBES, atlas[1] * LOD_BLOCK_PROBES,
+        atlas[2] * LOD_BLOCK_PROBES, 0, format, type, &zeroAtlas[0]);
+
+    glGenTextures(1, &binding.indirection);
+    glBindTexture(GL_TEXTURE_3D, binding.indirection);
+    glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA8UI, field.blocks[0], field.blocks[1], field.blocks[2], 0,
+        GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, &selector.indirection()[0]);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_3D, 0);
+}
+
+void uploadLodBlocks(const ProbeLodField& field, const ProbeLodSelector& selector, const std::vector<LodUpload>& uploads,
+    const VolumeBinding& binding) {
+    const int* atlas = selector.atlasBlocks();
+    GLenum format, type;
+    volumeTexelFormat(VOLUME_ZH3_HALF, 3, format, type);
+    std::vector<unsigned char> texels((size_t)LOD_BLOCK_PROBES * LOD_BLOCK_PROBES * LOD_BLOCK_PROBES
+        * volumeTexelBytes(VOLUME_ZH3_HALF, 3));
+    glBindTexture(GL_TEXTURE_3D, binding.textures[3]);
+    for (size_t u = 0; u < uploads.size(); u++) {
+        int slot = uploads[u].slot;
+        lodBlockK2Texels(field, uploads[u].block, &texels[0]);
+        glTexSubImage3D(GL_TEXTURE_3D, 0, slot % atlas[0] * LOD_BLOCK_PROBES, slot / atlas[0] % atlas[1] * LOD_BLOCK_PROBES,
+            slot / (atlas[0] * atlas[1]) * LOD_BLOCK_PROBES, LOD_BLOCK_PROBES, LOD_BLOCK_PROBES, LOD_BLOCK_PROBES,
+            format, type, &texels[0]);
+    }
+    if (selector.indirectionChanged()) {
+        glBindTexture(GL_TEXTURE_3D, binding.indirection);
+        glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, field.blocks[0], field.blocks[1], field.blocks[2],
+            GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, &selector.indirection()[0]);
+    }
+    glBindTexture(GL_TEXTURE_3D, 0);
+}
+
+void setVolumeSamplers(const xProgram& program) {
+    for (int t = 0; t < VOLUME_MAX_TEXTURES; t++) {
+        std::string name = "volume" + std::to_string(t);
+        glUniform1i(program.uniform(name.c_str()), 2 + t);
+    }
+    glUniform1i(program.uniform("brickIndirection"), 9);
+}
+
+void bindVolume(const xProgram& program, const VolumeBinding& volume) {
+    glUniform1i(program.uniform("volumeFormat"), volume.format);
+    glUniform3fv(program.uniform("volumeMin"), 1, volume.boundsMin);
+    glUniform3fv(program.uniform("volumeMax"), 1, volume.boundsMax);
+    glUniform3f(program.uniform("volumeDim"), (float)volume.dim[0], (float)volume.dim[1], (float)volume.dim[2]);
+    glUniform1i(program.uniform("useBrickMap"), volume.brickProbes > 0 && !volume.lod);
+    glUniform1i(program.uniform("useLod"), volume.lod);
+    glUniform2fv(program.uniform("lodBand"), 1, volume.lodBand);
+    glUniform1f(program.uniform("brickProbes"), (float)volume.brickProbes);
+    glUniform3f(program.uniform("brickGrid"), (float)volume.grid[0], (float)volume.grid[1], (float)volume.grid[2]);
+    glUniform3f(program.uniform("atlasBricks"), (float)volume.atlas[0], (float)volume.atlas[1], (float)volume.atlas[2]);
+    for (int t = 0; t < volumeTextureCount(volume.format); t++) {
+        glActiveTexture(GL_TEXTURE2 + t);
+        glBindTexture(GL_TEXTURE_3D, volume.textures[t]);
+    }
+    glActiveTexture(GL_TEXTURE9);
+    glBindTexture(GL_TEXTURE_3D, volume.indirection);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void uploadTextureBuffer(GLuint buffer, GLuint texture, GLenum format, const void* data, size_t bytes) {
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+    glBufferData(GL_TEXTURE_BUFFER, bytes, data, GL_STREAM_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    glBindTexture(GL_TEXTURE_BUFFER, texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
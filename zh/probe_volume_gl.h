@@ -0,0 +1,87 @@
+// probe_volume_gl.h
+#pragma once
+#include <stddef.h>
+#include <vector>
+#include <glad/glad.h>
+#include "probe_volume.h"
+#include "probe_brick_map.h"
+#include "probe_pager.h"
+#include "probe_lod.h"
+#include "xProgram.h"
+#include "xStreamBuffer.h"
+
+// Viewer side of the probe grids: the 3D textures shader_volume.frag samples, filled
+// from the CPU structures of probe_volume.h, probe_brick_map.h, probe_pager.h and
+// probe_lod.h, and the uniforms that describe their layout. The volume textures use
+// units 2 and up and the indirection unit 9.
+
+// Layout of a probe grid sampled by shader_volume.frag: a dense grid when brickProbes
+// is 0, otherwise an atlas of bricks or pages behind an indirection texture. With lod
+// only the K2 texture is an atlas, of the blocks of probe_lod.h.
+struct VolumeBinding {
+    VolumeFormat format;
+    float boundsMin[3];
+    float boundsMax[3];
+    int dim[3];
+    int brickProbes;
+    int grid[3];
+    int atlas[3];
+    GLuint textures[VOLUME_MAX_TEXTURES];
+    GLuint indirection;
+    bool lod;
+    float lodBand[2];
+};
+
+// Pixel format and type of texture t of a volume format, as deinterleaveVolumeTexels lays it out.
+void volumeTexelFormat(VolumeFormat volumeFormat, int t, GLenum& format, GLenum& type);
+// Allocate the 3D textures of a volume format, filled from texels[t] when given.
+// Trilinear filtering across probes comes from GL_LINEAR on every texture.
+void createVolumeTextures(VolumeFormat volumeFormat, const int dim[3], const unsigned char* const* texels,
+    GLuint textures[VOLUME_MAX_TEXTURES]);
+
+// Dense grid: the layout of volume in binding, whose textures are created by one of
+// the calls below.
+void initVolumeBinding(const ProbeVolume& volume, VolumeBinding& binding);
+// Allocate the textures of volume.format and fill them slice by slice from source.
+void bakeVolumeTextures(const ProbeVolume& volume, const ProbeSource& source, GLuint textures[VOLUME_MAX_TEXTURES]);
+// Encode and upload the size[0] x size[1] x size[2] probes of a box starting at
+// offset, packed x fastest, into existing volume textures.
+void uploadVolumeBox(VolumeFormat volumeFormat, const int offset[3], const int size[3], const float* probes,
+    GLuint textures[VOLUME_MAX_TEXTURES]);
+// Replace every probe of a volume's textures with count packed probes of its storage.
+void uploadVolumeProbes(VolumeFormat volumeFormat, const int dim[3], const float* probes, GLuint textures[VOLUME_MAX_TEXTURES]);
+// Upload the 8^3 boxes of a grid of packed probes that hold any probe with a nonzero
+// marked entry, x fastest like probes. Returns the number of boxes uploaded.
+int uploadMarkedProbes(VolumeFormat volumeFormat, const int dim[3], const float* probes,
+    const std::vector<unsigned char>& marked, GLuint textures[VOLUME_MAX_TEXTURES]);
+
+// Upload the brick atlas into volume textures and the indirection into an RGBA8UI
+// texture read with texelFetch, and describe the map in binding.
+void createBrickMapTextures(const BrickMap& map, VolumeBinding& binding);
+
+// Create the atlas textures of the pager with the fallback probe in slot 0 and an
+// indirection texture with every page pointing at it.
+void createPagerTextures(const ProbePager& pager, const float fallback[9][3], VolumeBinding& binding);
+// Copy this frame's pages into the stream buffer region at staging and upload them
+// from it into their atlas slots; NULL staging means the region was still busy and
+// the pager was given no uploads.
+void uploadPagerPages(const ProbePager& pager, const std::vector<PageUpload>& uploads, xStreamBuffer& stream,
+    unsigned char* staging, const VolumeBinding& binding);
+
+// Create the textures of a LOD field: L0 and L1 of every probe in the first three,
+// a zeroed K2 block atlas in the fourth and the block indirection on its own.
+void createLodTextures(const ProbeLodField& field, const ProbeLodSelector& selector, VolumeBinding& binding);
+// Copy this frame's K2 blocks into their atlas slots and refresh the indirection.
+void uploadLodBlocks(const ProbeLodField& field, const ProbeLodSelector& selector, const std::vector<LodUpload>& uploads,
+    const VolumeBinding& binding);
+
+// Point the samplers of the current shader_volume.frag program at the units
+// bindVolume uses; once per program.
+void setVolumeSamplers(const xProgram& program);
+// Set the layout uniforms of the current volume program and bind the textures to
+// units 2 and up, the indirection to unit 9.
+void bindVolume(const xProgram& program, const VolumeBinding& volume);
+
+// Replace the contents of a texture buffer. glBufferData hands the buffer new storage,
+// so the GPU can keep reading last frame's data from the old one.
+void uploadTextureBuffer(GLuint buffer, GLuint texture, GLenum format, const void* data, size_t bytes);
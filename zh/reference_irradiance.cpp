@@ -0,0 +1,244 @@
+#include "reference_irradiance.h"
+#include "parallel_for.h"
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+#define PI 3.14159265358979
+#define LEAF_TEXELS 4
+
+static const float lumWeight[3] = { 0.2126f, 0.7152f, 0.0722f };
+
+static float sinc(float x) {
+    return (fabs(x) < 1.0e-4f) ? 1.0f : sinf(x) / x;
+}
+
+static void normalizeAxis(float axis[3]) {
+    float len = sqrtf(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+    if (len < 1e-12f) {
+        axis[0] = 0.0f;
+        axis[1] = 0.0f;
+        axis[2] = 1.0f;
+        return;
+    }
+    for (int i = 0; i < 3; ++i) axis[i] /= len;
+}
+
+static float angleBetween(const float a[3], const float b[3]) {
+    float d = a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+    return acosf(d > 1.0f ? 1.0f : (d < -1.0f ? -1.0f : d));
+}
+
+static float coneBound(float angle) {
+    return angle >= (float)(PI / 2) ? 2.0f : sinf(angle);
+}
+
+static void buildLeaves(ReferenceIrradiance& ref) {
+    int width = ref.width;
+    std::vector<ReferenceNode>& leaves = ref.levels[0];
+    parallelFor(ref.leafDim, 8, [&](int begin, int end) {
+        for (int by = begin; by < end; ++by) {
+            for (int bx = 0; bx < ref.leafDim; ++bx) {
+                ReferenceNode& node = leaves[(size_t)by * ref.leafDim + bx];
+                memset(&node, 0, sizeof(node));
+                int i0 = by * LEAF_TEXELS, j0 = bx * LEAF_TEXELS;
+                float dirSum[3] = { 0.0f, 0.0f, 0.0f };
+                for (int i = i0; i < i0 + LEAF_TEXELS && i < width; ++i) {
+                    for (int j = j0; j < j0 + LEAF_TEXELS && j < width; ++j) {
+                        size_t t = ((size_t)i * width + j) * 3;
+                        const float* d = &ref.texelDir[t];
+                        const float* w = &ref.texelWeight[t];
+                        if (w[0] == 0.0f && w[1] == 0.0f && w[2] == 0.0f) continue;
+                        float p = w[0] * lumWeight[0] + w[1] * lumWeight[1] + w[2] * lumWeight[2];
+                        for (int col = 0; col < 3; ++col)
+                            for (int k = 0; k < 3; ++k)
+                                node.moment[col][k] += w[col] * d[k];
+                        node.power += fabsf(p);
+                        for (int k = 0; k < 3; ++k) dirSum[k] += d[k];
+                    }
+                }
+                memcpy(node.axis, dirSum, sizeof(dirSum));
+                normalizeAxis(node.axis);
+                float angle = 0.0f;
+                for (int i = i0; i < i0 + LEAF_TEXELS && i < width; ++i)
+                    for (int j = j0; j < j0 + LEAF_TEXELS && j < width; ++j) {
+                        size_t t = ((size_t)i * width + j) * 3;
+                        const float* w = &ref.texelWeight[t];
+                        if (w[0] == 0.0f && w[1] == 0.0f && w[2] == 0.0f) continue;
+                        float a = angleBetween(node.axis, &ref.texelDir[t]);
+                        if (a > angle) angle = a;
+                    }
+                node.sinAngle = coneBound(angle);
+            }
+        }
+    });
+}
+
+void buildReferenceIrradiance(const float* rgb, int width, ReferenceIrradiance& ref) {
+    ref.width = width;
+    ref.texelDir.assign((size_t)width * width * 3, 0.0f);
+    ref.texelWeight.assign((size_t)width * width * 3, 0.0f);
+
+    // Same parameterization and solid angle as computeSHFromFloatFile.
+    parallelFor(width, 16, [&](int begin, int end) {
+        for (int i = begin; i < end; ++i) {
+            for (int j = 0; j < width; ++j) {
+                float u = (j - width / 2.0f) / (width / 2.0f);
+                float v = (width / 2.0f - i) / (width / 2.0f);
+                float r = sqrtf(u * u + v * v);
+                size_t t = ((size_t)i * width + j) * 3;
+                float theta = (float)PI * r;
+                float phi = atan2f(v, u);
+                ref.texelDir[t + 0] = sinf(theta) * cosf(phi);
+                ref.texelDir[t + 1] = sinf(theta) * sinf(phi);
+                ref.texelDir[t + 2] = cosf(theta);
+                if (r > 1.0f) continue;
+                float domega = (float)((2 * PI / width) * (2 * PI / width)) * sinc(theta);
+                for (int col = 0; col < 3; ++col)
+                    ref.texelWeight[t + col] = rgb[t + col] * domega;
+            }
+        }
+    });
+
+    int blocks = (width + LEAF_TEXELS - 1) / LEAF_TEXELS;
+    ref.leafDim = 1;
+    while (ref.leafDim < blocks) ref.leafDim *= 2;
+
+    ref.levels.clear();
+    ref.levels.push_back(std::vector<ReferenceNode>((size_t)ref.leafDim * ref.leafDim));
+    buildLeaves(ref);
+
+    for (int dim = ref.leafDim / 2; dim >= 1; dim /= 2) {
+        const std::vector<ReferenceNode>& children = ref.levels.back();
+        std::vector<ReferenceNode> parents((size_t)dim * dim);
+        int childDim = dim * 2;
+        for (int y = 0; y < dim; ++y) {
+            for (int x = 0; x < dim; ++x) {
+                ReferenceNode& node = parents[(size_t)y * dim + x];
+                memset(&node, 0, sizeof(node));
+                const ReferenceNode* child[4] = {
+                    &children[(size_t)(2 * y) * childDim + 2 * x],
+                    &children[(size_t)(2 * y) * childDim + 2 * x + 1],
+                    &children[(size_t)(2 * y + 1) * childDim + 2 * x],
+                    &children[(size_t)(2 * y + 1) * childDim + 2 * x + 1]
+                };
+                for (int c = 0; c < 4; ++c) {
+                    for (int col = 0; col < 3; ++col)
+                        for (int k = 0; k < 3; ++k)
+                            node.moment[col][k] += child[c]->moment[col][k];
+                    node.power += child[c]->power;
+                    for (int k = 0; k < 3; ++k)
+                        node.axis[k] += child[c]->axis[k] * child[c]->power;
+                }
+                normalizeAxis(node.axis);
+                // Conservative cone: reach every child cone from the new axis.
+                float angle = 0.0f;
+                for (int c = 0; c < 4; ++c) {
+                    if (child[c]->power <= 0.0f) continue;
+                    float childAngle = child[c]->sinAngle > 1.0f ? (float)PI : asinf(child[c]->sinAngle);
+                    float a = angleBetween(node.axis, child[c]->axis) + childAngle;
+                    if (a > angle) angle = a;
+                }
+                node.sinAngle = coneBound(angle);
+            }
+        }
+        ref.levels.push_back(parents);
+    }
+    ref.totalPower = ref.levels.back()[0].power;
+}
+
+// A node straddling the horizon, with its clamped first-moment estimate and the
+// worst-case error of taking it.
+struct Straddle {
+    float error;
+    int level, x, y;
+    float estimate[3];
+};
+
+void evalReferenceIrradiance(const ReferenceIrradiance& ref, const float n[3], float errorBound, float out[3]) {
+    float pn[3] = { -n[0], -n[1], n[2] };
+    double sum[3] = { 0.0, 0.0, 0.0 };
+    double tolerance = (double)errorBound * ref.totalPower;
+
+    // Straddling nodes as a max-heap on their error; pending is the error of taking
+    // all of them as they are, and refinement stops once it fits the tolerance.
+    std::vector<Straddle> frontier;
+    double pending = 0.0;
+    auto byError = [](const Straddle& a, const Straddle& b) { return a.error < b.error; };
+    auto visit = [&](int level, int x, int y) {
+        int dim = ref.leafDim >> level;
+        const ReferenceNode& node = ref.levels[level][(size_t)y * dim + x];
+        if (node.power <= 0.0f) return;
+        float d = pn[0] * node.axis[0] + pn[1] * node.axis[1] + pn[2] * node.axis[2];
+        if (d <= -node.sinAngle) return;
+        Straddle s = { 2.0f * node.power * node.sinAngle, level, x, y, { 0.0f, 0.0f, 0.0f } };
+        for (int col = 0; col < 3; ++col) {
+            float c = pn[0] * node.moment[col][0] + pn[1] * node.moment[col][1] + pn[2] * node.moment[col][2];
+            s.estimate[col] = d >= node.sinAngle ? c : (c > 0.0f ? c : 0.0f);
+        }
+        if (d >= node.sinAngle) {
+            for (int col = 0; col < 3; ++col) sum[col] += s.estimate[col];
+            return;
+        }
+        frontier.push_back(s);
+        std::push_heap(frontier.begin(), frontier.end(), byError);
+        pending += s.error;
+    };
+
+    visit((int)ref.levels.size() - 1, 0, 0);
+    // With no tolerance every straddling node is refined; this also keeps rounding in
+    // pending from stopping early.
+    while (!frontier.empty() && (tolerance <= 0.0 || pending > tolerance)) {
+        std::pop_heap(frontier.begin(), frontier.end(), byError);
+        Straddle e = frontier.back();
+        frontier.pop_back();
+        pending -= e.error;
+        if (e.level > 0) {
+            for (int c = 0; c < 4; ++c)
+                visit(e.level - 1, e.x * 2 + (c & 1), e.y * 2 + (c >> 1));
+            continue;
+        }
+        int i0 = e.y * LEAF_TEXELS, j0 = e.x * LEAF_TEXELS;
+        for (int i = i0; i < i0 + LEAF_TEXELS && i < ref.width; ++i) {
+            for (int j = j0; j < j0 + LEAF_TEXELS && j < ref.width; ++j) {
+                size_t t = ((size_t)i * ref.width + j) * 3;
+                const float* dir = &ref.texelDir[t];
+                float c = pn[0] * dir[0] + pn[1] * dir[1] + pn[2] * dir[2];
+                if (c <= 0.0f) continue;
+                for (int col = 0; col < 3; ++col)
+                    sum[col] += c * ref.texelWeight[t + col];
+            }
+        }
+    }
+    for (size_t i = 0; i < frontier.size(); ++i)
+        for (int col = 0; col < 3; ++col)
+            sum[col] += frontier[i].estimate[col];
+    for (int col = 0; col < 3; ++col)
+        out[col] = (float)(sum[col] / PI);
+}
+
+void bakeReferenceIrradianceMap(const ReferenceIrradiance& ref, int size, float errorBound, IrradianceMap& map) {
+    map.size = size;
+    map.texels.assign((size_t)size * size * 3, 0.0f);
+    parallelFor(size * size, 16, [&](int begin, int end) {
+        for (int t = begin; t < end; ++t) {
+            float dir[3];
+            octahedralDecode((t % size + 0.5f) / size, (t / size + 0.5f) / size, dir);
+            evalReferenceIrradiance(ref, dir, errorBound, &map.texels[(size_t)t * 3]);
+        }
+    });
+}
+
+void evalReferenceIrradianceNormals(const ReferenceIrradiance& ref, const NormalSet& normals, float errorBound, float* out) {
+    int n = normals.count;
+    parallelFor(n, 64, [&](int begin, int end) {
+        for (int i = begin; i < end; ++i) {
+            float dir[3] = { normals.x[i], normals.y[i], normals.z[i] };
+            float value[3];
+            evalReferenceIrradiance(ref, dir, errorBound, value);
+            out[i] = value[0];
+            out[n + i] = value[1];
+            out[2 * n + i] = value[2];
+        }
+    });
+}
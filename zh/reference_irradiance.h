@@ -0,0 +1,38 @@
+// reference_irradiance.h
+#pragma once
+#include <vector>
+#include "irradiance_map.h"
+
+// Quadtree over the texels of an angular map. Every node keeps the first moment
+// sum(radiance * solidAngle * direction) per channel and a cone bounding its texel
+// directions, so a node entirely above the horizon of a normal contributes exactly
+// dot(n, moment) and a node entirely below contributes nothing. Only nodes
+// straddling the horizon are refined.
+struct ReferenceNode {
+    float moment[3][3]; // [channel][x, y, z]
+    float power;        // luminance of sum(radiance * solidAngle)
+    float axis[3];
+    float sinAngle;     // sine of the cone half-angle, 2 when wider than a hemisphere
+};
+
+struct ReferenceIrradiance {
+    int width = 0;
+    int leafDim = 0;                 // leaf nodes per side, a power of two
+    float totalPower = 0.0f;
+    std::vector<float> texelDir;     // width * width * 3, probe frame
+    std::vector<float> texelWeight;  // width * width * 3, radiance * solid angle
+    std::vector<std::vector<ReferenceNode> > levels; // levels[0] holds the leaves
+};
+
+// rgb is a width x width angular map laid out like the .float captures.
+void buildReferenceIrradiance(const float* rgb, int width, ReferenceIrradiance& ref);
+
+// Cosine-convolved irradiance, normalized like the SH reconstructions (constant
+// radiance L gives L). n is in the frame shader.frag evaluates in, whose basis
+// flips x and y relative to computeSHFromFloatFile. Straddling nodes are refined,
+// worst first, until the worst-case errors of those left unrefined add up to at most
+// errorBound * totalPower over the whole integral; 0 gives the exact texel sum.
+void evalReferenceIrradiance(const ReferenceIrradiance& ref, const float n[3], float errorBound, float out[3]);
+void bakeReferenceIrradianceMap(const ReferenceIrradiance& ref, int size, float errorBound, IrradianceMap& map);
+// Same values at every normal of the set, laid out like evalIrradianceNormals.
+void evalReferenceIrradianceNormals(const ReferenceIrradiance& ref, const NormalSet& normals, float errorBound, float* out);
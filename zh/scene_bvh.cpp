@@ -0,0 +1,210 @@
+#include "scene_bvh.h"
+#include <float.h>
+#include <string.h>
+#include <algorithm>
+
+#define SAH_BINS 16
+#define LEAF_MAX 8
+
+struct BuildTriangle {
+    float boundsMin[3];
+    float boundsMax[3];
+    float centroid[3];
+};
+
+static float halfArea(const float lo[3], const float hi[3]) {
+    float d[3] = { hi[0] - lo[0], hi[1] - lo[1], hi[2] - lo[2] };
+    return d[0] * d[1] + d[1] * d[2] + d[2] * d[0];
+}
+
+static void growBounds(float lo[3], float hi[3], const float boxLo[3], const float boxHi[3]) {
+    for (int i = 0; i < 3; ++i) {
+        lo[i] = std::min(lo[i], boxLo[i]);
+        hi[i] = std::max(hi[i], boxHi[i]);
+    }
+}
+
+static void buildNode(SceneBvh& bvh, const std::vector<BuildTriangle>& items, int node, int begin, int end, int depth) {
+    float lo[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, hi[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    float centroidLo[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, centroidHi[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    for (int t = begin; t < end; ++t) {
+        const BuildTriangle& item = items[bvh.triangles[t]];
+        growBounds(lo, hi, item.boundsMin, item.boundsMax);
+        growBounds(centroidLo, centroidHi, item.centroid, item.centroid);
+    }
+    memcpy(bvh.nodes[node].boundsMin, lo, sizeof(lo));
+    memcpy(bvh.nodes[node].boundsMax, hi, sizeof(hi));
+    bvh.nodes[node].first = begin;
+    bvh.nodes[node].count = end - begin;
+    int count = end - begin;
+    if (count <= 2 || depth == BVH_MAX_DEPTH) return;
+
+    // Binned SAH over all three axes; costs are relative to one triangle test with
+    // one box test per traversal step.
+    float bestCost = FLT_MAX;
+    int bestAxis = -1, bestSplit = 0;
+    for (int axis = 0; axis < 3; ++axis) {
+        float extent = centroidHi[axis] - centroidLo[axis];
+        float scale = SAH_BINS / extent;
+        // A denormal extent overflows the scale, and 0 * inf would bin a centroid at NaN.
+        if (extent <= 0.0f || scale > FLT_MAX) continue;
+        int binCount[SAH_BINS] = { 0 };
+        float binLo[SAH_BINS][3], binHi[SAH_BINS][3];
+        for (int b = 0; b < SAH_BINS; ++b) {
+            for (int i = 0; i < 3; ++i) {
+                binLo[b][i] = FLT_MAX;
+                binHi[b][i] = -FLT_MAX;
+            }
+        }
+        for (int t = begin; t < end; ++t) {
+            const BuildTriangle& item = items[bvh.triangles[t]];
+            int b = std::min(SAH_BINS - 1, (int)((item.centroid[axis] - centroidLo[axis]) * scale));
+            binCount[b]++;
+            growBounds(binLo[b], binHi[b], item.boundsMin, item.boundsMax);
+        }
+        float rightArea[SAH_BINS];
+        int rightCount[SAH_BINS];
+        float accLo[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, accHi[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+        int acc = 0;
+        for (int b = SAH_BINS - 1; b > 0; --b) {
+            acc += binCount[b];
+            if (binCount[b]) growBounds(accLo, accHi, binLo[b], binHi[b]);
+            rightCount[b] = acc;
+            rightArea[b] = acc ? halfArea(accLo, accHi) : 0.0f;
+        }
+        for (int i = 0; i < 3; ++i) {
+            accLo[i] = FLT_MAX;
+            accHi[i] = -FLT_MAX;
+        }
+        acc = 0;
+        for (int b = 0; b < SAH_BINS - 1; ++b) {
+            acc += binCount[b];
+            if (binCount[b]) growBounds(accLo, accHi, binLo[b], binHi[b]);
+            if (acc == 0 || rightCount[b + 1] == 0) continue;
+            float cost = halfArea(accLo, accHi) * acc + rightArea[b + 1] * rightCount[b + 1];
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = b + 1;
+            }
+        }
+    }
+    float area = halfArea(lo, hi);
+    if (bestAxis < 0 || (area > 0.0f && 1.0f + bestCost / area >= count && count <= LEAF_MAX)) return;
+
+    float scale = SAH_BINS / (centroidHi[bestAxis] - centroidLo[bestAxis]);
+    int* middle = std::partition(&bvh.triangles[begin], &bvh.triangles[begin] + count, [&](int t) {
+        return std::min(SAH_BINS - 1, (int)((items[t].centroid[bestAxis] - centroidLo[bestAxis]) * scale)) < bestSplit;
+    });
+    int split = (int)(middle - &bvh.triangles[0]);
+    int children = (int)bvh.nodes.size();
+    bvh.nodes.resize(bvh.nodes.size() + 2);
+    bvh.nodes[node].first = children;
+    bvh.nodes[node].count = -1 - bestAxis;
+    buildNode(bvh, items, children, begin, split, depth + 1);
+    buildNode(bvh, items, children + 1, split, end, depth + 1);
+}
+
+void buildSceneBvh(const SceneMesh& mesh, SceneBvh& bvh) {
+    int count = (int)mesh.triangleMaterial.size();
+    std::vector<BuildTriangle> items(count);
+    for (int t = 0; t < count; ++t) {
+        BuildTriangle& item = items[t];
+        for (int i = 0; i < 3; ++i) {
+            item.boundsMin[i] = FLT_MAX;
+            item.boundsMax[i] = -FLT_MAX;
+        }
+        for (int k = 0; k < 3; ++k) {
+            const float* v = &mesh.positions[mesh.triangles[t * 3 + k] * 3];
+            growBounds(item.boundsMin, item.boundsMax, v, v);
+        }
+        for (int i = 0; i < 3; ++i) item.centroid[i] = 0.5f * (item.boundsMin[i] + item.boundsMax[i]);
+    }
+    bvh.triangles.resize(count);
+    for (int t = 0; t < count; ++t) bvh.triangles[t] = t;
+    bvh.nodes.assign(1, BvhNode());
+    if (count > 0) {
+        bvh.nodes.reserve(2 * count);
+        buildNode(bvh, items, 0, 0, count, 0);
+    }
+    else {
+        bvh.nodes[0] = BvhNode{ { 0.0f, 0.0f, 0.0f }, 0, { -1.0f, -1.0f, -1.0f }, 0 };
+    }
+
+    bvh.triangleData.resize((size_t)count * 9);
+    for (int t = 0; t < count; ++t) {
+        const unsigned int* tri = &mesh.triangles[bvh.triangles[t] * 3];
+        const float* v0 = &mesh.positions[tri[0] * 3];
+        const float* v1 = &mesh.positions[tri[1] * 3];
+        const float* v2 = &mesh.positions[tri[2] * 3];
+        float* dst = &bvh.triangleData[(size_t)t * 9];
+        for (int i = 0; i < 3; ++i) {
+            dst[i] = v0[i];
+            dst[3 + i] = v1[i] - v0[i];
+            dst[6 + i] = v2[i] - v0[i];
+        }
+    }
+}
+
+void traceRayPacket(const SceneBvh& bvh, const float origin[3], const float* dirX, const float* dirY, const float* dirZ,
+    float tMax, int* triangle, float* t) {
+    typedef FloatW T;
+    const T zero(0.0f), one(1.0f), tiny(1e-12f), epsilon(1e-5f);
+    T ox(origin[0]), oy(origin[1]), oz(origin[2]);
+    T dx = T::load(dirX), dy = T::load(dirY), dz = T::load(dirZ);
+    // Zero components would turn the slab test into 0 * inf.
+    T ix = one / select(lessThan(abs(dx), tiny), tiny, dx);
+    T iy = one / select(lessThan(abs(dy), tiny), tiny, dy);
+    T iz = one / select(lessThan(abs(dz), tiny), tiny, dz);
+    // BVH triangle of the closest hit per lane, kept as a float (exact below 2^24).
+    T best(tMax), hitIndex(-1.0f);
+
+    // Each step pops one node and pushes at most its two children, one level down.
+    int stack[BVH_MAX_DEPTH + 1];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        const BvhNode& node = bvh.nodes[stack[--top]];
+        T ax = (T(node.boundsMin[0]) - ox) * ix, bx = (T(node.boundsMax[0]) - ox) * ix;
+        T ay = (T(node.boundsMin[1]) - oy) * iy, by = (T(node.boundsMax[1]) - oy) * iy;
+        T az = (T(node.boundsMin[2]) - oz) * iz, bz = (T(node.boundsMax[2]) - oz) * iz;
+        T tNear = max(max(min(ax, bx), min(ay, by)), max(min(az, bz), zero));
+        T tFar = min(min(max(ax, bx), max(ay, by)), min(max(az, bz), best));
+        if (!anyLane(lessEqual(tNear, tFar))) continue;
+
+        if (node.count < 0) {
+            // Visit the child on the side most of the packet comes from first.
+            int axis = -1 - node.count;
+            const float* dir = axis == 0 ? dirX : (axis == 1 ? dirY : dirZ);
+            float sum = 0.0f;
+            for (int l = 0; l < RAY_PACKET_SIZE; ++l) sum += dir[l];
+            bool reverse = sum < 0.0f;
+            stack[top++] = node.first + (reverse ? 0 : 1);
+            stack[top++] = node.first + (reverse ? 1 : 0);
+            continue;
+        }
+        for (int k = node.first; k < node.first + node.count; ++k) {
+            const float* tri = &bvh.triangleData[(size_t)k * 9];
+            T e1x(tri[3]), e1y(tri[4]), e1z(tri[5]);
+            T e2x(tri[6]), e2y(tri[7]), e2z(tri[8]);
+            T px = dy * e2z - dz * e2y, py = dz * e2x - dx * e2z, pz = dx * e2y - dy * e2x;
+            T inv = one / (e1x * px + e1y * py + e1z * pz);
+            // The origin is shared, so the vector from the vertex is the same in every lane.
+            float s[3] = { origin[0] - tri[0], origin[1] - tri[1], origin[2] - tri[2] };
+            float q[3] = { s[1] * tri[5] - s[2] * tri[4], s[2] * tri[3] - s[0] * tri[5], s[0] * tri[4] - s[1] * tri[3] };
+            T u = (T(s[0]) * px + T(s[1]) * py + T(s[2]) * pz) * inv;
+            T v = (dx * T(q[0]) + dy * T(q[1]) + dz * T(q[2])) * inv;
+            T dist = T(tri[6] * q[0] + tri[7] * q[1] + tri[8] * q[2]) * inv;
+            T hit = maskAnd(maskAnd(lessEqual(zero, u), lessEqual(zero, v)), lessEqual(u + v, one));
+            hit = maskAnd(hit, maskAnd(lessThan(epsilon, dist), lessThan(dist, best)));
+            best = select(hit, dist, best);
+            hitIndex = select(hit, T((float)k), hitIndex);
+        }
+    }
+
+    float lanes[RAY_PACKET_SIZE];
+    hitIndex.store(lanes);
+    best.store(t);
+    for (int l = 0; l < RAY_PACKET_SIZE; ++l)
+        triangle[l] = lanes[l] < 0.0f ? -1 : bvh.triangles[(int)lanes[l]];
+}
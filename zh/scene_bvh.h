@@ -0,0 +1,38 @@
+// scene_bvh.h
+#pragma once
+#include <vector>
+#include "scene_mesh.h"
+#include "simd_float.h"
+
+// Node of a flattened BVH. A leaf (count > 0) holds BVH triangles first .. first +
+// count - 1; an inner node (count = -1 - axis of its split) has its children at first
+// and first + 1.
+struct BvhNode {
+    float boundsMin[3];
+    int first;
+    float boundsMax[3];
+    int count;
+};
+
+// Binned-SAH BVH over a SceneMesh. Triangles are reordered into leaf order with the
+// vertex and edges Moller-Trumbore needs stored next to each other.
+struct SceneBvh {
+    std::vector<BvhNode> nodes;
+    std::vector<int> triangles;      // mesh triangle of each BVH triangle
+    std::vector<float> triangleData; // v0, v1 - v0, v2 - v0 of each BVH triangle
+};
+
+// Nodes deeper than this become leaves whatever their size, which bounds the
+// traversal stack at BVH_MAX_DEPTH + 1 entries on clustered or degenerate meshes.
+#define BVH_MAX_DEPTH 63
+
+void buildSceneBvh(const SceneMesh& mesh, SceneBvh& bvh);
+
+#define RAY_PACKET_SIZE SIMD_FLOAT_WIDTH
+
+// Closest hits of a packet of RAY_PACKET_SIZE rays leaving origin along unit directions
+// dirX/Y/Z, no farther than tMax. triangle receives the mesh triangle hit or -1 and t
+// the hit distance. The packet walks the tree together, entering a node when any lane
+// hits its box, and tests every triangle against all lanes at once.
+void traceRayPacket(const SceneBvh& bvh, const float origin[3], const float* dirX, const float* dirY, const float* dirZ,
+    float tMax, int* triangle, float* t);
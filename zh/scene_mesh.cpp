@@ -0,0 +1,151 @@
+#include "scene_mesh.h"
+#include <float.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+static const float defaultAlbedo[3] = { 0.5f, 0.5f, 0.5f };
+static const float noEmission[3] = { 0.0f, 0.0f, 0.0f };
+
+int addSceneMaterial(SceneMesh& mesh, const char* name, const float albedo[3], const float emission[3]) {
+    SceneMaterial material;
+    material.name = name;
+    memcpy(material.albedo, albedo, sizeof(material.albedo));
+    memcpy(material.emission, emission, sizeof(material.emission));
+    mesh.materials.push_back(material);
+    return (int)mesh.materials.size() - 1;
+}
+
+void addSceneTriangle(SceneMesh& mesh, const float a[3], const float b[3], const float c[3], int m) {
+    unsigned int base = (unsigned int)(mesh.positions.size() / 3);
+    mesh.positions.insert(mesh.positions.end(), a, a + 3);
+    mesh.positions.insert(mesh.positions.end(), b, b + 3);
+    mesh.positions.insert(mesh.positions.end(), c, c + 3);
+    for (unsigned int k = 0; k < 3; ++k) mesh.triangles.push_back(base + k);
+    mesh.triangleMaterial.push_back(m);
+}
+
+void addSceneQuad(SceneMesh& mesh, const float a[3], const float b[3], const float c[3], const float d[3], int m) {
+    addSceneTriangle(mesh, a, b, c, m);
+    addSceneTriangle(mesh, a, c, d, m);
+}
+
+void addSceneBox(SceneMesh& mesh, const float lo[3], const float hi[3], int m) {
+    float corner[8][3];
+    for (int k = 0; k < 8; ++k) {
+        corner[k][0] = k & 1 ? hi[0] : lo[0];
+        corner[k][1] = k & 2 ? hi[1] : lo[1];
+        corner[k][2] = k & 4 ? hi[2] : lo[2];
+    }
+    static const int faces[6][4] = { { 0, 4, 6, 2 }, { 1, 3, 7, 5 }, { 0, 1, 5, 4 }, { 2, 6, 7, 3 }, { 0, 2, 3, 1 }, { 4, 5, 7, 6 } };
+    for (int f = 0; f < 6; ++f)
+        addSceneQuad(mesh, corner[faces[f][0]], corner[faces[f][1]], corner[faces[f][2]], corner[faces[f][3]], m);
+}
+
+void sceneTriangleBounds(const SceneMesh& mesh, int first, int count, float lo[3], float hi[3]) {
+    for (int i = 0; i < 3; ++i) {
+        lo[i] = FLT_MAX;
+        hi[i] = -FLT_MAX;
+    }
+    for (int k = first * 3; k < (first + count) * 3; ++k) {
+        const float* v = &mesh.positions[mesh.triangles[k] * 3];
+        for (int i = 0; i < 3; ++i) {
+            lo[i] = std::min(lo[i], v[i]);
+            hi[i] = std::max(hi[i], v[i]);
+        }
+    }
+}
+
+// Kd and Ke of every newmtl in a material library, appended to mesh.materials.
+static void loadMTL(const std::string& path, SceneMesh& mesh) {
+    std::ifstream file(path);
+    if (!file) {
+        printf("Material library %s not found\n", path.c_str());
+        return;
+    }
+    std::string line;
+    SceneMaterial* current = NULL;
+    while (std::getline(file, line)) {
+        std::istringstream in(line);
+        std::string key;
+        in >> key;
+        if (key == "newmtl") {
+            std::string name;
+            in >> name;
+            addSceneMaterial(mesh, name.c_str(), defaultAlbedo, noEmission);
+            current = &mesh.materials.back();
+        }
+        else if (current && key == "Kd") {
+            in >> current->albedo[0] >> current->albedo[1] >> current->albedo[2];
+        }
+        else if (current && key == "Ke") {
+            in >> current->emission[0] >> current->emission[1] >> current->emission[2];
+        }
+    }
+}
+
+bool loadOBJ(const char* path, SceneMesh& mesh) {
+    std::ifstream file(path);
+    if (!file) {
+        printf("Failed to open %s\n", path);
+        return false;
+    }
+    mesh = SceneMesh();
+    std::string directory(path);
+    size_t slash = directory.find_last_of("/\\");
+    directory = slash == std::string::npos ? std::string() : directory.substr(0, slash + 1);
+
+    std::vector<float> vertices;
+    int material = -1;
+    int fallback = -1;
+    std::string line;
+    std::vector<int> face;
+    while (std::getline(file, line)) {
+        std::istringstream in(line);
+        std::string key;
+        in >> key;
+        if (key == "v") {
+            float v[3] = { 0.0f, 0.0f, 0.0f };
+            in >> v[0] >> v[1] >> v[2];
+            vertices.insert(vertices.end(), v, v + 3);
+        }
+        else if (key == "mtllib") {
+            std::string name;
+            in >> name;
+            loadMTL(directory + name, mesh);
+        }
+        else if (key == "usemtl") {
+            std::string name;
+            in >> name;
+            material = -1;
+            for (size_t m = 0; m < mesh.materials.size(); ++m)
+                if (mesh.materials[m].name == name) material = (int)m;
+        }
+        else if (key == "f") {
+            // v, v/vt, v/vt/vn or v//vn; negative indices count back from the last vertex.
+            face.clear();
+            std::string token;
+            int vertexCount = (int)(vertices.size() / 3);
+            while (in >> token) {
+                int index = atoi(token.c_str());
+                index = index < 0 ? vertexCount + index : index - 1;
+                if (index < 0 || index >= vertexCount) {
+                    printf("Bad face index in %s: %s\n", path, line.c_str());
+                    return false;
+                }
+                face.push_back(index);
+            }
+            if (material < 0 && fallback < 0)
+                fallback = addSceneMaterial(mesh, "default", defaultAlbedo, noEmission);
+            for (size_t k = 2; k < face.size(); ++k) {
+                addSceneTriangle(mesh, &vertices[face[0] * 3], &vertices[face[k - 1] * 3], &vertices[face[k] * 3],
+                    material < 0 ? fallback : material);
+            }
+        }
+    }
+    printf("Loaded %s: %zu triangles, %zu materials\n", path, mesh.triangleMaterial.size(), mesh.materials.size());
+    return !mesh.triangleMaterial.empty();
+}
@@ -0,0 +1,34 @@
+// scene_mesh.h
+#pragma once
+#include <string>
+#include <vector>
+
+struct SceneMaterial {
+    std::string name;
+    float albedo[3];    // diffuse reflectance, Kd
+    float emission[3];  // emitted radiance, Ke
+};
+
+// Triangle soup for the probe baker. Triangle t has vertices
+// positions[3 * triangles[3t + k] .. + 2] and material triangleMaterial[t].
+struct SceneMesh {
+    std::vector<float> positions;
+    std::vector<unsigned int> triangles;
+    std::vector<int> triangleMaterial;
+    std::vector<SceneMaterial> materials;
+};
+
+// Read the v, f, usemtl and mtllib statements of a Wavefront OBJ; faces with more than
+// three vertices are split into fans, and Kd and Ke of the material library are kept.
+// Faces before any usemtl, or naming an unknown material, get a grey default.
+bool loadOBJ(const char* path, SceneMesh& mesh);
+
+// Append a quad a, b, c, d (counter-clockwise) or a triangle with material index m.
+void addSceneQuad(SceneMesh& mesh, const float a[3], const float b[3], const float c[3], const float d[3], int m);
+void addSceneTriangle(SceneMesh& mesh, const float a[3], const float b[3], const float c[3], int m);
+int addSceneMaterial(SceneMesh& mesh, const char* name, const float albedo[3], const float emission[3]);
+// Append the six faces of the box lo..hi, facing out.
+void addSceneBox(SceneMesh& mesh, const float lo[3], const float hi[3], int m);
+
+// Bounds of triangles first .. first + count - 1.
+void sceneTriangleBounds(const SceneMesh& mesh, int first, int count, float lo[3], float hi[3]);
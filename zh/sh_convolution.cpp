@@ -0,0 +1,98 @@
+#include "sh_convolution.h"
+#include <math.h>
+#include <stddef.h>
+
+#define PI 3.14159265358979
+#define KERNEL_SAMPLES 8192
+
+static ZonalKernel projectKernel(double (*profile)(double theta, const void* data), const void* data) {
+    // Integrate f(cos theta) * P_l(cos theta) over the sphere and divide by the band 0 term.
+    double moments[3] = { 0.0, 0.0, 0.0 };
+    double dtheta = PI / KERNEL_SAMPLES;
+    for (int i = 0; i < KERNEL_SAMPLES; ++i) {
+        double theta = (i + 0.5) * dtheta;
+        double t = cos(theta);
+        double w = profile(theta, data) * sin(theta) * dtheta;
+        moments[0] += w;
+        moments[1] += w * t;
+        moments[2] += w * 0.5 * (3.0 * t * t - 1.0);
+    }
+    ZonalKernel kernel;
+    kernel.zh[0] = 1.0f;
+    kernel.zh[1] = moments[0] > 0.0 ? (float)(moments[1] / moments[0]) : 0.0f;
+    kernel.zh[2] = moments[0] > 0.0 ? (float)(moments[2] / moments[0]) : 0.0f;
+    return kernel;
+}
+
+static double ggxProfile(double theta, const void* data) {
+    if (theta > PI / 2) return 0.0;
+    double a2 = *(const double*)data;
+    double t = cos(theta);
+    double d = (a2 - 1.0) * t * t + 1.0;
+    return a2 / (PI * d * d);
+}
+
+struct TabulatedData {
+    const float* values;
+    int count;
+};
+
+static double tabulatedProfile(double theta, const void* data) {
+    const TabulatedData* table = (const TabulatedData*)data;
+    if (table->count == 1) return table->values[0];
+    double x = theta / PI * (table->count - 1);
+    int i = (int)x;
+    if (i >= table->count - 1) return table->values[table->count - 1];
+    double f = x - i;
+    return table->values[i] * (1.0 - f) + table->values[i + 1] * f;
+}
+
+ZonalKernel makeCosineKernel() {
+    ZonalKernel kernel = { { 1.0f, 2.0f / 3.0f, 0.25f } };
+    return kernel;
+}
+
+ZonalKernel makePhongKernel(float exponent) {
+    double n = exponent;
+    ZonalKernel kernel = { { 1.0f, (float)((n + 1.0) / (n + 2.0)), (float)(n / (n + 3.0)) } };
+    return kernel;
+}
+
+ZonalKernel makeGGXKernel(float roughness) {
+    double a2 = (double)roughness * roughness;
+    if (a2 < 1e-6) a2 = 1e-6;
+    return projectKernel(ggxProfile, &a2);
+}
+
+ZonalKernel makeTabulatedKernel(const float* values, int count) {
+    if (count <= 0) {
+        ZonalKernel identity = { { 1.0f, 1.0f, 1.0f } };
+        return identity;
+    }
+    TabulatedData table = { values, count };
+    return projectKernel(tabulatedProfile, &table);
+}
+
+void convolveSH(const float sh[9][3], const ZonalKernel& kernel, float out[9][3]) {
+    static const int band[9] = { 0, 1, 1, 1, 2, 2, 2, 2, 2 };
+    for (int i = 0; i < 9; ++i)
+        for (int col = 0; col < 3; ++col)
+            out[i][col] = sh[i][col] * kernel.zh[band[i]];
+}
+
+void convolveProbes(const float* probes, int probeCount, const ZonalKernel* kernels, int kernelCount, float* out) {
+    for (int k = 0; k < kernelCount; ++k) {
+        // Expand the per-band factors to all 27 floats once so the inner loop is a plain multiply.
+        float scale[27];
+        for (int i = 0; i < 27; ++i) {
+            int coeff = i / 3;
+            scale[i] = kernels[k].zh[coeff == 0 ? 0 : (coeff < 4 ? 1 : 2)];
+        }
+        float* dst = out + (size_t)k * probeCount * 27;
+        for (int p = 0; p < probeCount; ++p) {
+            const float* src = probes + (size_t)p * 27;
+            for (int i = 0; i < 27; ++i)
+                dst[(size_t)p * 27 + i] = src[i] * scale[i];
+        }
+    }
+}
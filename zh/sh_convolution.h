@@ -0,0 +1,24 @@
+// sh_convolution.h
+#pragma once
+
+// Per-band zonal harmonic coefficients of a rotationally symmetric kernel,
+// normalized so that band 0 is 1. Convolving SH with the kernel scales
+// every coefficient of band l by zh[l].
+struct ZonalKernel {
+    float zh[3];
+};
+
+// Normalized clamped cosine (irradiance): 1, 2/3, 1/4.
+ZonalKernel makeCosineKernel();
+// Normalized Phong lobe cos^n around the axis: 1, (n+1)/(n+2), n/(n+3).
+ZonalKernel makePhongKernel(float exponent);
+// GGX distribution of the given roughness (alpha), centred on the reflection axis.
+ZonalKernel makeGGXKernel(float roughness);
+// Kernel tabulated at count uniformly spaced angles from 0 to PI, linearly interpolated.
+ZonalKernel makeTabulatedKernel(const float* values, int count);
+
+// Convolve one probe's quadratic SH with the kernel.
+void convolveSH(const float sh[9][3], const ZonalKernel& kernel, float out[9][3]);
+// Convolve probeCount probes (float[probeCount][9][3]) with kernelCount kernels at once.
+// out holds kernelCount consecutive sets of probeCount probes.
+void convolveProbes(const float* probes, int probeCount, const ZonalKernel* kernels, int kernelCount, float* out);
@@ -0,0 +1,302 @@
+// sh_eval.h
+#pragma once
+#include <math.h>
+#include "simd_float.h"
+
+// C++ versions of the reconstruction functions in st.cpp, with the same names,
+// signs and coefficient layout (shader.frag evaluates the same basis). Every
+// function is a template on the scalar T: float or double evaluate one normal,
+// FloatN<4/8/16> evaluate one normal per lane. Coefficients are T as well, so a
+// single probe is broadcast with T(value) and a packet of probes is loaded lane-wise.
+
+inline float shAbs(float a) { return fabsf(a); }
+inline double shAbs(double a) { return fabs(a); }
+template <int N> inline FloatN<N> shAbs(FloatN<N> a) { return abs(a); }
+
+inline float shSqrt(float a) { return sqrtf(a); }
+inline double shSqrt(double a) { return ::sqrt(a); }
+template <int N> inline FloatN<N> shSqrt(FloatN<N> a) { return sqrt(a); }
+
+template <typename T>
+struct ShVec3 {
+    T x, y, z;
+
+    ShVec3() {}
+    ShVec3(T s) : x(s), y(s), z(s) {}
+    ShVec3(T x_, T y_, T z_) : x(x_), y(y_), z(z_) {}
+};
+
+template <typename T> inline ShVec3<T> operator+(const ShVec3<T>& a, const ShVec3<T>& b) { return ShVec3<T>(a.x + b.x, a.y + b.y, a.z + b.z); }
+template <typename T> inline ShVec3<T> operator-(const ShVec3<T>& a, const ShVec3<T>& b) { return ShVec3<T>(a.x - b.x, a.y - b.y, a.z - b.z); }
+template <typename T> inline ShVec3<T> operator*(const ShVec3<T>& a, const ShVec3<T>& b) { return ShVec3<T>(a.x * b.x, a.y * b.y, a.z * b.z); }
+template <typename T> inline ShVec3<T> operator/(const ShVec3<T>& a, const ShVec3<T>& b) { return ShVec3<T>(a.x / b.x, a.y / b.y, a.z / b.z); }
+template <typename T> inline ShVec3<T> operator*(const ShVec3<T>& a, T s) { return ShVec3<T>(a.x * s, a.y * s, a.z * s); }
+template <typename T> inline ShVec3<T> operator*(T s, const ShVec3<T>& a) { return ShVec3<T>(a.x * s, a.y * s, a.z * s); }
+template <typename T> inline ShVec3<T> operator/(const ShVec3<T>& a, T s) { return ShVec3<T>(a.x / s, a.y / s, a.z / s); }
+template <typename T> inline ShVec3<T>& operator+=(ShVec3<T>& a, const ShVec3<T>& b) { return a = a + b; }
+template <typename T> inline ShVec3<T>& operator/=(ShVec3<T>& a, T s) { return a = a / s; }
+
+template <typename T> inline T dot(const ShVec3<T>& a, const ShVec3<T>& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+template <typename T> inline T length(const ShVec3<T>& a) { return shSqrt(dot(a, a)); }
+template <typename T> inline ShVec3<T> normalize(const ShVec3<T>& a) { return a / length(a); }
+template <typename T> inline ShVec3<T> abs(const ShVec3<T>& a) { return ShVec3<T>(shAbs(a.x), shAbs(a.y), shAbs(a.z)); }
+
+#define SH_EVAL_PI 3.141592653589793
+
+// Basis constants in the precision of T.
+template <typename T> inline T shConst(double v) { return T((float)v); }
+template <> inline double shConst<double>(double v) { return v; }
+
+// Per-band zonal coefficients of the normalized cosine lobe.
+static const float cosLobe[3] = { 1.0f, 2.0f / 3.0f, 0.25f };
+
+// Luminance of a colour using sRGB coefficients.
+template <typename T>
+inline T Color_Luminance(const ShVec3<T>& color) {
+    return T(0.2126f) * color.x + T(0.7152f) * color.y + T(0.0722f) * color.z;
+}
+
+// Evaluate linear SH in a direction.
+template <typename T>
+inline void SH2_InDirection(const ShVec3<T>& direction, T sh[4]) {
+    sh[0] = shConst<T>(0.5 * sqrt(1.0 / SH_EVAL_PI));
+
+    sh[1] = shConst<T>(-sqrt(0.75 / SH_EVAL_PI)) * direction.y;
+    sh[2] = shConst<T>(sqrt(0.75 / SH_EVAL_PI)) * direction.z;
+    sh[3] = shConst<T>(-sqrt(0.75 / SH_EVAL_PI)) * direction.x;
+}
+
+// Evaluate quadratic SH in a direction.
+template <typename T>
+inline void SH3_InDirection(const ShVec3<T>& direction, T sh[9]) {
+    SH2_InDirection(direction, sh);
+
+    sh[4] = shConst<T>(0.5 * sqrt(15.0 / SH_EVAL_PI)) * direction.x * direction.y;
+    sh[5] = shConst<T>(-0.5 * sqrt(15.0 / SH_EVAL_PI)) * direction.y * direction.z;
+    sh[6] = shConst<T>(0.25 * sqrt(5.0 / SH_EVAL_PI)) * (T(-1.0f) + T(3.0f) * direction.z * direction.z);
+    sh[7] = shConst<T>(-0.5 * sqrt(15.0 / SH_EVAL_PI)) * direction.z * direction.x;
+    sh[8] = shConst<T>(0.25 * sqrt(15.0 / SH_EVAL_PI)) * (direction.x * direction.x - direction.y * direction.y);
+}
+
+// Convolve linear SH with a zonal kernel given by its per-band coefficients.
+template <typename C>
+inline void SH2_Conv(C sh[4], const float kernel[3]) {
+    sh[0] = sh[0] * C(kernel[0]);
+    for (int i = 1; i < 4; ++i) sh[i] = sh[i] * C(kernel[1]);
+}
+
+// Convolve quadratic SH with a zonal kernel given by its per-band coefficients.
+template <typename C>
+inline void SH3_Conv(C sh[9], const float kernel[3]) {
+    SH2_Conv(sh, kernel);
+    for (int i = 4; i < 9; ++i) sh[i] = sh[i] * C(kernel[2]);
+}
+
+// Convolve linear SH with a normalized cosine lobe to produce an irradiance function.
+template <typename C>
+inline void SH2_ConvCos(C sh[4]) {
+    SH2_Conv(sh, cosLobe);
+}
+
+// Convolve quadratic SH with a normalized cosine lobe to produce an irradiance function.
+template <typename C>
+inline void SH3_ConvCos(C sh[9]) {
+    SH3_Conv(sh, cosLobe);
+}
+
+// Dot two linear SH vectors, used for reconstructing c in the direction given by sh.
+template <typename T>
+inline T SH2_Dot(const T c[4], const T sh[4]) {
+    T result = c[0] * sh[0];
+    for (int i = 1; i < 4; ++i) result += c[i] * sh[i];
+    return result;
+}
+
+// Dot two linear SH vectors, used for reconstructing c in the direction given by sh.
+template <typename T>
+inline ShVec3<T> SH2_Dot(const ShVec3<T> c[4], const T sh[4]) {
+    ShVec3<T> result = c[0] * sh[0];
+    for (int i = 1; i < 4; ++i) result += c[i] * sh[i];
+    return result;
+}
+
+// Dot two quadratic SH vectors, used for reconstructing c in the direction given by sh.
+template <typename T>
+inline T SH3_Dot(const T c[9], const T sh[9]) {
+    T result = c[0] * sh[0];
+    for (int i = 1; i < 9; ++i) result += c[i] * sh[i];
+    return result;
+}
+
+// Dot two quadratic SH vectors, used for reconstructing c in the direction given by sh.
+template <typename T>
+inline ShVec3<T> SH3_Dot(const ShVec3<T> c[9], const T sh[9]) {
+    ShVec3<T> result = c[0] * sh[0];
+    for (int i = 1; i < 9; ++i) result += c[i] * sh[i];
+    return result;
+}
+
+// Extract the zonal L2 SH coefficient in the direction N.
+template <typename T>
+inline T SH_ExtractL2Zonal(const T sh[9], const ShVec3<T>& N) {
+    T inDirection[9];
+    SH3_InDirection(N, inDirection);
+
+    T s = inDirection[4] * sh[4];
+    for (int i = 5; i < 9; ++i) s += inDirection[i] * sh[i];
+
+    return s / shConst<T>(0.5 * sqrt(5.0 / SH_EVAL_PI));
+}
+
+// Extract the zonal L2 SH coefficient in the direction N.
+template <typename T>
+inline ShVec3<T> SH_ExtractL2Zonal(const ShVec3<T> sh[9], const ShVec3<T>& N) {
+    T inDirection[9];
+    SH3_InDirection(N, inDirection);
+
+    ShVec3<T> s = sh[4] * inDirection[4];
+    for (int i = 5; i < 9; ++i) s += sh[i] * inDirection[i];
+
+    return s / shConst<T>(0.5 * sqrt(5.0 / SH_EVAL_PI));
+}
+
+// Evaluate irradiance in direction nor from the linear SH env.
+template <typename T>
+inline T SH2_EvalIrradiance(const T env[4], const ShVec3<T>& nor) {
+    T shDir[4];
+    SH2_InDirection(nor, shDir);
+
+    SH2_ConvCos(shDir);
+    return SH2_Dot(env, shDir);
+}
+
+// Evaluate irradiance in direction nor from the linear SH env.
+template <typename T>
+inline ShVec3<T> SH2_EvalIrradiance(const ShVec3<T> env[4], const ShVec3<T>& nor) {
+    T shDir[4];
+    SH2_InDirection(nor, shDir);
+
+    SH2_ConvCos(shDir);
+    return SH2_Dot(env, shDir);
+}
+
+// Evaluate radiance in direction nor from the quadratic SH env.
+template <typename T>
+inline ShVec3<T> SH3_EvalRadiance(const ShVec3<T> env[9], const ShVec3<T>& nor) {
+    T shDir[9];
+    SH3_InDirection(nor, shDir);
+
+    return SH3_Dot(env, shDir);
+}
+
+// Evaluate irradiance in direction nor from the quadratic SH env.
+template <typename T>
+inline ShVec3<T> SH3_EvalIrradiance(const ShVec3<T> env[9], const ShVec3<T>& nor) {
+    T shDir[9];
+    SH3_InDirection(nor, shDir);
+
+    SH3_ConvCos(shDir);
+    return SH3_Dot(env, shDir);
+}
+
+// Zonal L2 basis function around an axis, times the cosine lobe's band-2 factor.
+template <typename T>
+inline T ZH3_ConvolvedZonalBasis(const ShVec3<T>& zonalAxis, const ShVec3<T>& normal) {
+    T fZ = dot(zonalAxis, normal);
+    T zhNormal = shConst<T>(sqrt(5.0 / (16.0 * SH_EVAL_PI))) * (T(3.0f) * fZ * fZ - T(1.0f));
+    return T(cosLobe[2]) * zhNormal;
+}
+
+// Evaluate irradiance in direction normal from the quadratic SH sh,
+// extracting the ZH3 coefficient and then using that and linear SH
+// for reconstruction.
+template <typename T>
+inline T ZH3_EvalIrradiance(const T sh[9], const ShVec3<T>& normal) {
+    ShVec3<T> zonalAxis = normalize(ShVec3<T>(-sh[3], -sh[1], sh[2]));
+
+    T zonalL2Coeff = SH_ExtractL2Zonal(sh, zonalAxis);
+
+    T result = SH2_EvalIrradiance(sh, normal);
+    result += ZH3_ConvolvedZonalBasis(zonalAxis, normal) * zonalL2Coeff;
+    return result;
+}
+
+// Evaluate irradiance in direction normal from the quadratic SH sh,
+// extracting the ZH3 coefficient and then using that and linear SH
+// for reconstruction.
+template <typename T>
+inline ShVec3<T> ZH3_EvalIrradiance(const ShVec3<T> sh[9], const ShVec3<T>& normal) {
+    T channel[3][9];
+    for (int i = 0; i < 9; ++i) {
+        channel[0][i] = sh[i].x;
+        channel[1][i] = sh[i].y;
+        channel[2][i] = sh[i].z;
+    }
+    return ShVec3<T>(ZH3_EvalIrradiance(channel[0], normal), ZH3_EvalIrradiance(channel[1], normal),
+        ZH3_EvalIrradiance(channel[2], normal));
+}
+
+// Evaluate irradiance in direction normal from the quadratic SH sh,
+// computing a shared luminance axis from the linear components,
+// extracting the ZH3 coefficients along that axis,
+// and then using ZH3 and linear SH for reconstruction in the direction normal.
+template <typename T>
+inline ShVec3<T> ZH3_EvalIrradianceLumAxis(const ShVec3<T> sh[9], const ShVec3<T>& normal) {
+    ShVec3<T> zonalAxis = normalize(ShVec3<T>(-Color_Luminance(sh[3]), -Color_Luminance(sh[1]), Color_Luminance(sh[2])));
+
+    ShVec3<T> zonalL2Coeff = SH_ExtractL2Zonal(sh, zonalAxis);
+
+    ShVec3<T> result = SH2_EvalIrradiance(sh, normal);
+    result += zonalL2Coeff * ZH3_ConvolvedZonalBasis(zonalAxis, normal);
+    return result;
+}
+
+// Evaluate irradiance in direction normal from the linear SH sh,
+// hallucinating the ZH3 coefficient and then using that and linear SH
+// for reconstruction.
+template <typename T>
+inline T ZH3Hallucinate_EvalIrradiance(const T sh[4], const ShVec3<T>& normal) {
+    ShVec3<T> zonalAxis(-sh[3], -sh[1], sh[2]);
+    T l1Length = length(zonalAxis);
+    zonalAxis /= l1Length;
+
+    T ratio = l1Length / sh[0];
+    T zonalL2Coeff = sh[0] * ratio * (T(0.08f) + T(0.6f) * ratio); // Curve-fit.
+
+    T result = SH2_EvalIrradiance(sh, normal);
+    result += ZH3_ConvolvedZonalBasis(zonalAxis, normal) * zonalL2Coeff;
+    return result;
+}
+
+// Evaluate irradiance in direction normal from the linear SH sh,
+// hallucinating the ZH3 coefficient and then using that and linear SH
+// for reconstruction.
+template <typename T>
+inline ShVec3<T> ZH3Hallucinate_EvalIrradiance(const ShVec3<T> sh[4], const ShVec3<T>& normal) {
+    T r[4] = { sh[0].x, sh[1].x, sh[2].x, sh[3].x };
+    T g[4] = { sh[0].y, sh[1].y, sh[2].y, sh[3].y };
+    T b[4] = { sh[0].z, sh[1].z, sh[2].z, sh[3].z };
+    return ShVec3<T>(ZH3Hallucinate_EvalIrradiance(r, normal), ZH3Hallucinate_EvalIrradiance(g, normal),
+        ZH3Hallucinate_EvalIrradiance(b, normal));
+}
+
+// Evaluate irradiance in direction normal from the linear SH sh,
+// computing a shared luminance axis from the linear components,
+// hallucinating the ZH3 coefficients along that axis,
+// and then using ZH3 and linear SH for reconstruction in the direction normal.
+template <typename T>
+inline ShVec3<T> ZH3Hallucinate_EvalIrradianceLumAxis(const ShVec3<T> sh[4], const ShVec3<T>& normal) {
+    ShVec3<T> zonalAxis = normalize(ShVec3<T>(-Color_Luminance(sh[3]), -Color_Luminance(sh[1]), Color_Luminance(sh[2])));
+
+    ShVec3<T> ratio(
+        dot(ShVec3<T>(-sh[3].x, -sh[1].x, sh[2].x), zonalAxis),
+        dot(ShVec3<T>(-sh[3].y, -sh[1].y, sh[2].y), zonalAxis),
+        dot(ShVec3<T>(-sh[3].z, -sh[1].z, sh[2].z), zonalAxis));
+    ratio = abs(ratio / sh[0]);
+
+    ShVec3<T> zonalL2Coeff = sh[0] * ratio * (ShVec3<T>(T(0.08f)) + ratio * T(0.6f)); // Curve-fit.
+
+    ShVec3<T> result = SH2_EvalIrradiance(sh, normal);
+    result += zonalL2Coeff * ZH3_ConvolvedZonalBasis(zonalAxis, normal);
+    return result;
+}
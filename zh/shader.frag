@@ -4,22 +4,49 @@ out vec4 FragColor;
 in vec3 WorldPos;
 in vec3 Normal;
 
-uniform vec3 cameraPos;
+layout(std140) uniform FrameConstants {
+    mat4 view;
+    mat4 projection;
+    vec3 cameraPos;
+};
 uniform sampler2D envMap;
-uniform vec3 sh[4];
-uniform vec3 rsh[9];
 uniform float weight;
-uniform float k2[3];
+
+#define PCA_MAX_COMPONENTS 8
+
+// Every form of the probe the functions below read, so switching probes is a single
+// buffer update (ProbeConstants in main.cpp).
+layout(std140) uniform ProbeConstants {
+    vec3 sh[4];
+    vec3 rsh[9];
+    vec3 k2;
+    vec3 zhAxis;
+    vec3 zhL0;
+    mat3 zhL1;
+    vec3 zhK2;
+    uvec4 packedZH3;
+    float pcaWeights[PCA_MAX_COMPONENTS + 1];
+    int pcaComponents;
+};
+
+// The PCA basis is shared by every probe.
+uniform vec3 pcaMean[9];
+uniform vec3 pcaBasis[9 * PCA_MAX_COMPONENTS];
 
 const float PI = 3.14159265359;
 
+#include "zh3_common.glsl"
+
+// sh, rsh and k2 arrive already convolved with the cosine lobe (see sh_convolution.h),
+// so the reconstructions below are plain dot products with the SH basis.
+
 vec3 calcIrradianceSH2_mine(vec3 n)
 {
     float SH[4];
     SH[0] = 1.0 / (2.0 * sqrt(PI));                                     
-    SH[1] = -sqrt(3.0 / (4.0 * PI)) * n.y * (2.0 / 3.0);                
-    SH[2] =  sqrt(3.0 / (4.0 * PI)) * n.z * (2.0 / 3.0);
-    SH[3] = -sqrt(3.0 / (4.0 * PI)) * n.x * (2.0 / 3.0);
+    SH[1] = -sqrt(3.0 / (4.0 * PI)) * n.y;                
+    SH[2] =  sqrt(3.0 / (4.0 * PI)) * n.z;
+    SH[3] = -sqrt(3.0 / (4.0 * PI)) * n.x;
 
     vec3 result = vec3(0.0);
     for (int i = 0; i < 4; i++) {
@@ -32,14 +59,14 @@ vec3 calcIrradianceSH3_mine(vec3 n)
 {
     float SH[9];
     SH[0] = 1.0 / (2.0 * sqrt(PI));                                     
-    SH[1] = -sqrt(3.0 / (4.0 * PI)) * n.y * (2.0 / 3.0);                
-    SH[2] =  sqrt(3.0 / (4.0 * PI)) * n.z * (2.0 / 3.0);
-    SH[3] = -sqrt(3.0 / (4.0 * PI)) * n.x * (2.0 / 3.0);
-    SH[4] =  sqrt(15.0 / (4.0 * PI)) * n.x * n.y * 0.25;                
-    SH[5] = -sqrt(15.0 / (4.0 * PI)) * n.y * n.z * 0.25;
-    SH[6] =  sqrt(5.0 / (16.0 * PI)) * (3.0 * n.z * n.z - 1.0) * 0.25;
-    SH[7] = -sqrt(15.0 / (4.0 * PI)) * n.x * n.z * 0.25;
-    SH[8] =  sqrt(15.0 / (16.0 * PI)) * (n.x * n.x - n.y * n.y) * 0.25;
+    SH[1] = -sqrt(3.0 / (4.0 * PI)) * n.y;                
+    SH[2] =  sqrt(3.0 / (4.0 * PI)) * n.z;
+    SH[3] = -sqrt(3.0 / (4.0 * PI)) * n.x;
+    SH[4] =  sqrt(15.0 / (4.0 * PI)) * n.x * n.y;                
+    SH[5] = -sqrt(15.0 / (4.0 * PI)) * n.y * n.z;
+    SH[6] =  sqrt(5.0 / (16.0 * PI)) * (3.0 * n.z * n.z - 1.0);
+    SH[7] = -sqrt(15.0 / (4.0 * PI)) * n.x * n.z;
+    SH[8] =  sqrt(15.0 / (16.0 * PI)) * (n.x * n.x - n.y * n.y);
 
     vec3 result = vec3(0.0);
     for (int i = 0; i < 9; i++) {
@@ -64,10 +91,6 @@ vec3 calcIrradianceZH3(vec3 n)
         linBasis[2] =  sqrt(3.0 / (4.0 * PI)) * n.z;
         linBasis[3] = -sqrt(3.0 / (4.0 * PI)) * n.x;
 
-        linBasis[1] *= 2.0 / 3.0;
-        linBasis[2] *= 2.0 / 3.0;
-        linBasis[3] *= 2.0 / 3.0;
-
         float linCoeff[4] = float[4](sh0, sh1, sh2, sh3);
         float channelIrradiance = 0.0;
         for (int i = 0; i < 4; i++) {
@@ -78,59 +101,82 @@ vec3 calcIrradianceZH3(vec3 n)
         float fZ = dot(optDir, n);
         float zhBasis = sqrt(5.0 / (16.0 * PI)) * (3.0 * fZ * fZ - 1.0);
 
-        channelIrradiance += k2[channel] * zhBasis * 0.25;
+        channelIrradiance += k2[channel] * zhBasis;
         result[channel] = channelIrradiance;
     }
 
     return result;
 }
 
+// Shared luminance-axis ZH3, fitted once per probe by fitZH3Shared (zh3_fit.h)
+// with the basis constants folded into the packet.
 vec3 calcIrradianceShared(vec3 n)
 {
-    vec3 result = vec3(0.0);
-    float RGBWeight[3];
-    RGBWeight[0] = 0.2126f;
-    RGBWeight[1] = 0.7152f;
-    RGBWeight[2] = 0.0722f;
-    float sh_3 = 0.0;
-    float sh_1 = 0.0;
-    float sh_2 = 0.0;
-    for (int channel = 0; channel < 3; channel++) {
-        sh_3 += sh[3][channel] * RGBWeight[channel];
-        sh_1 += sh[1][channel] * RGBWeight[channel];
-        sh_2 += sh[2][channel] * RGBWeight[channel];
-    }
-    vec3 optDir = normalize(vec3(-sh_3, -sh_1, sh_2));
-    float fZ = dot(optDir, n);
-    float zhBasis = sqrt(5.0 / (16.0 * PI)) * (3.0 * fZ * fZ - 1.0);
+    float t = dot(zhAxis, n);
+    return zhL0 + zhL1 * n + zhK2 * (t * t);
+}
 
-    for (int channel = 0; channel < 3; channel++) {
-        float sh0 = sh[0][channel];
-        float sh1 = sh[1][channel];
-        float sh2 = sh[2][channel];
-        float sh3 = sh[3][channel];
 
-        float linBasis[4];
-        linBasis[0] = 1.0 / (2.0 * sqrt(PI));
-        linBasis[1] = -sqrt(3.0 / (4.0 * PI)) * n.y;
-        linBasis[2] =  sqrt(3.0 / (4.0 * PI)) * n.z;
-        linBasis[3] = -sqrt(3.0 / (4.0 * PI)) * n.x;
+// Hallucinated ZH3 from the 4-coefficient probe in sh[] alone, as
+// ZH3Hallucinate_EvalIrradianceLumAxis in st.cpp and fitZH3Hallucinated in zh3_fit.cpp.
+vec3 calcIrradianceHallucinated(vec3 n)
+{
+    vec3 c[5] = vec3[5](sh[0], sh[1], sh[2], sh[3], vec3(0.0));
+    c[4] = hallucinateK2(c);
+    return evalZH3(c, n);
+}
 
-        linBasis[1] *= 2.0 / 3.0;
-        linBasis[2] *= 2.0 / 3.0;
-        linBasis[3] *= 2.0 / 3.0;
 
-        float linCoeff[4] = float[4](sh0, sh1, sh2, sh3);
-        float channelIrradiance = 0.0;
-        for (int i = 0; i < 4; i++) {
-            channelIrradiance += linCoeff[i] * linBasis[i];
-        }
+vec3 decodeRGB9E5(uint w)
+{
+    float scale = exp2(float(w >> 27u) - 24.0);
+    return vec3(float(w & 511u), float((w >> 9u) & 511u), float((w >> 18u) & 511u)) * scale;
+}
 
-        channelIrradiance += k2[channel] * zhBasis * 0.25;
-        result[channel] = channelIrradiance;
+float decodeRatio8(uint w, uint byteIndex)
+{
+    return float(int(w << (24u - 8u * byteIndex)) >> 24) / 127.0;
+}
+
+// ZH3 probe in the rgb9e5 + ratio8 encoding of probe_quantize.cpp: L0 in the first
+// word, then L1 and the luminance-axis K2 as signed bytes relative to L0.
+vec3 calcIrradiancePackedZH3(vec3 n)
+{
+    vec3 c[5];
+    c[0] = decodeRGB9E5(packedZH3.x);
+    for (int k = 3; k < 15; k++) {
+        int b = k - 3;
+        float range = k < 12 ? 1.2 : 0.6;
+        c[k / 3][k % 3] = decodeRatio8(packedZH3[1 + b / 4], uint(b % 4)) * range * c[0][k % 3];
     }
+    return evalZH3(c, n);
+}
 
-    return result;
+
+// Quadratic SH rebuilt from the shared basis of probe_pca.h: pcaWeights[0] is the
+// probe's L0 luminance and the rest are its weights.
+vec3 calcIrradiancePCA(vec3 n)
+{
+    float SH[9];
+    SH[0] = 1.0 / (2.0 * sqrt(PI));
+    SH[1] = -sqrt(3.0 / (4.0 * PI)) * n.y;
+    SH[2] =  sqrt(3.0 / (4.0 * PI)) * n.z;
+    SH[3] = -sqrt(3.0 / (4.0 * PI)) * n.x;
+    SH[4] =  sqrt(15.0 / (4.0 * PI)) * n.x * n.y;
+    SH[5] = -sqrt(15.0 / (4.0 * PI)) * n.y * n.z;
+    SH[6] =  sqrt(5.0 / (16.0 * PI)) * (3.0 * n.z * n.z - 1.0);
+    SH[7] = -sqrt(15.0 / (4.0 * PI)) * n.x * n.z;
+    SH[8] =  sqrt(15.0 / (16.0 * PI)) * (n.x * n.x - n.y * n.y);
+
+    vec3 result = vec3(0.0);
+    for (int i = 0; i < 9; i++) {
+        vec3 c = pcaMean[i];
+        for (int k = 0; k < pcaComponents; k++) {
+            c += pcaWeights[k + 1] * pcaBasis[k * 9 + i];
+        }
+        result += c * SH[i];
+    }
+    return result * pcaWeights[0];
 }
 
 
@@ -148,10 +194,23 @@ void main()
     vec3 v = normalize(cameraPos - WorldPos);
     vec3 r = reflect(-v, n);
 
-    //vec3 irradiance = calcIrradianceZH3(n);
-    //vec3 irradiance = calcIrradianceSH3_mine(n);
-    //vec3 irradiance = calcIrradianceSH2_mine(n);
+    // main.cpp builds one variant per reconstruction through xProgramCache, defining
+    // exactly one of these; the functions a variant never calls compile away.
+#if defined(IRRADIANCE_ZH3)
+    vec3 irradiance = calcIrradianceZH3(n);
+#elif defined(IRRADIANCE_SH3)
+    vec3 irradiance = calcIrradianceSH3_mine(n);
+#elif defined(IRRADIANCE_SH2)
+    vec3 irradiance = calcIrradianceSH2_mine(n);
+#elif defined(IRRADIANCE_HALLUCINATED)
+    vec3 irradiance = calcIrradianceHallucinated(n);
+#elif defined(IRRADIANCE_PACKED_ZH3)
+    vec3 irradiance = calcIrradiancePackedZH3(n);
+#elif defined(IRRADIANCE_PCA)
+    vec3 irradiance = calcIrradiancePCA(n);
+#else
     vec3 irradiance = calcIrradianceShared(n);
+#endif
     vec3 reflection = texture(envMap, angularUV(r)).rgb;
     irradiance *= weight;
     vec3 color = vec3(pow(irradiance, vec3(1.0 / 2.2))) ;
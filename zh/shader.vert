@@ -5,12 +5,18 @@ layout(location = 1) in vec3 aNormal;
 out vec3 WorldPos;
 out vec3 Normal;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+layout(std140) uniform FrameConstants {
+    mat4 view;
+    mat4 projection;
+    vec3 cameraPos;
+};
+layout(std140) uniform ObjectConstants {
+    mat4 model;
+    mat3 normalMatrix;  // transpose(inverse(mat3(model))), computed on the CPU
+};
 
 void main() {
     WorldPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;
+    Normal = normalMatrix * aNormal;
     gl_Position = projection * view * vec4(WorldPos, 1.0);
 }
@@ -0,0 +1,92 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec3 WorldPos;
+in vec3 Normal;
+
+layout(std140) uniform FrameConstants {
+    mat4 view;
+    mat4 projection;
+    vec3 cameraPos;
+};
+uniform sampler2D envMap;
+uniform float weight;
+
+// Local probes assigned to view-frustum clusters by buildClusters (local_probes.h).
+// localProbes holds 5 texels per probe: position and radius, then the 15 ZH3 floats.
+// clusterRanges holds the offset and count of every cluster's list in clusterIndices.
+uniform samplerBuffer localProbes;
+uniform usamplerBuffer clusterRanges;
+uniform usamplerBuffer clusterIndices;
+uniform vec3 clusterDim;    // tiles across, tiles up, depth slices
+uniform vec2 clusterDepth;  // near and far depth of the slices
+uniform vec2 screenSize;
+
+// ZH3 storage of the environment, filling in where local weights sum below one.
+uniform vec3 globalZH3[5];
+
+const float PI = 3.14159265359;
+
+#include "zh3_common.glsl"
+
+// Blend the coefficients of the probes listed for this fragment's cluster before a
+// single reconstruction, so the cost follows how many probes overlap here rather than
+// how many exist.
+vec3 calcIrradianceClustered(vec3 p, vec3 n)
+{
+    float depth = -(view * vec4(p, 1.0)).z;
+    float slice = floor(log(max(depth, clusterDepth.x) / clusterDepth.x) / log(clusterDepth.y / clusterDepth.x) * clusterDim.z);
+    vec3 cell = min(vec3(floor(gl_FragCoord.xy / screenSize * clusterDim.xy), slice), clusterDim - 1.0);
+    int cluster = int((cell.z * clusterDim.y + cell.y) * clusterDim.x + cell.x);
+    uvec2 range = texelFetch(clusterRanges, cluster).xy;
+
+    vec3 c[5];
+    for (int i = 0; i < 5; i++) c[i] = vec3(0.0);
+    float total = 0.0;
+    for (uint i = 0u; i < range.y; i++) {
+        int base = int(texelFetch(clusterIndices, int(range.x + i)).x) * 5;
+        vec4 t0 = texelFetch(localProbes, base);
+        vec3 d = p - t0.xyz;
+        float f = clamp(1.0 - dot(d, d) / (t0.w * t0.w), 0.0, 1.0);
+        float w = f * f;
+        if (w <= 0.0) continue;
+        vec4 t1 = texelFetch(localProbes, base + 1);
+        vec4 t2 = texelFetch(localProbes, base + 2);
+        vec4 t3 = texelFetch(localProbes, base + 3);
+        vec4 t4 = texelFetch(localProbes, base + 4);
+        c[0] += w * t1.xyz;
+        c[1] += w * vec3(t1.w, t2.xy);
+        c[2] += w * vec3(t2.zw, t3.x);
+        c[3] += w * t3.yzw;
+        c[4] += w * t4.xyz;
+        total += w;
+    }
+    float scale = 1.0 / max(total, 1.0);
+    float rest = max(1.0 - total, 0.0);
+    for (int i = 0; i < 5; i++) c[i] = c[i] * scale + globalZH3[i] * rest;
+    return evalZH3(c, n);
+}
+
+vec2 angularUV(vec3 dir)
+{
+    dir = normalize(dir);
+    float m = 2.0 * sqrt(dir.x * dir.x + dir.y * dir.y + (dir.z + 1.0) * (dir.z + 1.0));
+    if (m < 1e-5) return vec2(0.5, 0.5);
+    return dir.xy / m + 0.5;
+}
+
+void main()
+{
+    vec3 n = normalize(Normal);
+    vec3 v = normalize(cameraPos - WorldPos);
+    vec3 r = reflect(-v, n);
+
+    vec3 irradiance = calcIrradianceClustered(WorldPos, n);
+    vec3 reflection = texture(envMap, angularUV(r)).rgb;
+    irradiance *= weight;
+    vec3 color = vec3(pow(max(irradiance, vec3(0.0)), vec3(1.0 / 2.2)));
+    color *= 0.95;
+    color += reflection * 0.05;
+
+    FragColor = vec4(color, 1.0);
+}
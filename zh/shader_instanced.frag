@@ -0,0 +1,20 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec3 WorldPos;
+in vec3 Normal;
+flat in vec3 zhAxis;
+flat in vec3 zhL0;
+flat in mat3 zhL1;
+flat in vec3 zhK2;
+
+uniform float weight;
+
+// calcIrradianceShared of shader.frag with the packet of this instance.
+void main()
+{
+    vec3 n = normalize(Normal);
+    float t = dot(zhAxis, n);
+    vec3 irradiance = (zhL0 + zhL1 * n + zhK2 * (t * t)) * weight;
+    FragColor = vec4(pow(max(irradiance, vec3(0.0)), vec3(1.0 / 2.2)), 1.0);
+}
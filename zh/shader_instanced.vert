@@ -0,0 +1,38 @@
+#version 330 core
+layout(location = 0) in vec3 aPos;
+layout(location = 1) in vec3 aNormal;
+
+out vec3 WorldPos;
+out vec3 Normal;
+flat out vec3 zhAxis;
+flat out vec3 zhL0;
+flat out mat3 zhL1;
+flat out vec3 zhK2;
+
+layout(std140) uniform FrameConstants {
+    mat4 view;
+    mat4 projection;
+    vec3 cameraPos;
+};
+
+// 6 texels per instance: position and radius, then the ZH3Packet that fitZH3Shared
+// (zh3_fit.h) fitted for it on the CPU, in field order and padded by two floats.
+uniform samplerBuffer instanceProbes;
+
+void main() {
+    int base = gl_InstanceID * 6;
+    vec4 placement = texelFetch(instanceProbes, base);
+    vec4 a = texelFetch(instanceProbes, base + 1);
+    vec4 b = texelFetch(instanceProbes, base + 2);
+    vec4 c = texelFetch(instanceProbes, base + 3);
+    vec4 d = texelFetch(instanceProbes, base + 4);
+    vec4 e = texelFetch(instanceProbes, base + 5);
+    zhAxis = a.xyz;
+    zhL0 = vec3(a.w, b.xy);
+    zhL1 = mat3(vec3(b.zw, c.x), c.yzw, d.xyz);
+    zhK2 = vec3(d.w, e.xy);
+
+    WorldPos = placement.xyz + aPos * placement.w;
+    Normal = aNormal;
+    gl_Position = projection * view * vec4(WorldPos, 1.0);
+}
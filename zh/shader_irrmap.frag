@@ -0,0 +1,50 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec3 WorldPos;
+in vec3 Normal;
+
+layout(std140) uniform FrameConstants {
+    mat4 view;
+    mat4 projection;
+    vec3 cameraPos;
+};
+uniform sampler2D envMap;
+uniform sampler2D irradianceMap;
+uniform float weight;
+
+// Same layout as octahedralEncode in irradiance_map.cpp.
+vec2 octahedralUV(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 p = n.xy;
+    if (n.z < 0.0) {
+        vec2 s = vec2(p.x >= 0.0 ? 1.0 : -1.0, p.y >= 0.0 ? 1.0 : -1.0);
+        p = (1.0 - abs(p.yx)) * s;
+    }
+    return p * 0.5 + 0.5;
+}
+
+vec2 angularUV(vec3 dir)
+{
+    dir = normalize(dir);
+    float m = 2.0 * sqrt(dir.x * dir.x + dir.y * dir.y + (dir.z + 1.0) * (dir.z + 1.0));
+    if (m < 1e-5) return vec2(0.5, 0.5);
+    return dir.xy / m + 0.5;
+}
+
+void main()
+{
+    vec3 n = normalize(Normal);
+    vec3 v = normalize(cameraPos - WorldPos);
+    vec3 r = reflect(-v, n);
+
+    vec3 irradiance = texture(irradianceMap, octahedralUV(n)).rgb;
+    vec3 reflection = texture(envMap, angularUV(r)).rgb;
+    irradiance *= weight;
+    vec3 color = vec3(pow(irradiance, vec3(1.0 / 2.2))) ;
+    color *= 0.95;
+    color += reflection * 0.05;
+
+    FragColor = vec4(color, 1.0);
+}
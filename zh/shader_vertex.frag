@@ -0,0 +1,39 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec3 WorldPos;
+in vec3 Normal;
+in vec3 Irradiance;
+
+layout(std140) uniform FrameConstants {
+    mat4 view;
+    mat4 projection;
+    vec3 cameraPos;
+};
+uniform sampler2D envMap;
+uniform float weight;
+
+vec2 angularUV(vec3 dir)
+{
+    dir = normalize(dir);
+    float m = 2.0 * sqrt(dir.x * dir.x + dir.y * dir.y + (dir.z + 1.0) * (dir.z + 1.0));
+    if (m < 1e-5) return vec2(0.5, 0.5);
+    return dir.xy / m + 0.5;
+}
+
+void main()
+{
+    vec3 n = normalize(Normal);
+    vec3 v = normalize(cameraPos - WorldPos);
+    vec3 r = reflect(-v, n);
+
+    // Baked per vertex on the CPU, only interpolated here.
+    vec3 irradiance = Irradiance;
+    vec3 reflection = texture(envMap, angularUV(r)).rgb;
+    irradiance *= weight;
+    vec3 color = vec3(pow(irradiance, vec3(1.0 / 2.2))) ;
+    color *= 0.95;
+    color += reflection * 0.05;
+
+    FragColor = vec4(color, 1.0);
+}
@@ -0,0 +1,25 @@
+#version 330 core
+layout(location = 0) in vec3 aPos;
+layout(location = 1) in vec3 aNormal;
+layout(location = 2) in vec3 aIrradiance;
+
+out vec3 WorldPos;
+out vec3 Normal;
+out vec3 Irradiance;
+
+layout(std140) uniform FrameConstants {
+    mat4 view;
+    mat4 projection;
+    vec3 cameraPos;
+};
+layout(std140) uniform ObjectConstants {
+    mat4 model;
+    mat3 normalMatrix;  // transpose(inverse(mat3(model))), computed on the CPU
+};
+
+void main() {
+    WorldPos = vec3(model * vec4(aPos, 1.0));
+    Normal = normalMatrix * aNormal;
+    Irradiance = aIrradiance;
+    gl_Position = projection * view * vec4(WorldPos, 1.0);
+}
@@ -0,0 +1,166 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec3 WorldPos;
+in vec3 Normal;
+
+layout(std140) uniform FrameConstants {
+    mat4 view;
+    mat4 projection;
+    vec3 cameraPos;
+};
+uniform sampler2D envMap;
+uniform float weight;
+
+// Probe grid baked by bakeProbeVolume (probe_volume.h). Each record is split over
+// consecutive 3D textures that are sampled with hardware trilinear filtering, so the
+// coefficients are interpolated between the eight surrounding probes before the
+// reconstruction below.
+uniform sampler3D volume0;
+uniform sampler3D volume1;
+uniform sampler3D volume2;
+uniform sampler3D volume3;
+uniform sampler3D volume4;
+uniform sampler3D volume5;
+uniform sampler3D volume6;
+uniform int volumeFormat;   // VolumeFormat
+uniform vec3 volumeMin;     // position of probe (0, 0, 0)
+uniform vec3 volumeMax;     // position of the last probe
+uniform vec3 volumeDim;     // probes along each axis
+
+// Sparse brick map of probe_brick_map.h, or the resident pages of probe_pager.h,
+// instead: volume0..6 hold the brick atlas and brickIndirection the atlas slot of
+// every brick. volumeMax is then the position of probe (brickProbes - 1) * brickGrid.
+uniform bool useBrickMap;
+uniform usampler3D brickIndirection;
+uniform vec3 brickGrid;     // bricks along each axis
+uniform vec3 atlasBricks;   // bricks along each atlas axis
+uniform float brickProbes;  // probes along each brick edge
+
+// Two-level probe field of probe_lod.h: volume0..2 hold L0 and L1 of every probe in
+// the VOLUME_ZH3_HALF layout and volume3 an atlas of K2 blocks, laid out like bricks,
+// for the blocks near the camera. Stored K2 fades into hallucinated K2 across
+// lodBand, and blocks in atlas slot 0 have no K2 and use the hallucinated form alone.
+uniform bool useLod;
+uniform vec2 lodBand;       // distances from cameraPos where the fade starts and ends
+
+const float PI = 3.14159265359;
+const int VOLUME_SH3_HALF = 0;
+const int VOLUME_ZH3_HALF = 1;
+const int VOLUME_ZH3_RATIO8 = 2;
+
+#include "zh3_common.glsl"
+
+// Probes sit on the texel centers, so the ends of the grid map half a texel inward.
+vec3 volumeUVW(vec3 p)
+{
+    vec3 t = clamp((p - volumeMin) / (volumeMax - volumeMin), 0.0, 1.0);
+    return (0.5 + t * (volumeDim - 1.0)) / volumeDim;
+}
+
+// A brick's probes span one spacing fewer and share the faces with their neighbours,
+// so sampling stays between its own texel centers and never filters across the atlas.
+vec3 brickUVW(vec3 p, out vec3 slot)
+{
+    float span = brickProbes - 1.0;
+    vec3 f = clamp((p - volumeMin) / (volumeMax - volumeMin), 0.0, 1.0) * (span * brickGrid);
+    vec3 brick = min(floor(f / span), brickGrid - 1.0);
+    slot = vec3(texelFetch(brickIndirection, ivec3(brick), 0).xyz);
+    return (slot * brickProbes + 0.5 + (f - span * brick)) / (atlasBricks * brickProbes);
+}
+
+vec3 evalSH3(vec3 c[9], vec3 n)
+{
+    vec3 result = c[0] * (1.0 / (2.0 * sqrt(PI)))
+        - c[1] * (sqrt(3.0 / (4.0 * PI)) * n.y)
+        + c[2] * (sqrt(3.0 / (4.0 * PI)) * n.z)
+        - c[3] * (sqrt(3.0 / (4.0 * PI)) * n.x);
+    result += c[4] * (sqrt(15.0 / (4.0 * PI)) * n.x * n.y)
+        - c[5] * (sqrt(15.0 / (4.0 * PI)) * n.y * n.z)
+        + c[6] * (sqrt(5.0 / (16.0 * PI)) * (3.0 * n.z * n.z - 1.0))
+        - c[7] * (sqrt(15.0 / (4.0 * PI)) * n.x * n.z)
+        + c[8] * (sqrt(15.0 / (16.0 * PI)) * (n.x * n.x - n.y * n.y));
+    return result;
+}
+
+vec3 calcIrradianceVolume(vec3 p, vec3 n)
+{
+    vec3 slot = vec3(1.0);
+    vec3 uvw = useBrickMap ? brickUVW(p, slot) : volumeUVW(p);
+    vec3 k2UVW = useLod ? brickUVW(p, slot) : uvw;
+    vec4 t0 = texture(volume0, uvw);
+    vec4 t1 = texture(volume1, uvw);
+    vec4 t2 = texture(volume2, uvw);
+    // Far LOD blocks (slot 0) have no K2 in the atlas and skip the fetch. The volumes
+    // have no mips, so the explicit level is what texture() would pick anyway.
+    vec4 t3 = vec4(0.0);
+    if (!useLod || slot != vec3(0.0)) {
+        t3 = textureLod(volume3, k2UVW, 0.0);
+    }
+
+    if (volumeFormat == VOLUME_SH3_HALF) {
+        // 27 halves in 7 RGBA16F texels, coefficient-major.
+        vec4 t4 = texture(volume4, uvw);
+        vec4 t5 = texture(volume5, uvw);
+        vec4 t6 = texture(volume6, uvw);
+        vec3 c[9];
+        c[0] = t0.xyz;
+        c[1] = vec3(t0.w, t1.xy);
+        c[2] = vec3(t1.zw, t2.x);
+        c[3] = t2.yzw;
+        c[4] = t3.xyz;
+        c[5] = vec3(t3.w, t4.xy);
+        c[6] = vec3(t4.zw, t5.x);
+        c[7] = t5.yzw;
+        c[8] = t6.xyz;
+        return evalSH3(c, n);
+    }
+
+    vec3 c[5];
+    if (volumeFormat == VOLUME_ZH3_HALF) {
+        c[0] = t0.xyz;
+        c[1] = vec3(t0.w, t1.xy);
+        c[2] = vec3(t1.zw, t2.x);
+        c[3] = t2.yzw;
+        c[4] = t3.xyz;
+        if (useLod) {
+            vec3 hallucinated = hallucinateK2(c);
+            c[4] = slot == vec3(0.0) ? hallucinated
+                : mix(c[4], hallucinated, smoothstep(lodBand.x, lodBand.y, distance(p, cameraPos)));
+        }
+    }
+    else {
+        // RGB9_E5 L0 and RGBA8_SNORM ratios; the filtered ratios are applied to the
+        // filtered L0, which is exact wherever neighbouring probes share their chroma.
+        c[0] = t0.rgb;
+        c[1] = vec3(t1.xyz) * 1.2 * c[0];
+        c[2] = vec3(t1.w, t2.xy) * 1.2 * c[0];
+        c[3] = vec3(t2.zw, t3.x) * 1.2 * c[0];
+        c[4] = t3.yzw * 0.6 * c[0];
+    }
+    return evalZH3(c, n);
+}
+
+vec2 angularUV(vec3 dir)
+{
+    dir = normalize(dir);
+    float m = 2.0 * sqrt(dir.x * dir.x + dir.y * dir.y + (dir.z + 1.0) * (dir.z + 1.0));
+    if (m < 1e-5) return vec2(0.5, 0.5);
+    return dir.xy / m + 0.5;
+}
+
+void main()
+{
+    vec3 n = normalize(Normal);
+    vec3 v = normalize(cameraPos - WorldPos);
+    vec3 r = reflect(-v, n);
+
+    vec3 irradiance = calcIrradianceVolume(WorldPos, n);
+    vec3 reflection = texture(envMap, angularUV(r)).rgb;
+    irradiance *= weight;
+    vec3 color = vec3(pow(max(irradiance, vec3(0.0)), vec3(1.0 / 2.2)));
+    color *= 0.95;
+    color += reflection * 0.05;
+
+    FragColor = vec4(color, 1.0);
+}
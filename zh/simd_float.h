@@ -0,0 +1,159 @@
+// simd_float.h
+#pragma once
+#include <math.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SIMD_FLOAT_SSE
+#endif
+#if defined(__AVX__)
+#define SIMD_FLOAT_AVX
+#endif
+#if defined(__AVX512F__)
+#define SIMD_FLOAT_AVX512
+#endif
+
+#if defined(SIMD_FLOAT_SSE) || defined(SIMD_FLOAT_AVX) || defined(SIMD_FLOAT_AVX512)
+#include <immintrin.h>
+#endif
+
+// N float lanes with the arithmetic the SH evaluation templates need, so the same
+// source runs on float, double or FloatN<4/8/16>. Widths without a matching
+// instruction set enabled fall back to plain loops over an array.
+template <int N>
+struct FloatN {
+    float v[N];
+
+    FloatN() {}
+    FloatN(float s) { for (int i = 0; i < N; ++i) v[i] = s; }
+    static FloatN load(const float* p) { FloatN r; for (int i = 0; i < N; ++i) r.v[i] = p[i]; return r; }
+    void store(float* p) const { for (int i = 0; i < N; ++i) p[i] = v[i]; }
+};
+
+template <int N> inline FloatN<N> operator+(FloatN<N> a, FloatN<N> b) { for (int i = 0; i < N; ++i) a.v[i] += b.v[i]; return a; }
+template <int N> inline FloatN<N> operator-(FloatN<N> a, FloatN<N> b) { for (int i = 0; i < N; ++i) a.v[i] -= b.v[i]; return a; }
+template <int N> inline FloatN<N> operator*(FloatN<N> a, FloatN<N> b) { for (int i = 0; i < N; ++i) a.v[i] *= b.v[i]; return a; }
+template <int N> inline FloatN<N> operator/(FloatN<N> a, FloatN<N> b) { for (int i = 0; i < N; ++i) a.v[i] /= b.v[i]; return a; }
+template <int N> inline FloatN<N> operator-(FloatN<N> a) { for (int i = 0; i < N; ++i) a.v[i] = -a.v[i]; return a; }
+template <int N> inline FloatN<N> sqrt(FloatN<N> a) { for (int i = 0; i < N; ++i) a.v[i] = sqrtf(a.v[i]); return a; }
+template <int N> inline FloatN<N> abs(FloatN<N> a) { for (int i = 0; i < N; ++i) a.v[i] = fabsf(a.v[i]); return a; }
+template <int N> inline FloatN<N> max(FloatN<N> a, FloatN<N> b) { for (int i = 0; i < N; ++i) a.v[i] = a.v[i] > b.v[i] ? a.v[i] : b.v[i]; return a; }
+template <int N> inline FloatN<N> min(FloatN<N> a, FloatN<N> b) { for (int i = 0; i < N; ++i) a.v[i] = a.v[i] < b.v[i] ? a.v[i] : b.v[i]; return a; }
+
+// Comparisons return lane masks, all bits set where they hold and clear elsewhere, for
+// maskAnd, select and anyLane. NaN lanes compare false.
+inline float simdMaskLane(bool b) { unsigned int u = b ? 0xffffffffu : 0u; float f; memcpy(&f, &u, 4); return f; }
+inline bool simdLaneSet(float f) { unsigned int u; memcpy(&u, &f, 4); return u != 0; }
+template <int N> inline FloatN<N> lessThan(FloatN<N> a, FloatN<N> b) { for (int i = 0; i < N; ++i) a.v[i] = simdMaskLane(a.v[i] < b.v[i]); return a; }
+template <int N> inline FloatN<N> lessEqual(FloatN<N> a, FloatN<N> b) { for (int i = 0; i < N; ++i) a.v[i] = simdMaskLane(a.v[i] <= b.v[i]); return a; }
+template <int N> inline FloatN<N> maskAnd(FloatN<N> a, FloatN<N> b) { for (int i = 0; i < N; ++i) a.v[i] = simdMaskLane(simdLaneSet(a.v[i]) && simdLaneSet(b.v[i])); return a; }
+template <int N> inline FloatN<N> select(FloatN<N> mask, FloatN<N> a, FloatN<N> b) { for (int i = 0; i < N; ++i) a.v[i] = simdLaneSet(mask.v[i]) ? a.v[i] : b.v[i]; return a; }
+template <int N> inline bool anyLane(FloatN<N> mask) { for (int i = 0; i < N; ++i) if (simdLaneSet(mask.v[i])) return true; return false; }
+
+#ifdef SIMD_FLOAT_SSE
+template <>
+struct FloatN<4> {
+    __m128 v;
+
+    FloatN() {}
+    FloatN(float s) : v(_mm_set1_ps(s)) {}
+    FloatN(__m128 m) : v(m) {}
+    static FloatN load(const float* p) { return FloatN(_mm_loadu_ps(p)); }
+    void store(float* p) const { _mm_storeu_ps(p, v); }
+};
+
+inline FloatN<4> operator+(FloatN<4> a, FloatN<4> b) { return _mm_add_ps(a.v, b.v); }
+inline FloatN<4> operator-(FloatN<4> a, FloatN<4> b) { return _mm_sub_ps(a.v, b.v); }
+inline FloatN<4> operator*(FloatN<4> a, FloatN<4> b) { return _mm_mul_ps(a.v, b.v); }
+inline FloatN<4> operator/(FloatN<4> a, FloatN<4> b) { return _mm_div_ps(a.v, b.v); }
+inline FloatN<4> operator-(FloatN<4> a) { return _mm_xor_ps(a.v, _mm_set1_ps(-0.0f)); }
+inline FloatN<4> sqrt(FloatN<4> a) { return _mm_sqrt_ps(a.v); }
+inline FloatN<4> abs(FloatN<4> a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v); }
+inline FloatN<4> max(FloatN<4> a, FloatN<4> b) { return _mm_max_ps(a.v, b.v); }
+inline FloatN<4> min(FloatN<4> a, FloatN<4> b) { return _mm_min_ps(a.v, b.v); }
+inline FloatN<4> lessThan(FloatN<4> a, FloatN<4> b) { return _mm_cmplt_ps(a.v, b.v); }
+inline FloatN<4> lessEqual(FloatN<4> a, FloatN<4> b) { return _mm_cmple_ps(a.v, b.v); }
+inline FloatN<4> maskAnd(FloatN<4> a, FloatN<4> b) { return _mm_and_ps(a.v, b.v); }
+inline FloatN<4> select(FloatN<4> mask, FloatN<4> a, FloatN<4> b) { return _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v)); }
+inline bool anyLane(FloatN<4> mask) { return _mm_movemask_ps(mask.v) != 0; }
+#endif
+
+#ifdef SIMD_FLOAT_AVX
+template <>
+struct FloatN<8> {
+    __m256 v;
+
+    FloatN() {}
+    FloatN(float s) : v(_mm256_set1_ps(s)) {}
+    FloatN(__m256 m) : v(m) {}
+    static FloatN load(const float* p) { return FloatN(_mm256_loadu_ps(p)); }
+    void store(float* p) const { _mm256_storeu_ps(p, v); }
+};
+
+inline FloatN<8> operator+(FloatN<8> a, FloatN<8> b) { return _mm256_add_ps(a.v, b.v); }
+inline FloatN<8> operator-(FloatN<8> a, FloatN<8> b) { return _mm256_sub_ps(a.v, b.v); }
+inline FloatN<8> operator*(FloatN<8> a, FloatN<8> b) { return _mm256_mul_ps(a.v, b.v); }
+inline FloatN<8> operator/(FloatN<8> a, FloatN<8> b) { return _mm256_div_ps(a.v, b.v); }
+inline FloatN<8> operator-(FloatN<8> a) { return _mm256_xor_ps(a.v, _mm256_set1_ps(-0.0f)); }
+inline FloatN<8> sqrt(FloatN<8> a) { return _mm256_sqrt_ps(a.v); }
+inline FloatN<8> abs(FloatN<8> a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v); }
+inline FloatN<8> max(FloatN<8> a, FloatN<8> b) { return _mm256_max_ps(a.v, b.v); }
+inline FloatN<8> min(FloatN<8> a, FloatN<8> b) { return _mm256_min_ps(a.v, b.v); }
+inline FloatN<8> lessThan(FloatN<8> a, FloatN<8> b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ); }
+inline FloatN<8> lessEqual(FloatN<8> a, FloatN<8> b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ); }
+inline FloatN<8> maskAnd(FloatN<8> a, FloatN<8> b) { return _mm256_and_ps(a.v, b.v); }
+inline FloatN<8> select(FloatN<8> mask, FloatN<8> a, FloatN<8> b) { return _mm256_blendv_ps(b.v, a.v, mask.v); }
+inline bool anyLane(FloatN<8> mask) { return _mm256_movemask_ps(mask.v) != 0; }
+#endif
+
+#ifdef SIMD_FLOAT_AVX512
+template <>
+struct FloatN<16> {
+    __m512 v;
+
+    FloatN() {}
+    FloatN(float s) : v(_mm512_set1_ps(s)) {}
+    FloatN(__m512 m) : v(m) {}
+    static FloatN load(const float* p) { return FloatN(_mm512_loadu_ps(p)); }
+    void store(float* p) const { _mm512_storeu_ps(p, v); }
+};
+
+inline FloatN<16> operator+(FloatN<16> a, FloatN<16> b) { return _mm512_add_ps(a.v, b.v); }
+inline FloatN<16> operator-(FloatN<16> a, FloatN<16> b) { return _mm512_sub_ps(a.v, b.v); }
+inline FloatN<16> operator*(FloatN<16> a, FloatN<16> b) { return _mm512_mul_ps(a.v, b.v); }
+inline FloatN<16> operator/(FloatN<16> a, FloatN<16> b) { return _mm512_div_ps(a.v, b.v); }
+inline FloatN<16> operator-(FloatN<16> a) { return _mm512_sub_ps(_mm512_setzero_ps(), a.v); }
+inline FloatN<16> sqrt(FloatN<16> a) { return _mm512_sqrt_ps(a.v); }
+inline FloatN<16> abs(FloatN<16> a) { return _mm512_abs_ps(a.v); }
+inline FloatN<16> max(FloatN<16> a, FloatN<16> b) { return _mm512_max_ps(a.v, b.v); }
+inline FloatN<16> min(FloatN<16> a, FloatN<16> b) { return _mm512_min_ps(a.v, b.v); }
+// AVX-512 compares into mask registers; lanes are widened back to bit masks so the
+// interface matches the narrower widths.
+inline FloatN<16> simdMaskFromBits(__mmask16 k) { return _mm512_castsi512_ps(_mm512_maskz_set1_epi32(k, -1)); }
+inline __mmask16 simdBitsFromMask(FloatN<16> m) { return _mm512_test_epi32_mask(_mm512_castps_si512(m.v), _mm512_castps_si512(m.v)); }
+inline FloatN<16> lessThan(FloatN<16> a, FloatN<16> b) { return simdMaskFromBits(_mm512_cmp_ps_mask(a.v, b.v, _CMP_LT_OQ)); }
+inline FloatN<16> lessEqual(FloatN<16> a, FloatN<16> b) { return simdMaskFromBits(_mm512_cmp_ps_mask(a.v, b.v, _CMP_LE_OQ)); }
+inline FloatN<16> maskAnd(FloatN<16> a, FloatN<16> b) { return _mm512_castsi512_ps(_mm512_and_si512(_mm512_castps_si512(a.v), _mm512_castps_si512(b.v))); }
+inline FloatN<16> select(FloatN<16> mask, FloatN<16> a, FloatN<16> b) { return _mm512_mask_blend_ps(simdBitsFromMask(mask), b.v, a.v); }
+inline bool anyLane(FloatN<16> mask) { return simdBitsFromMask(mask) != 0; }
+#endif
+
+template <int N> inline FloatN<N>& operator+=(FloatN<N>& a, FloatN<N> b) { return a = a + b; }
+template <int N> inline FloatN<N>& operator-=(FloatN<N>& a, FloatN<N> b) { return a = a - b; }
+template <int N> inline FloatN<N>& operator*=(FloatN<N>& a, FloatN<N> b) { return a = a * b; }
+template <int N> inline FloatN<N>& operator/=(FloatN<N>& a, FloatN<N> b) { return a = a / b; }
+
+typedef FloatN<4> Float4;
+typedef FloatN<8> Float8;
+typedef FloatN<16> Float16;
+
+// Widest lane count the build's instruction set handles natively.
+#if defined(SIMD_FLOAT_AVX512)
+#define SIMD_FLOAT_WIDTH 16
+#elif defined(SIMD_FLOAT_AVX)
+#define SIMD_FLOAT_WIDTH 8
+#else
+#define SIMD_FLOAT_WIDTH 4
+#endif
+
+typedef FloatN<SIMD_FLOAT_WIDTH> FloatW;
@@ -3,8 +3,11 @@ layout (location = 0) in vec3 aPos;
 
 out vec3 WorldDir;
 
-uniform mat4 view;
-uniform mat4 projection;
+layout(std140) uniform FrameConstants {
+    mat4 view;
+    mat4 projection;
+    vec3 cameraPos;
+};
 
 void main()
 {
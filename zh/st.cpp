@@ -117,28 +117,41 @@ void SH3_InDirection(vec3 direction, out float sh[9]) {
      sh[8] = 0.25 * sqrt(15.0 / PI) * (direction.x * direction.x - direction.y * direction.y);
 }
 
+// Per-band zonal coefficients of the normalized cosine lobe.
+const vec3 cosLobe = vec3(1.0, 2.0 / 3.0, 0.25);
+
+// Convolve linear SH with a zonal kernel given by its per-band coefficients.
+void SH2_Conv(inout float sh[4], vec3 kernel) {
+    sh[0] *= kernel.x;
+    
+    sh[1] *= kernel.y;
+    sh[2] *= kernel.y;
+    sh[3] *= kernel.y;
+}
+
+// Convolve quadratic SH with a zonal kernel given by its per-band coefficients.
+void SH3_Conv(inout float sh[9], vec3 kernel) {
+    sh[0] *= kernel.x;
+    
+    sh[1] *= kernel.y;
+    sh[2] *= kernel.y;
+    sh[3] *= kernel.y;
+    
+    sh[4] *= kernel.z;
+    sh[5] *= kernel.z;
+    sh[6] *= kernel.z;
+    sh[7] *= kernel.z;
+    sh[8] *= kernel.z;
+}
+
 // Convolve linear SH with a normalized cosine lobe to produce an irradiance function.
 void SH2_ConvCos(inout float sh[4]) {
-    sh[0] *= 1.0;
-    
-    sh[1] *= 2.0 / 3.0;
-    sh[2] *= 2.0 / 3.0;
-    sh[3] *= 2.0 / 3.0;
+    SH2_Conv(sh, cosLobe);
 }
 
 // Convolve quadratic SH with a normalized cosine lobe to produce an irradiance function.
 void SH3_ConvCos(inout float sh[9]) {
-    sh[0] *= 1.0;
-    
-    sh[1] *= 2.0 / 3.0;
-    sh[2] *= 2.0 / 3.0;
-    sh[3] *= 2.0 / 3.0;
-    
-    sh[4] *= 0.25;
-    sh[5] *= 0.25;
-    sh[6] *= 0.25;
-    sh[7] *= 0.25;
-    sh[8] *= 0.25;
+    SH3_Conv(sh, cosLobe);
 }
 
 // Dot two linear SH vectors, used for reconstructing c in the direction given by sh.
@@ -263,7 +276,7 @@ float ZH3_EvalIrradiance(float sh[9], vec3 normal) {
 
     float linearSH[4] = float[](sh[0], sh[1], sh[2], sh[3]);
     float result = SH2_EvalIrradiance(linearSH, normal);
-    result += 0.25f * zhNormal * zonalL2Coeff;
+    result += cosLobe.z * zhNormal * zonalL2Coeff;
     return result;
 }
 
@@ -297,7 +310,7 @@ vec3 ZH3_EvalIrradianceLumAxis(vec3 sh[9], vec3 normal) {
 
     vec3 linearSH[4] = vec3[](sh[0], sh[1], sh[2], sh[3]);
     vec3 result = SH2_EvalIrradiance(linearSH, normal);
-    result += 0.25f * zhNormal * zonalL2Coeff;
+    result += cosLobe.z * zhNormal * zonalL2Coeff;
     return result;
 }
 
@@ -317,7 +330,7 @@ float ZH3Hallucinate_EvalIrradiance(float sh[4], vec3 normal) {
     float zhNormal = sqrt(5.0f / (16.0f * PI)) * (3.0f * fZ * fZ - 1.0f);
     
     float result = SH2_EvalIrradiance(sh, normal);
-    result += 0.25f * zhNormal * zonalL2Coeff;
+    result += cosLobe.z * zhNormal * zonalL2Coeff;
     return result;
 }
 
@@ -352,7 +365,7 @@ vec3 ZH3Hallucinate_EvalIrradianceLumAxis(vec3 sh[4], vec3 normal) {
     float zhNormal = sqrt(5.0f / (16.0f * PI)) * (3.0f * fZ * fZ - 1.0f);
 
     vec3 result = SH2_EvalIrradiance(sh, normal);
-    result += 0.25f * zhNormal * zonalL2Coeff;
+    result += cosLobe.z * zhNormal * zonalL2Coeff;
     return result;
 }
 
@@ -0,0 +1,157 @@
+#include "stand_in_scene.h"
+#include "probe_quantize.h"
+#include "zh3_fit.h"
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+#define PI 3.14159265358979
+
+void initStandInScene(const float environment[9][3], StandInScene& scene) {
+    memcpy(scene.environment, environment, sizeof(scene.environment));
+    const float lightPos[3] = { 1.2f, 1.0f, 1.4f };
+    float luminance = environment[0][0] + environment[0][1] + environment[0][2];
+    const float tint[3] = { 2.0f, 1.4f, 0.8f };
+    for (int j = 0; j < 3; j++) {
+        scene.lightPos[j] = lightPos[j];
+        scene.lightRGB[j] = luminance * tint[j];
+    }
+}
+
+ProbeSource standInProbes(const StandInScene& scene) {
+    return [scene](const float* pos, float (*sh)[3]) {
+        memcpy(sh, scene.environment, sizeof(scene.environment));
+        addPointLightSH(pos, scene.lightPos, scene.lightRGB, sh);
+    };
+}
+
+KeyframeSource standInDayProbes(const StandInScene& scene, const ProbeVolume& volume, const float* times, int keyCount) {
+    std::vector<float> keyTimes(times, times + keyCount);
+    return [scene, volume, keyTimes](int key, int probe, float (*sh)[3]) {
+        float angle = 2.0f * (float)PI * (keyTimes[key] - 0.25f);
+        float height = sinf(angle);
+        float sky = 0.15f + 0.85f * std::max(height, 0.0f);
+        float sun = std::max(height, 0.05f);
+        float sunPos[3] = { 3.0f * cosf(angle), 3.0f * height, 1.0f };
+        const float* rgb = scene.lightRGB;
+        float sunRGB[3] = { rgb[0] * sun, rgb[1] * sun * sun, rgb[2] * sun * sun * sun };
+        float pos[3];
+        int d = volume.dim[0];
+        volumeProbePosition(volume, probe % d, probe / d % volume.dim[1], probe / (d * volume.dim[1]), pos);
+        for (int i = 0; i < 9; i++) {
+            for (int j = 0; j < 3; j++) {
+                sh[i][j] = scene.environment[i][j] * sky;
+            }
+        }
+        addPointLightSH(pos, sunPos, sunRGB, sh);
+    };
+}
+
+ProbeSource standInWorldProbes(const StandInScene& scene) {
+    return [scene](const float* pos, float (*sh)[3]) {
+        memcpy(sh, scene.environment, sizeof(scene.environment));
+        float cellX = floorf(pos[0] / 10.0f), cellZ = floorf(pos[2] / 10.0f);
+        for (int dz = -1; dz <= 1; dz++) {
+            for (int dx = -1; dx <= 1; dx++) {
+                float light[3] = { (cellX + dx) * 10.0f + 3.0f, 1.5f, (cellZ + dz) * 10.0f + 3.0f };
+                addPointLightSH(pos, light, scene.lightRGB, sh);
+            }
+        }
+    };
+}
+
+void sampleProbeGrid(const ProbeVolume& volume, int dim, const ProbeSource& source, std::vector<float>& probes) {
+    ProbeVolume grid = volume;
+    grid.dim[0] = grid.dim[1] = grid.dim[2] = dim;
+    int count = dim * dim * dim;
+    probes.resize((size_t)count * 27);
+    for (int p = 0; p < count; p++) {
+        float pos[3];
+        volumeProbePosition(grid, p % dim, p / dim % dim, p / (dim * dim), pos);
+        source(pos, (float (*)[3])&probes[(size_t)p * 27]);
+    }
+}
+
+void buildSceneBrickMap(const int bricks[3], const float boundsMin[3], const float boundsMax[3], VolumeFormat format,
+    const ProbeSource& source, const float fallback[9][3], BrickMap& map) {
+    std::vector<int> cells;
+    std::vector<float> probes;
+    for (int z = 0; z <= 3 * bricks[2]; z++) {
+        for (int y = 0; y <= 3 * bricks[1]; y++) {
+            for (int x = 0; x <= 3 * bricks[0]; x++) {
+                int cell[3] = { x, y, z };
+                float pos[3], sh[9][3];
+                for (int i = 0; i < 3; i++) {
+                    pos[i] = boundsMin[i] + (boundsMax[i] - boundsMin[i]) * cell[i] / (3.0f * bricks[i]);
+                }
+                float r = sqrtf(pos[0] * pos[0] + pos[1] * pos[1] + pos[2] * pos[2]);
+                if (r < 0.75f || r > 1.25f) {
+                    continue;
+                }
+                source(pos, sh);
+                cells.insert(cells.end(), cell, cell + 3);
+                probes.insert(probes.end(), &sh[0][0], &sh[0][0] + 27);
+            }
+        }
+    }
+    buildBrickMap(bricks, boundsMin, boundsMax, format, cells.empty() ? NULL : &cells[0],
+        probes.empty() ? NULL : &probes[0], (int)(cells.size() / 3), fallback, map);
+}
+
+void placeLocalProbes(int count, const ProbeSource& source, std::vector<LocalProbe>& probes) {
+    probes.resize(count);
+    unsigned int seed = 12345u;
+    for (int p = 0; p < count; p++) {
+        float u[4];
+        for (int i = 0; i < 4; i++) {
+            seed = seed * 1664525u + 1013904223u;
+            u[i] = (seed >> 8) / 16777216.0f;
+        }
+        float sh[9][3];
+        for (int i = 0; i < 3; i++) {
+            probes[p].position[i] = (u[i] - 0.5f) * 12.0f;
+        }
+        probes[p].radius = 0.5f + 1.5f * u[3];
+        source(probes[p].position, sh);
+        packProbe(PROBE_STORAGE_ZH3, sh, probes[p].zh3);
+    }
+}
+
+void placeProbeInstances(int count, const ProbeSource& source, std::vector<float>& texels) {
+    int side = (int)ceilf(cbrtf((float)count));
+    texels.assign((size_t)count * 24, 0.0f);
+    for (int p = 0; p < count; p++) {
+        float* dst = &texels[(size_t)p * 24];
+        int index[3] = { p % side, (p / side) % side, p / (side * side) };
+        for (int i = 0; i < 3; i++) {
+            dst[i] = (index[i] - 0.5f * (side - 1)) * 0.25f;
+        }
+        dst[3] = 0.08f;
+        float sh[9][3];
+        ZH3Packet packet;
+        source(dst, sh);
+        fitZH3Shared(sh, packet);
+        memcpy(dst + 4, &packet, sizeof(packet));
+    }
+}
+
+int buildStandInScene(SceneMesh& mesh) {
+    const float grey[3] = { 0.6f, 0.6f, 0.6f }, red[3] = { 0.7f, 0.1f, 0.1f }, green[3] = { 0.1f, 0.6f, 0.15f };
+    const float dark[3] = { 0.0f, 0.0f, 0.0f }, warm[3] = { 4.0f, 3.2f, 2.4f };
+    int floorMaterial = addSceneMaterial(mesh, "floor", grey, dark);
+    int redMaterial = addSceneMaterial(mesh, "red", red, dark);
+    int greenMaterial = addSceneMaterial(mesh, "green", green, dark);
+    int lightMaterial = addSceneMaterial(mesh, "light", grey, warm);
+    const float floor[4][3] = { { -2.5f, -1.3f, -2.5f }, { -2.5f, -1.3f, 2.5f }, { 2.5f, -1.3f, 2.5f }, { 2.5f, -1.3f, -2.5f } };
+    const float left[4][3] = { { -2.5f, -1.3f, -2.5f }, { -2.5f, 2.0f, -2.5f }, { -2.5f, 2.0f, 2.5f }, { -2.5f, -1.3f, 2.5f } };
+    const float right[4][3] = { { 2.5f, -1.3f, -2.5f }, { 2.5f, -1.3f, 2.5f }, { 2.5f, 2.0f, 2.5f }, { 2.5f, 2.0f, -2.5f } };
+    const float light[4][3] = { { -0.8f, 2.0f, -0.8f }, { 0.8f, 2.0f, -0.8f }, { 0.8f, 2.0f, 0.8f }, { -0.8f, 2.0f, 0.8f } };
+    addSceneQuad(mesh, floor[0], floor[1], floor[2], floor[3], floorMaterial);
+    addSceneQuad(mesh, left[0], left[1], left[2], left[3], redMaterial);
+    addSceneQuad(mesh, right[0], right[1], right[2], right[3], greenMaterial);
+    addSceneQuad(mesh, light[0], light[1], light[2], light[3], lightMaterial);
+    const float blockMin[3] = { -1.2f, -1.3f, 0.8f }, blockMax[3] = { -0.8f, -0.9f, 1.2f };
+    int block = (int)mesh.triangleMaterial.size();
+    addSceneBox(mesh, blockMin, blockMax, floorMaterial);
+    return block;
+}
@@ -0,0 +1,49 @@
+// stand_in_scene.h
+#pragma once
+#include <vector>
+#include "local_probes.h"
+#include "probe_brick_map.h"
+#include "probe_volume.h"
+#include "scene_mesh.h"
+#include "time_of_day.h"
+
+// The analytic scenes the viewer lights its probe systems with: the loaded capture's
+// SH plus point lights added by addPointLightSH, evaluated in closed form at each
+// probe so that any system can be rebuilt on a key press. The dense volume can use
+// the ray-traced room of probe_baker.h instead (buildStandInScene below, or a scene
+// file); the other systems always read these.
+struct StandInScene {
+    float environment[9][3];   // cosine-convolved SH of the loaded capture
+    float lightPos[3];         // warm light beside the sphere
+    float lightRGB[3];
+};
+
+// Place the warm light and scale it to the brightness of environment.
+void initStandInScene(const float environment[9][3], StandInScene& scene);
+// The environment and the warm light at any position.
+ProbeSource standInProbes(const StandInScene& scene);
+// Day cycle over the probes of volume, in volumeProbePosition order: the sun is a
+// point light circling the sphere, captured at each of keyCount times of day, with
+// the sky dimmed at night.
+KeyframeSource standInDayProbes(const StandInScene& scene, const ProbeVolume& volume, const float* times, int keyCount);
+// Streamed world: the environment plus a point light every 10 units over a 120 x 120
+// floor, the nearest nine lights reaching each probe.
+ProbeSource standInWorldProbes(const StandInScene& scene);
+
+// 27 floats per probe of source on a dim^3 grid over the bounds of volume, x fastest.
+void sampleProbeGrid(const ProbeVolume& volume, int dim, const ProbeSource& source, std::vector<float>& probes);
+// Brick map of every probe of the brick grid within reach of the sphere's surface,
+// projected from source.
+void buildSceneBrickMap(const int bricks[3], const float boundsMin[3], const float boundsMax[3], VolumeFormat format,
+    const ProbeSource& source, const float fallback[9][3], BrickMap& map);
+// Hand placement: count probes scattered around the sphere with radii of 0.5 to 2,
+// each projected from source at its center.
+void placeLocalProbes(int count, const ProbeSource& source, std::vector<LocalProbe>& probes);
+// Probe grid for instanced display: count probes on a cube of points 0.25 apart around
+// the sphere, drawn as spheres of radius 0.08. Each gets 6 RGBA32F texels in the
+// layout of shader_instanced.vert: position and radius, then its ZH3Packet.
+void placeProbeInstances(int count, const ProbeSource& source, std::vector<float>& texels);
+// Room for the ray tracer when no scene file is found: a floor under the sphere, a red
+// and a green wall either side, a warm light panel overhead and a small block on the
+// floor. Returns the first triangle of the block, which is added last.
+int buildStandInScene(SceneMesh& mesh);
@@ -0,0 +1,204 @@
+#include "time_of_day.h"
+#include "parallel_for.h"
+#include "zh3_fit.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <fstream>
+
+static const char keyframeMagic[4] = { 'P', 'R', 'T', 'D' };
+
+bool writeProbeKeyframes(const char* path, const float* times, int keyCount, int probeCount, const KeyframeSource& source) {
+    if (keyCount < 1 || keyCount > TOD_MAX_KEYFRAMES) return false;
+    std::ofstream file(path, std::ios::binary);
+    if (!file) return false;
+    int fields[2] = { keyCount, probeCount };
+    file.write(keyframeMagic, 4);
+    file.write((const char*)fields, sizeof(fields));
+    file.write((const char*)times, keyCount * sizeof(float));
+
+    std::vector<float> planes((size_t)27 * probeCount);
+    for (int key = 0; key < keyCount; ++key) {
+        parallelFor(probeCount, 256, [&](int begin, int end) {
+            for (int p = begin; p < end; ++p) {
+                float sh[9][3];
+                source(key, p, sh);
+                for (int i = 0; i < 27; ++i)
+                    planes[(size_t)i * probeCount + p] = (&sh[0][0])[i];
+            }
+        });
+        file.write((const char*)&planes[0], planes.size() * sizeof(float));
+    }
+    return (bool)file;
+}
+
+ProbeTimeOfDay::~ProbeTimeOfDay() {
+    close();
+}
+
+bool ProbeTimeOfDay::open(const char* filePath, float blendStep) {
+    close();
+    std::ifstream file(filePath, std::ios::binary);
+    char magic[4];
+    int fields[2];
+    if (!file.read(magic, 4) || memcmp(magic, keyframeMagic, 4) != 0 || !file.read((char*)fields, sizeof(fields))
+        || fields[0] < 1 || fields[0] > TOD_MAX_KEYFRAMES || fields[1] < 1) {
+        printf("Failed to open probe keyframes %s\n", filePath);
+        return false;
+    }
+    times.resize(fields[0]);
+    if (!file.read((char*)&times[0], times.size() * sizeof(float))) {
+        printf("Failed to open probe keyframes %s\n", filePath);
+        return false;
+    }
+    path = filePath;
+    probes = fields[1];
+    headerBytes = 4 + sizeof(fields) + times.size() * sizeof(float);
+    step = blendStep;
+    for (int s = 0; s < 2; ++s) {
+        slotSH[s].resize((size_t)27 * probes);
+        slotKey[s] = -1;
+    }
+    blendFrom = blendTo = -1;
+    blendedSH.resize((size_t)27 * probes);
+    k2.resize((size_t)3 * probes);
+    blendedZH3.resize((size_t)15 * probes);
+    counters = TimeOfDayStats{ 0, 0, 0, 0.0 };
+
+    quit = false;
+    requestedKey = readingKey = prefetchedKey = -1;
+    loader = std::thread(&ProbeTimeOfDay::loaderMain, this);
+    return true;
+}
+
+void ProbeTimeOfDay::close() {
+    if (!loader.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    wake.notify_all();
+    loader.join();
+    prefetched.clear();
+    prefetchedKey = -1;
+}
+
+void ProbeTimeOfDay::loaderMain() {
+    std::ifstream file(path, std::ios::binary);
+    size_t bytes = (size_t)27 * probes * sizeof(float);
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        wake.wait(lock, [&]() { return quit || requestedKey >= 0; });
+        if (quit) return;
+        int key = requestedKey;
+        requestedKey = -1;
+        readingKey = key;
+        lock.unlock();
+
+        std::vector<float> sh((size_t)27 * probes);
+        file.seekg((std::streamoff)(headerBytes + (size_t)key * bytes));
+        bool ok = (bool)file.read((char*)&sh[0], bytes);
+        file.clear();
+
+        lock.lock();
+        readingKey = -1;
+        if (ok) {
+            prefetched.swap(sh);
+            prefetchedKey = key;
+        }
+        loaded.notify_all();
+    }
+}
+
+void ProbeTimeOfDay::prefetchKeyframe(int key) {
+    if (key == slotKey[0] || key == slotKey[1]) return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (key == prefetchedKey || key == readingKey) return;
+        requestedKey = key;
+    }
+    wake.notify_all();
+}
+
+// Take the keyframe from the loader when it was asked for, waiting for a read still in
+// flight, and read it here otherwise.
+void ProbeTimeOfDay::loadKeyframe(int slot, int key) {
+    counters.keyframeLoads++;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        loaded.wait(lock, [&]() { return readingKey != key && requestedKey != key; });
+        if (prefetchedKey == key) {
+            slotSH[slot].swap(prefetched);
+            prefetchedKey = -1;
+            slotKey[slot] = key;
+            return;
+        }
+    }
+    std::ifstream file(path, std::ios::binary);
+    size_t bytes = slotSH[slot].size() * sizeof(float);
+    file.seekg((std::streamoff)(headerBytes + (size_t)key * bytes));
+    if (!file.read((char*)&slotSH[slot][0], bytes))
+        printf("Failed to read keyframe %d of %s\n", key, path.c_str());
+    slotKey[slot] = key;
+    counters.keyframeStalls++;
+}
+
+bool ProbeTimeOfDay::update(float timeOfDay, WorkerPool& workers) {
+    if (times.empty()) return false;
+    float t = timeOfDay - floorf(timeOfDay);
+    // Keyframes wrap around midnight: from the last of one day to the first of the next.
+    int count = (int)times.size();
+    int to = 0;
+    while (to < count && times[to] <= t) ++to;
+    to %= count;
+    int from = (to + count - 1) % count;
+    float span = times[to] - times[from];
+    float since = t - times[from];
+    if (span <= 0.0f) span += 1.0f;
+    if (since < 0.0f) since += 1.0f;
+    float alpha = count > 1 ? std::min(since / span, 1.0f) : 0.0f;
+
+    if (from == blendFrom && to == blendTo && fabsf(alpha - blendAlpha) < step) return false;
+
+    // Keep whichever of the pair is already resident and read only the other.
+    int slotFrom = slotKey[0] == from ? 0 : (slotKey[1] == from ? 1 : -1);
+    int slotTo = slotKey[0] == to ? 0 : (slotKey[1] == to ? 1 : -1);
+    if (slotFrom < 0) {
+        slotFrom = slotTo == 0 ? 1 : 0;
+        loadKeyframe(slotFrom, from);
+    }
+    if (slotTo < 0) {
+        slotTo = 1 - slotFrom;
+        loadKeyframe(slotTo, to);
+    }
+    // Time runs forward, so the next pair needs the keyframe after this one.
+    if (to != blendTo) prefetchKeyframe((to + 1) % count);
+    blendFrom = from;
+    blendTo = to;
+    blendAlpha = alpha;
+
+    auto start = std::chrono::high_resolution_clock::now();
+    const float* a = &slotSH[slotFrom][0];
+    const float* b = &slotSH[slotTo][0];
+    size_t planeCount = (size_t)27 * probes;
+    workers.run((int)((planeCount + 4095) / 4096), 4, [&](int begin, int end) {
+        size_t lo = (size_t)begin * 4096, hi = std::min(planeCount, (size_t)end * 4096);
+        for (size_t i = lo; i < hi; ++i)
+            blendedSH[i] = a[i] + (b[i] - a[i]) * alpha;
+    });
+    fitZH3K2Batch(ZH3_AXIS_LUMINANCE, &blendedSH[0], probes, probes, &k2[0], probes, workers);
+    workers.run(probes, 1024, [&](int begin, int end) {
+        for (int p = begin; p < end; ++p) {
+            float* dst = &blendedZH3[(size_t)p * 15];
+            for (int i = 0; i < 12; ++i)
+                dst[i] = blendedSH[(size_t)i * probes + p];
+            for (int c = 0; c < 3; ++c)
+                dst[12 + c] = k2[(size_t)c * probes + p];
+        }
+    });
+    auto end = std::chrono::high_resolution_clock::now();
+    counters.refits++;
+    counters.refitSeconds += std::chrono::duration<double>(end - start).count();
+    return true;
+}
@@ -0,0 +1,79 @@
+// time_of_day.h
+#pragma once
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "parallel_for.h"
+
+#define TOD_MAX_KEYFRAMES 24
+
+// Fills sh with the cosine-convolved SH of probe `probe` captured at keyframe `key`.
+typedef std::function<void(int key, int probe, float (*sh)[3])> KeyframeSource;
+
+// Bake keyCount captures of probeCount probes and write them to path: a small header
+// with the capture times, as fractions of a day in increasing order, then each
+// keyframe as 27 SoA planes of probeCount floats. False on I/O failure.
+bool writeProbeKeyframes(const char* path, const float* times, int keyCount, int probeCount, const KeyframeSource& source);
+
+struct TimeOfDayStats {
+    long long keyframeLoads;
+    long long keyframeStalls;   // loads read on the calling thread, not prefetched
+    long long refits;
+    double refitSeconds;
+};
+
+// Lights probes at any time of day from the two keyframes around it. Those two are
+// held in memory, and a background thread reads the one after them while they are in
+// use, so crossing into the next pair finds it ready. Blending happens on the SH, and
+// the luminance axis and K2 of every probe are refit from the blend, on the caller's
+// workers, only when it moved by more than blendStep since the last fit.
+class ProbeTimeOfDay {
+public:
+    ~ProbeTimeOfDay();
+    bool open(const char* path, float blendStep);
+    void close();
+    // Returns true when zh3() changed.
+    bool update(float timeOfDay, WorkerPool& workers);
+
+    int probeCount() const { return probes; }
+    int keyCount() const { return (int)times.size(); }
+    // 15-float ZH3 storage of probe_storage.h for every probe.
+    const std::vector<float>& zh3() const { return blendedZH3; }
+    TimeOfDayStats stats() const { return counters; }
+
+private:
+    void loadKeyframe(int slot, int key);
+    void prefetchKeyframe(int key);
+    void loaderMain();
+
+    std::string path;
+    std::vector<float> times;
+    int probes = 0;
+    size_t headerBytes = 0;
+    float step = 0.0f;
+
+    std::vector<float> slotSH[2];
+    int slotKey[2] = { -1, -1 };
+    int blendFrom = -1;
+    int blendTo = -1;
+    float blendAlpha = 0.0f;
+
+    std::vector<float> blendedSH;
+    std::vector<float> k2;
+    std::vector<float> blendedZH3;
+    TimeOfDayStats counters = { 0, 0, 0, 0.0 };
+
+    // Shared with the loader thread.
+    std::thread loader;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable loaded;
+    int requestedKey = -1;
+    int readingKey = -1;
+    int prefetchedKey = -1;
+    std::vector<float> prefetched;
+    bool quit = false;
+};
@@ -12,7 +12,6 @@
 #define MAXWIDTH 2000 
 
 static float hdr[MAXWIDTH][MAXWIDTH][3]; 
-static float coeffs[9][3]; 
 
 static float sinc(float x) {
     return (fabs(x) < 1.0e-4f) ? 1.0f : sinf(x) / x;
@@ -32,7 +31,8 @@ static void input(const char* filename, const int width) {
     fclose(fp);
 }
 
-static void updatecoeffs(float hdr[3], float domega, float x, float y, float z) {
+// The accumulator is the caller's, so images can be projected on several threads.
+static void updatecoeffs(float coeffs[9][3], float hdr[3], float domega, float x, float y, float z) {
     int col;
     for (col = 0; col < 3; ++col) { 
         coeffs[0][col] += hdr[col] * 0.282095f * domega; 
@@ -47,22 +47,39 @@ static void updatecoeffs(float hdr[3], float domega, float x, float y, float z)
     }
 }
 
+static void projectTexel(float coeffs[9][3], float texel[3], int width, int i, int j) {
+    float u = (j - width / 2.0f) / (width / 2.0f);
+    float v = (width / 2.0f - i) / (width / 2.0f);
+    float r = sqrtf(u * u + v * v);
+    if (r > 1.0f) return; 
+    float theta = PI * r; 
+    float phi = atan2f(v, u); 
+    float x = sinf(theta) * cosf(phi); 
+    float y = sinf(theta) * sinf(phi);
+    float z = cosf(theta);
+    float domega = (2 * PI / width) * (2 * PI / width) * sinc(theta); 
+    updatecoeffs(coeffs, texel, domega, x, y, z); 
+}
+
 void computeSHFromFloatFile(const char* filename, int width, float sh[9][3]) {
+    float coeffs[9][3];
     memset(coeffs, 0, sizeof(coeffs)); 
     input(filename, width); 
     for (int i = 0; i < width; ++i) {
         for (int j = 0; j < width; ++j) {
-            float u = (j - width / 2.0f) / (width / 2.0f);
-            float v = (width / 2.0f - i) / (width / 2.0f);
-            float r = sqrtf(u * u + v * v);
-            if (r > 1.0f) continue; 
-            float theta = PI * r; 
-            float phi = atan2f(v, u); 
-            float x = sinf(theta) * cosf(phi); 
-            float y = sinf(theta) * sinf(phi);
-            float z = cosf(theta);
-            float domega = (2 * PI / width) * (2 * PI / width) * sinc(theta); 
-            updatecoeffs(hdr[i][j], domega, x, y, z); 
+            projectTexel(coeffs, hdr[i][j], width, i, j);
+        }
+    }
+    memcpy(sh, coeffs, sizeof(coeffs)); 
+}
+
+void computeSHFromImage(const float* rgb, int width, float sh[9][3]) {
+    float coeffs[9][3];
+    memset(coeffs, 0, sizeof(coeffs)); 
+    for (int i = 0; i < width; ++i) {
+        for (int j = 0; j < width; ++j) {
+            float texel[3] = { rgb[3 * (i * width + j) + 0], rgb[3 * (i * width + j) + 1], rgb[3 * (i * width + j) + 2] };
+            projectTexel(coeffs, texel, width, i, j);
         }
     }
     memcpy(sh, coeffs, sizeof(coeffs)); 
@@ -85,6 +102,16 @@ void convertFloatToHDR(const char* floatPath, const char* hdrOutPath, int width)
     free(linearRGB); 
 }
 
+void readFloatFile(const char* filename, int width, float* rgb) {
+    FILE* fp = fopen(filename, "rb");
+    assert(fp && "HDR .float file not found or unreadable.");
+    size_t count = (size_t)width * width * 3;
+    size_t got = fread(rgb, sizeof(float), count, fp);
+    assert(got == count);
+    (void)got;
+    fclose(fp);
+}
+
 int guessFloatWidth(const char* path) {
     FILE* fp = fopen(path, "rb");
     if (!fp) return -1; 
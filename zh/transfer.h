@@ -2,5 +2,7 @@
 #pragma once
 
 void computeSHFromFloatFile(const char* filename, int width, float sh[9][3]);
+void computeSHFromImage(const float* rgb, int width, float sh[9][3]);
 void convertFloatToHDR(const char* floatPath, const char* hdrOutPath, int width);
-int guessFloatWidth(const char* path);
\ No newline at end of file
+int guessFloatWidth(const char* path);
+void readFloatFile(const char* filename, int width, float* rgb);
\ No newline at end of file
@@ -2,14 +2,31 @@
 
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
 #include <glad/glad.h>
 #include <GLFW/glfw3.h> 
 #include "xShader.h" 
+#include "xProgramBinaryCache.h"
+#include "xUniformBuffer.h"
 
 class xProgram {
 public:
-	xProgram(char* vertexShaderStr, char* fragmentShaderStr) {
+	// binaries, when not NULL, supplies the program linked on an earlier run and keeps
+	// the binary of one built from source for the next.
+	xProgram(char* vertexShaderStr, char* fragmentShaderStr, xProgramBinaryCache* binaries) {
 		program = glCreateProgram();
+		if (binaries && binaries->load(program, vertexShaderStr, fragmentShaderStr)) {
+			resolveUniforms();
+			return;
+		}
+		if (binaries) {
+			// Start the source build from a fresh program in case a binary was rejected.
+			glDeleteProgram(program);
+			program = glCreateProgram();
+			binaries->prepare(program);
+		}
 
 		xShader vertexShader(vertexShaderStr, xShaderType::Vertex);
 		xShader fragmentShader(fragmentShaderStr, xShaderType::Fragment);
@@ -26,6 +43,10 @@ public:
 			printf("ProgramLog:\n%s\n", log);
 			free(log);
 		}
+		GLint status = GL_FALSE;
+		glGetProgramiv(program, GL_LINK_STATUS, &status);
+		if (binaries && status == GL_TRUE) binaries->store(program, vertexShaderStr, fragmentShaderStr);
+		resolveUniforms();
 	}
 	~xProgram() {
 		if (program != NULL) {
@@ -33,5 +54,38 @@ public:
 			program = 0;
 		}
 	}
+
+	// Location of a default-block uniform, looked up without a call into the driver;
+	// -1, which glUniform* ignores, when the program does not use it.
+	GLint uniform(const char* name) const {
+		std::map<std::string, GLint>::const_iterator it = locations.find(name);
+		return it == locations.end() ? -1 : it->second;
+	}
+
 	GLuint program = 0;
+
+private:
+	// Record the location of every active uniform, arrays under their bare name, and
+	// attach the shared uniform blocks to their binding points.
+	void resolveUniforms() {
+		GLint count = 0;
+		glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+		for (GLint i = 0; i < count; i++) {
+			char name[256];
+			GLsizei length = 0;
+			GLint size = 0;
+			GLenum type = 0;
+			glGetActiveUniform(program, (GLuint)i, sizeof(name), &length, &size, &type, name);
+			GLint location = glGetUniformLocation(program, name);
+			if (location < 0) continue;  // a member of a uniform block
+			if (length > 3 && strcmp(name + length - 3, "[0]") == 0) name[length - 3] = '\0';
+			locations[name] = location;
+		}
+		for (int b = 0; b < UniformBlockCount; b++) {
+			GLuint index = glGetUniformBlockIndex(program, xUniformBlockNames[b]);
+			if (index != GL_INVALID_INDEX) glUniformBlockBinding(program, index, b);
+		}
+	}
+
+	std::map<std::string, GLint> locations;
 };
\ No newline at end of file
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+// ARB_get_program_binary is not part of the 3.3 loader, so it is fetched at runtime.
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+typedef void (APIENTRY* xGetProgramBinaryProc)(GLuint program, GLsizei bufSize, GLsizei* length, GLenum* binaryFormat, void* binary);
+typedef void (APIENTRY* xProgramBinaryProc)(GLuint program, GLenum binaryFormat, const void* binary, GLsizei length);
+typedef void (APIENTRY* xProgramParameteriProc)(GLuint program, GLenum pname, GLint value);
+
+// Linked program binaries kept in one file across runs. The file records the vendor,
+// renderer and version strings of the driver that wrote it and is ignored under any
+// other; entries inside are keyed by a hash of the program's sources. A binary the
+// driver still rejects is dropped, and the program is compiled from source again.
+class xProgramBinaryCache {
+public:
+	// Needs a current context; a missing or stale file leaves the cache empty.
+	explicit xProgramBinaryCache(const char* path) : path(path) {
+		GLint formats = 0;
+		if (glfwExtensionSupported("GL_ARB_get_program_binary")) {
+			getProgramBinary = (xGetProgramBinaryProc)glfwGetProcAddress("glGetProgramBinary");
+			programBinary = (xProgramBinaryProc)glfwGetProcAddress("glProgramBinary");
+			programParameteri = (xProgramParameteriProc)glfwGetProcAddress("glProgramParameteri");
+			glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+		}
+		supported = getProgramBinary && programBinary && programParameteri && formats > 0;
+		if (!supported) {
+			printf("Program binary cache: not supported by the driver, compiling from source\n");
+			return;
+		}
+		driver = std::string((const char*)glGetString(GL_VENDOR)) + "|" + (const char*)glGetString(GL_RENDERER) + "|" +
+			(const char*)glGetString(GL_VERSION);
+		read();
+		printf("Program binary cache: %zu programs in %s\n", entries.size(), path);
+	}
+
+	// Hint before linking that the driver should keep the binary retrievable.
+	void prepare(GLuint program) {
+		if (supported) programParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
+
+	// Link program from the binary stored for these sources. False when there is none
+	// or the driver rejects it; program must then be recreated and built from source.
+	bool load(GLuint program, const char* vertexSource, const char* fragmentSource) {
+		if (!supported) return false;
+		std::map<unsigned long long, Entry>::iterator it = entries.find(sourceHash(vertexSource, fragmentSource));
+		if (it == entries.end()) return false;
+		programBinary(program, it->second.format, &it->second.data[0], (GLsizei)it->second.data.size());
+		GLint status = GL_FALSE;
+		glGetProgramiv(program, GL_LINK_STATUS, &status);
+		if (status == GL_TRUE) return true;
+		printf("Program binary cache: binary rejected, compiling from source\n");
+		entries.erase(it);
+		return false;
+	}
+
+	// Keep the binary of a program linked from these sources until the next flush().
+	void store(GLuint program, const char* vertexSource, const char* fragmentSource) {
+		if (!supported) return;
+		GLint length = 0;
+		glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+		if (length <= 0) return;
+		Entry entry;
+		entry.data.resize(length);
+		getProgramBinary(program, length, NULL, &entry.format, &entry.data[0]);
+		entries[sourceHash(vertexSource, fragmentSource)] = entry;
+		changed = true;
+	}
+
+	// Write the file if anything was stored since the last flush, to a temporary that
+	// then replaces it, so a crash mid-write never leaves a truncated cache behind.
+	void flush() {
+		if (!changed) return;
+		changed = false;
+		std::string temporary = path + ".tmp";
+		if (!write(temporary.c_str())) {
+			printf("Program binary cache: cannot write %s\n", temporary.c_str());
+			remove(temporary.c_str());
+			return;
+		}
+		// rename() does not replace an existing file on Windows.
+		if (rename(temporary.c_str(), path.c_str()) != 0) {
+			remove(path.c_str());
+			if (rename(temporary.c_str(), path.c_str()) != 0)
+				printf("Program binary cache: cannot replace %s\n", path.c_str());
+		}
+	}
+
+private:
+	struct Entry {
+		GLenum format = 0;
+		std::vector<char> data;
+	};
+
+	// FNV-1a over both sources, with the terminator of the first in between.
+	static unsigned long long sourceHash(const char* vertexSource, const char* fragmentSource) {
+		unsigned long long hash = 14695981039346656037ull;
+		const char* sources[2] = { vertexSource, fragmentSource };
+		for (int s = 0; s < 2; s++) {
+			size_t length = strlen(sources[s]) + 1;
+			for (size_t i = 0; i < length; i++) {
+				hash ^= (unsigned char)sources[s][i];
+				hash *= 1099511628211ull;
+			}
+		}
+		return hash;
+	}
+
+	// Layout: magic, driver string length and bytes, entry count, then per entry the
+	// source hash, binary format, binary length and bytes.
+	void read() {
+		FILE* file = fopen(path.c_str(), "rb");
+		if (!file) return;
+		char magic[4] = { 0 };
+		unsigned int length = 0, count = 0;
+		bool ok = fread(magic, 1, 4, file) == 4 && memcmp(magic, "XPBC", 4) == 0 &&
+			fread(&length, sizeof(length), 1, file) == 1 && length == driver.size();
+		std::string fileDriver(length, '\0');
+		ok = ok && (length == 0 || fread(&fileDriver[0], 1, length, file) == length) && fileDriver == driver &&
+			fread(&count, sizeof(count), 1, file) == 1;
+		for (unsigned int e = 0; ok && e < count; e++) {
+			unsigned long long hash = 0;
+			unsigned int format = 0, size = 0;
+			ok = fread(&hash, sizeof(hash), 1, file) == 1 && fread(&format, sizeof(format), 1, file) == 1 &&
+				fread(&size, sizeof(size), 1, file) == 1 && size > 0;
+			if (!ok) break;
+			Entry& entry = entries[hash];
+			entry.format = format;
+			entry.data.resize(size);
+			ok = fread(&entry.data[0], 1, size, file) == size;
+			if (!ok) entries.erase(hash);
+		}
+		fclose(file);
+	}
+
+	bool write(const char* target) const {
+		FILE* file = fopen(target, "wb");
+		if (!file) return false;
+		unsigned int length = (unsigned int)driver.size(), count = (unsigned int)entries.size();
+		fwrite("XPBC", 1, 4, file);
+		fwrite(&length, sizeof(length), 1, file);
+		fwrite(driver.data(), 1, length, file);
+		fwrite(&count, sizeof(count), 1, file);
+		for (std::map<unsigned long long, Entry>::const_iterator it = entries.begin(); it != entries.end(); ++it) {
+			unsigned int format = it->second.format, size = (unsigned int)it->second.data.size();
+			fwrite(&it->first, sizeof(it->first), 1, file);
+			fwrite(&format, sizeof(format), 1, file);
+			fwrite(&size, sizeof(size), 1, file);
+			fwrite(&it->second.data[0], 1, size, file);
+		}
+		bool ok = !ferror(file);
+		return fclose(file) == 0 && ok;
+	}
+
+	std::string path;
+	std::string driver;
+	std::map<unsigned long long, Entry> entries;
+	bool supported = false;
+	bool changed = false;
+	xGetProgramBinaryProc getProgramBinary = NULL;
+	xProgramBinaryProc programBinary = NULL;
+	xProgramParameteriProc programParameteri = NULL;
+};
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include "xProgram.h"
+
+// Variants of one vertex/fragment pair specialized by #define. A key lists the names
+// to define, separated by spaces; each variant is compiled the first time it is asked
+// for and kept for the life of the cache, so switching back to it is a lookup.
+class xProgramCache {
+public:
+	// setup runs once on every newly linked variant with its program bound, to set the
+	// loose uniforms that do not change afterwards. binaries is passed on to xProgram;
+	// variants built later are stored in it but written out by the owner's flush().
+	xProgramCache(const std::string& vertexSource, const std::string& fragmentSource,
+		std::function<void(const xProgram&)> setup, xProgramBinaryCache* binaries)
+		: vertexSource(vertexSource), fragmentSource(fragmentSource), setup(setup), binaries(binaries) {}
+
+	const xProgram& get(const std::string& key) {
+		std::map<std::string, std::unique_ptr<xProgram> >::const_iterator it = programs.find(key);
+		if (it != programs.end()) return *it->second;
+
+		std::string vertex = specialize(vertexSource, key);
+		std::string fragment = specialize(fragmentSource, key);
+		printf("Building variant \"%s\"\n", key.c_str());
+		xProgram* program = new xProgram((char*)vertex.c_str(), (char*)fragment.c_str(), binaries);
+		programs[key].reset(program);
+		if (setup) {
+			glUseProgram(program->program);
+			setup(*program);
+		}
+		return *program;
+	}
+
+	// source with a #define for every name in key inserted after its #version line,
+	// which has to stay first. The #line keeps compile logs on the file's numbering.
+	static std::string specialize(const std::string& source, const std::string& key) {
+		size_t version = source.find("#version");
+		size_t lineEnd = version == std::string::npos ? std::string::npos : source.find('\n', version);
+		if (lineEnd == std::string::npos) return source;
+		std::string defines;
+		size_t start = 0;
+		while (start < key.size()) {
+			size_t end = key.find(' ', start);
+			if (end == std::string::npos) end = key.size();
+			if (end > start) defines += "#define " + key.substr(start, end - start) + "\n";
+			start = end + 1;
+		}
+		int versionLine = 1;
+		for (size_t i = 0; i < version; i++) {
+			if (source[i] == '\n') versionLine++;
+		}
+		return source.substr(0, lineEnd + 1) + defines + "#line " + std::to_string(versionLine + 1) + "\n" +
+			source.substr(lineEnd + 1);
+	}
+
+private:
+	std::string vertexSource;
+	std::string fragmentSource;
+	std::function<void(const xProgram&)> setup;
+	xProgramBinaryCache* binaries;
+	std::map<std::string, std::unique_ptr<xProgram> > programs;
+};
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstdio>
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+// ARB_buffer_storage is not part of the 3.3 loader, so it is fetched at runtime.
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+typedef void (APIENTRY* xBufferStorageProc)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+
+// Pixel-unpack ring for streaming texture uploads, split into regions used one per
+// frame. With ARB_buffer_storage the ring is mapped once, persistently and coherently;
+// otherwise each region is mapped unsynchronized for the frame. A fence guards every
+// region, and map() returns NULL instead of waiting while the GPU still reads it, so
+// the caller skips uploads for a frame rather than stalling the render loop.
+class xStreamBuffer {
+public:
+	xStreamBuffer(GLsizeiptr regionSize, int regionCount) : regionSize(regionSize), regionCount(regionCount) {
+		fences = new GLsync[regionCount]();
+		glGenBuffers(1, &buffer);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+		xBufferStorageProc bufferStorage = NULL;
+		if (glfwExtensionSupported("GL_ARB_buffer_storage"))
+			bufferStorage = (xBufferStorageProc)glfwGetProcAddress("glBufferStorage");
+		GLsizeiptr size = regionSize * regionCount;
+		if (bufferStorage) {
+			GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			bufferStorage(GL_PIXEL_UNPACK_BUFFER, size, NULL, flags);
+			persistent = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, flags);
+		}
+		if (!persistent)
+			glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		printf("Stream buffer: %d x %.1f MB, %s\n", regionCount, regionSize / 1048576.0,
+			persistent ? "persistent-mapped" : "unsynchronized map");
+	}
+	~xStreamBuffer() {
+		for (int i = 0; i < regionCount; i++)
+			if (fences[i]) glDeleteSync(fences[i]);
+		delete[] fences;
+		if (buffer != 0) {
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+			if (persistent) glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			glDeleteBuffers(1, &buffer);
+			buffer = 0;
+		}
+	}
+
+	// Start writing the next region; regionOffset() is its offset for pixel-unpack calls.
+	unsigned char* map() {
+		int next = (region + 1) % regionCount;
+		if (fences[next]) {
+			if (glClientWaitSync(fences[next], 0, 0) == GL_TIMEOUT_EXPIRED)
+				return NULL;
+			glDeleteSync(fences[next]);
+			fences[next] = 0;
+		}
+		region = next;
+		if (persistent)
+			return persistent + regionOffset();
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+		unsigned char* mapped = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, regionOffset(), regionSize,
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		return mapped;
+	}
+	// Call after writing and before the uploads that read the region.
+	void unmap() {
+		if (persistent) return;
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+	// Call after the uploads so the region is not rewritten while they are pending.
+	void fence() {
+		fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+	GLintptr regionOffset() const { return (GLintptr)region * regionSize; }
+
+	GLuint buffer = 0;
+	GLsizeiptr regionSize;
+	int regionCount;
+	unsigned char* persistent = NULL;
+private:
+	GLsync* fences;
+	int region = 0;
+};
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <glad/glad.h>
+
+// Binding points of the std140 uniform blocks the shaders share. xProgram binds every
+// block it finds by these names once, at link time.
+enum xUniformBlock {
+	FrameBlock = 0,   // FrameConstants: view, projection and camera position
+	ObjectBlock = 1,  // ObjectConstants: model and normal matrices
+	ProbeBlock = 2,   // ProbeConstants: the probe shader.frag evaluates
+	UniformBlockCount = 3
+};
+
+static const char* const xUniformBlockNames[UniformBlockCount] = { "FrameConstants", "ObjectConstants", "ProbeConstants" };
+
+// Uniform buffer holding one std140 struct T, attached to its binding point for its
+// whole life, so updating it is the only call a change of constants costs.
+template <typename T>
+class xUniformBuffer {
+public:
+	explicit xUniformBuffer(xUniformBlock block) {
+		glGenBuffers(1, &buffer);
+		glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+		glBufferData(GL_UNIFORM_BUFFER, sizeof(T), NULL, GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		glBindBufferBase(GL_UNIFORM_BUFFER, block, buffer);
+	}
+	~xUniformBuffer() {
+		if (buffer != 0) {
+			glDeleteBuffers(1, &buffer);
+			buffer = 0;
+		}
+	}
+
+	void update(const T& data) {
+		glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(T), &data);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+
+	GLuint buffer = 0;
+};
@@ -0,0 +1,35 @@
+// ZH3 reconstruction shared by the probe shaders, spliced in by readShader (main.cpp)
+// in place of #include "zh3_common.glsl" after PI is declared. The same guards as
+// zh3LuminanceAxis and fitZH3Hallucinated in zh3_fit.cpp keep a flat or black probe
+// from producing NaN.
+
+// Luminance-weighted L1 direction of c[1..3], or +z when L1 vanishes.
+vec3 zh3LuminanceAxis(vec3 c[5])
+{
+    const vec3 lum = vec3(0.2126, 0.7152, 0.0722);
+    vec3 axis = vec3(-dot(c[3], lum), -dot(c[1], lum), dot(c[2], lum));
+    float len = length(axis);
+    return len < 1e-12 ? vec3(0.0, 0.0, 1.0) : axis / len;
+}
+
+// K2 along the luminance axis from L0 and L1 alone. The curve fit expects radiance,
+// so the convolved L1 is scaled back by 3/2; channels without positive L0 get none.
+vec3 hallucinateK2(vec3 c[5])
+{
+    vec3 axis = zh3LuminanceAxis(c);
+    vec3 l1 = -c[3] * axis.x - c[1] * axis.y + c[2] * axis.z;
+    vec3 ratio = abs(1.5 * l1 / max(c[0], vec3(1e-30)));
+    return mix(0.25 * c[0] * ratio * (0.08 + 0.6 * ratio), vec3(0.0), lessThanEqual(c[0], vec3(0.0)));
+}
+
+// L0, L1 and K2 along the luminance axis rederived from L1.
+vec3 evalZH3(vec3 c[5], vec3 n)
+{
+    float t = dot(zh3LuminanceAxis(c), n);
+    float zhBasis = sqrt(5.0 / (16.0 * PI)) * (3.0 * t * t - 1.0);
+    vec3 result = c[0] * (1.0 / (2.0 * sqrt(PI)))
+        - c[1] * (sqrt(3.0 / (4.0 * PI)) * n.y)
+        + c[2] * (sqrt(3.0 / (4.0 * PI)) * n.z)
+        - c[3] * (sqrt(3.0 / (4.0 * PI)) * n.x);
+    return result + c[4] * zhBasis;
+}
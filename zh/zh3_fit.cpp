@@ -0,0 +1,226 @@
+#include "zh3_fit.h"
+#include "parallel_for.h"
+#include "simd_float.h"
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#define PI 3.14159265358979
+
+static const float c0 = (float)(1.0 / (2.0 * sqrt(PI)));
+static const float c1 = (float)sqrt(3.0 / (4.0 * PI));
+static const float c3 = (float)sqrt(5.0 / (16.0 * PI));
+static const float lumWeight[3] = { 0.2126f, 0.7152f, 0.0722f };
+
+void zh3LuminanceAxis(const float sh[][3], float axis[3]) {
+    float lum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    for (int col = 0; col < 3; ++col)
+        for (int i = 1; i < 4; ++i)
+            lum[i] += sh[i][col] * lumWeight[col];
+    axis[0] = -lum[3];
+    axis[1] = -lum[1];
+    axis[2] = lum[2];
+    float len = sqrtf(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+    if (len < 1e-12f) {
+        axis[0] = 0.0f;
+        axis[1] = 0.0f;
+        axis[2] = 1.0f;
+        return;
+    }
+    for (int i = 0; i < 3; ++i) axis[i] /= len;
+}
+
+void zh3ExtractK2(const float sh[9][3], const float axis[3], float k2[3]) {
+    double x = axis[0], y = axis[1], z = axis[2];
+    double q[5];
+    q[0] = sqrt(15.0 / (4.0 * PI)) * x * y;
+    q[1] = -sqrt(15.0 / (4.0 * PI)) * y * z;
+    q[2] = sqrt(5.0 / (16.0 * PI)) * (3.0 * z * z - 1.0);
+    q[3] = -sqrt(15.0 / (4.0 * PI)) * x * z;
+    q[4] = sqrt(15.0 / (16.0 * PI)) * (x * x - y * y);
+    for (int col = 0; col < 3; ++col) {
+        double s = 0.0;
+        for (int i = 0; i < 5; ++i)
+            s += q[i] * sh[4 + i][col];
+        k2[col] = (float)(s * sqrt(4.0 * PI / 5.0));
+    }
+}
+
+void fitZH3PerChannelK2(const float sh[9][3], float k2[3]) {
+    // Nine coefficients x three channels with unit stride are one probe in SoA form.
+    fitZH3K2Batch(ZH3_AXIS_PER_CHANNEL, &sh[0][0], 1, 1, k2, 1);
+}
+
+template <typename T> static T loadLanes(const float* p) { return T::load(p); }
+template <> float loadLanes<float>(const float* p) { return *p; }
+static void storeLanes(float* p, float v) { *p = v; }
+template <int N> static void storeLanes(float* p, FloatN<N> v) { v.store(p); }
+static float laneMax(float a, float b) { return fmaxf(a, b); }
+template <int N> static FloatN<N> laneMax(FloatN<N> a, FloatN<N> b) { return max(a, b); }
+static float laneSqrt(float a) { return sqrtf(a); }
+template <int N> static FloatN<N> laneSqrt(FloatN<N> a) { return sqrt(a); }
+// 1 where the squared axis length is usable and exactly 0 where |L1| < 1e-12.
+static float laneAxisValid(float len2) { return len2 < 1e-24f ? 0.0f : 1.0f; }
+template <int N> static FloatN<N> laneAxisValid(FloatN<N> len2) {
+    return select(lessThan(len2, FloatN<N>(1e-24f)), FloatN<N>(0.0f), FloatN<N>(1.0f));
+}
+
+// Fit one lane group of probes. valid is 1 for a usable axis and 0 when L1 vanishes
+// (|L1| < 1e-12, as in the scalar code), selected per lane so the loop stays free of
+// branches and every lane matches the scalar fit.
+template <typename T>
+static void fitK2Lanes(ZH3AxisMode mode, const float* sh, size_t stride, float* k2, size_t k2Stride) {
+    const T qa((float)sqrt(15.0 / (4.0 * PI)));
+    const T qb((float)sqrt(5.0 / (16.0 * PI)));
+    const T qc((float)sqrt(15.0 / (16.0 * PI)));
+    const T scale((float)sqrt(4.0 * PI / 5.0));
+    const T one(1.0f), three(3.0f), tiny(1e-30f);
+
+    T l1[3][3], l2[5][3];
+    for (int col = 0; col < 3; ++col) {
+        for (int i = 0; i < 3; ++i)
+            l1[i][col] = loadLanes<T>(sh + ((1 + i) * 3 + col) * stride);
+        for (int i = 0; i < 5; ++i)
+            l2[i][col] = loadLanes<T>(sh + ((4 + i) * 3 + col) * stride);
+    }
+
+    auto extract = [&](T x, T y, T z, int col) {
+        T s = qa * x * y * l2[0][col] - qa * y * z * l2[1][col] + qb * (three * z * z - one) * l2[2][col]
+            - qa * x * z * l2[3][col] + qc * (x * x - y * y) * l2[4][col];
+        return s * scale;
+    };
+
+    if (mode == ZH3_AXIS_PER_CHANNEL) {
+        for (int col = 0; col < 3; ++col) {
+            T x = -l1[2][col], y = -l1[0][col], z = l1[1][col];
+            T len2 = x * x + y * y + z * z;
+            T inv = one / laneSqrt(laneMax(len2, tiny));
+            T valid = laneAxisValid(len2);
+            storeLanes(k2 + col * k2Stride, extract(x * inv, y * inv, z * inv, col) * valid);
+        }
+        return;
+    }
+
+    T lum[3];
+    for (int i = 0; i < 3; ++i)
+        lum[i] = T(lumWeight[0]) * l1[i][0] + T(lumWeight[1]) * l1[i][1] + T(lumWeight[2]) * l1[i][2];
+    T x = -lum[2], y = -lum[0], z = lum[1];
+    T len2 = x * x + y * y + z * z;
+    T valid = laneAxisValid(len2);
+    T inv = valid / laneSqrt(laneMax(len2, tiny));
+    x = x * inv;
+    y = y * inv;
+    z = z * inv + (one - valid);
+    for (int col = 0; col < 3; ++col)
+        storeLanes(k2 + col * k2Stride, extract(x, y, z, col));
+}
+
+static void fitK2Range(ZH3AxisMode mode, const float* sh, size_t stride, int begin, int end, float* k2, size_t k2Stride) {
+    int p = begin;
+    for (; p + SIMD_FLOAT_WIDTH <= end; p += SIMD_FLOAT_WIDTH)
+        fitK2Lanes<FloatW>(mode, sh + p, stride, k2 + p, k2Stride);
+    for (; p < end; ++p)
+        fitK2Lanes<float>(mode, sh + p, stride, k2 + p, k2Stride);
+}
+
+void fitZH3K2Batch(ZH3AxisMode mode, const float* sh, size_t stride, int count, float* k2, size_t k2Stride) {
+    parallelFor(count, 16384, [&](int begin, int end) {
+        fitK2Range(mode, sh, stride, begin, end, k2, k2Stride);
+    });
+}
+
+void fitZH3K2Batch(ZH3AxisMode mode, const float* sh, size_t stride, int count, float* k2, size_t k2Stride,
+    WorkerPool& workers) {
+    workers.run(count, 16384, [&](int begin, int end) {
+        fitK2Range(mode, sh, stride, begin, end, k2, k2Stride);
+    });
+}
+
+void benchmarkZH3Fit(int count) {
+    std::vector<float> sh((size_t)count * 27);
+    std::vector<float> k2((size_t)count * 3);
+    for (size_t i = 0; i < sh.size(); ++i)
+        sh[i] = sinf(0.37f * (float)i) * (i < (size_t)count * 3 ? 0.5f : 0.2f) + (i < (size_t)count * 3 ? 1.0f : 0.0f);
+
+    // Each probe reads its 24 L1 and L2 floats (L0 is never touched) and writes 3 K2.
+    // The first 8192 probes, under 1 MB, are also fitted over and over from cache: the
+    // full pass is bound by memory where it runs well below that rate. One core and
+    // all cores side by side show what the extra threads add.
+    int cached = std::min(count, 8192);
+    printf("ZH3 K2 fit over %d SoA probes, %d-wide SIMD, %u threads\n", count, SIMD_FLOAT_WIDTH,
+        std::max(1u, std::thread::hardware_concurrency()));
+    const char* names[2] = { "per-channel", "luminance" };
+    const char* passes[3] = { "in cache", "one core", "all cores" };
+    for (int m = 0; m < 2; ++m) {
+        for (int pass = 0; pass < 3; ++pass) {
+            double best = 1e30;
+            for (int run = 0; run < 4; ++run) {
+                auto start = std::chrono::high_resolution_clock::now();
+                if (pass == 0) {
+                    for (int done = 0; done < count; done += cached)
+                        fitK2Range((ZH3AxisMode)m, &sh[0], count, 0, cached, &k2[0], count);
+                }
+                else if (pass == 1) fitK2Range((ZH3AxisMode)m, &sh[0], count, 0, count, &k2[0], count);
+                else fitZH3K2Batch((ZH3AxisMode)m, &sh[0], count, count, &k2[0], count);
+                auto end = std::chrono::high_resolution_clock::now();
+                double seconds = std::chrono::duration<double>(end - start).count();
+                if (run > 0 && seconds < best) best = seconds;
+            }
+            printf("  %-12s %-10s %8.2f ms %8.1f M probes/s %6.2f GB/s\n", names[m], passes[pass], best * 1000.0,
+                count / best * 1e-6, count * 27.0 * sizeof(float) / best * 1e-9);
+        }
+    }
+}
+
+static void packZH3(const float sh[][3], const float axis[3], const float k2[3], ZH3Packet& packet) {
+    for (int i = 0; i < 3; ++i) packet.axis[i] = axis[i];
+    for (int col = 0; col < 3; ++col) {
+        // Y20(t) = c3 * (3t^2 - 1): the constant part moves into l0.
+        packet.l0[col] = c0 * sh[0][col] - c3 * k2[col];
+        packet.l1[0][col] = -c1 * sh[3][col];
+        packet.l1[1][col] = -c1 * sh[1][col];
+        packet.l1[2][col] = c1 * sh[2][col];
+        packet.k2[col] = 3.0f * c3 * k2[col];
+    }
+}
+
+void makeZH3Packet(const float sh[][3], const float k2[3], ZH3Packet& packet) {
+    float axis[3];
+    zh3LuminanceAxis(sh, axis);
+    packZH3(sh, axis, k2, packet);
+}
+
+void fitZH3Shared(const float sh[9][3], ZH3Packet& packet) {
+    float axis[3], k2[3];
+    zh3LuminanceAxis(sh, axis);
+    zh3ExtractK2(sh, axis, k2);
+    packZH3(sh, axis, k2, packet);
+}
+
+void fitZH3Hallucinated(const float sh[4][3], ZH3Packet& packet) {
+    float axis[3], k2[3];
+    zh3LuminanceAxis(sh, axis);
+    for (int col = 0; col < 3; ++col) {
+        if (sh[0][col] <= 0.0f) {
+            k2[col] = 0.0f;
+            continue;
+        }
+        // The curve fit is in terms of radiance, so undo the 2/3 of the convolved L1
+        // and apply the 1/4 of band 2 to the result.
+        float l1 = -sh[3][col] * axis[0] - sh[1][col] * axis[1] + sh[2][col] * axis[2];
+        float ratio = fabsf(1.5f * l1 / sh[0][col]);
+        k2[col] = 0.25f * sh[0][col] * ratio * (0.08f + 0.6f * ratio);
+    }
+    packZH3(sh, axis, k2, packet);
+}
+
+void evalZH3Packet(const ZH3Packet& packet, const float n[3], float out[3]) {
+    float t = packet.axis[0] * n[0] + packet.axis[1] * n[1] + packet.axis[2] * n[2];
+    for (int col = 0; col < 3; ++col) {
+        out[col] = packet.l0[col] + packet.l1[0][col] * n[0] + packet.l1[1][col] * n[1] + packet.l1[2][col] * n[2]
+            + packet.k2[col] * t * t;
+    }
+}
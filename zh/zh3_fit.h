@@ -0,0 +1,48 @@
+// zh3_fit.h
+#pragma once
+#include <stddef.h>
+
+class WorkerPool;
+
+// Shared luminance-axis ZH3 probe with the SH basis constants folded in, so that
+// irradiance(n) = l0 + l1 * n + k2 * dot(axis, n)^2 for every channel at once.
+// This is what calcIrradianceShared in shader.frag evaluates.
+struct ZH3Packet {
+    float axis[3];
+    float l0[3];      // [channel]
+    float l1[3][3];   // [x, y, z][channel], a column-major mat3 for GLSL
+    float k2[3];      // [channel]
+};
+
+enum ZH3AxisMode {
+    ZH3_AXIS_PER_CHANNEL, // each channel along its own L1 direction, as calcIrradianceZH3
+    ZH3_AXIS_LUMINANCE    // one luminance-weighted axis for all channels, as calcIrradianceShared
+};
+
+// Luminance-weighted zonal axis from the linear band; (0, 0, 1) when it vanishes.
+// Only sh[0..3] are read, so linear probes can be passed too.
+void zh3LuminanceAxis(const float sh[][3], float axis[3]);
+// Zonal L2 coefficient of each channel along axis, as SH_ExtractL2Zonal in st.cpp.
+void zh3ExtractK2(const float sh[9][3], const float axis[3], float k2[3]);
+// K2 of each channel along that channel's own L1 axis, as calcIrradianceZH3 expects.
+void fitZH3PerChannelK2(const float sh[9][3], float k2[3]);
+// K2 for count probes stored as SoA planes: coefficient i of channel c of probe p is
+// sh[(i * 3 + c) * stride + p], and k2 receives three planes k2[c * k2Stride + p].
+// Probes run in SIMD lanes and chunks of them over all cores, so a large volume is
+// bound by memory rather than arithmetic. A vanishing L1 gives K2 = 0 per channel
+// and the +z axis for the luminance mode, like the single-probe functions.
+void fitZH3K2Batch(ZH3AxisMode mode, const float* sh, size_t stride, int count, float* k2, size_t k2Stride);
+// The same on a caller's worker pool, for fits redone every frame.
+void fitZH3K2Batch(ZH3AxisMode mode, const float* sh, size_t stride, int count, float* k2, size_t k2Stride,
+    WorkerPool& workers);
+// Print the throughput of fitZH3K2Batch for both modes over count probes, on one
+// core and on all, against the same kernel running from cache.
+void benchmarkZH3Fit(int count);
+// Fit the shared-axis packet from cosine-convolved quadratic SH.
+void fitZH3Shared(const float sh[9][3], ZH3Packet& packet);
+// Build the packet from linear SH and K2 already extracted along the luminance axis.
+void makeZH3Packet(const float sh[][3], const float k2[3], ZH3Packet& packet);
+// Fit the packet from cosine-convolved linear SH alone, hallucinating K2 along the
+// luminance axis with the curve fit of ZH3Hallucinate_EvalIrradianceLumAxis in st.cpp.
+void fitZH3Hallucinated(const float sh[4][3], ZH3Packet& packet);
+void evalZH3Packet(const ZH3Packet& packet, const float n[3], float out[3]);